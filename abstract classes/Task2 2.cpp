@@ -3,83 +3,605 @@
 #include <string>
 #include <stdexcept>
 #include <memory>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string_view>
+#include <unordered_map>
+#include <cmath>
+#include <cassert>
+
+// Уровни журнала событий
+enum class LogLevel : unsigned char {
+    Debug,   // Создание, копирование, присваивание и уничтожение ТС, скидки
+    Info,    // Посадка и высадка
+    Warning, // Отказ в посадке
+    Off
+};
+
+// Наименьший уровень, который компилируется (0 - Debug, 3 - Off); события ниже него
+// удаляются из программы целиком, например: g++ -DTRANSPORT_LOG_LEVEL=2
+#ifndef TRANSPORT_LOG_LEVEL
+#define TRANSPORT_LOG_LEVEL 0
+#endif
+
+// Журнал скомпилирован хотя бы для одного уровня; иначе он не создаётся и поток вывода не запускается
+constexpr bool LOG_COMPILED = TRANSPORT_LOG_LEVEL < static_cast<int>(LogLevel::Off);
+
+// События ТС
+enum class LogEvent : unsigned char {
+    Created,
+    Copied,
+    Assigned,
+    Destroyed,
+    Embarked,
+    NoRoom,
+    Disembarked,
+    DisembarkedAll,
+    ChildDiscount,
+    SeniorDiscount,
+    NoDiscount
+};
+
+// Запись журнала: текст по ней составляет только поток вывода журнала
+struct LogRecord {
+    LogLevel level;
+    LogEvent event;
+    unsigned value; // Количество ТС или пассажиров, если событие его содержит
+};
+
+// Журнал событий. Записи кладутся в кольцевой буфер без блокировок (ячейка с номером
+// последовательности, очередь Вьюкова для многих писателей) и выводятся в std::cout
+// фоновым потоком пачками с одним сбросом на пачку. Если буфер полон, запись теряется
+// и учитывается в счётчике потерянных, писатель не ждёт. Пустой буфер фоновый поток
+// ждёт на условной переменной; будит его первый писатель после опустошения буфера.
+class EventLog {
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    static const size_t CAPACITY = 1 << 14; // Степень двойки
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> head{0};  // Следующая позиция записи (писатели)
+    alignas(64) size_t tail = 0;              // Следующая позиция чтения (только фоновый поток)
+    std::atomic<size_t> processed{0};         // Сколько записей выведено
+    std::atomic<size_t> dropped{0};
+    std::atomic<LogLevel> level{LogLevel::Debug};
+    std::atomic<bool> stopping{false};
+    std::atomic<bool> idle{false};            // Фоновый поток ждёт записей
+    std::mutex wakeLock;
+    std::condition_variable wake;             // Новые записи, остановка и вывод пачки (для flush)
+    std::thread drainer;
+
+    EventLog() : cells(new Cell[CAPACITY]) {
+        for (size_t i = 0; i < CAPACITY; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        drainer = std::thread([this] { drain(); });
+    }
+
+    // Следующая запись опубликована писателем
+    bool ready() const {
+        return cells[tail & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == tail + 1;
+    }
+
+    // Пробуждение ждущих wake: захват мьютекса не даёт уведомлению проскочить между
+    // проверкой условия и засыпанием
+    void notify() {
+        { std::lock_guard<std::mutex> guard(wakeLock); }
+        wake.notify_all();
+    }
+
+    bool pop(LogRecord& record) {
+        Cell& cell = cells[tail & (CAPACITY - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != tail + 1) {
+            return false;
+        }
+        record = cell.record;
+        cell.sequence.store(tail + CAPACITY, std::memory_order_release);
+        tail++;
+        return true;
+    }
+
+    static void print(const LogRecord& record) {
+        switch (record.event) {
+            case LogEvent::Created:
+                std::cout << "Создано транспортное средство. Всего: " << record.value << '\n';
+                break;
+            case LogEvent::Copied:
+                std::cout << "Создана копия транспортного средства. Всего: " << record.value << '\n';
+                break;
+            case LogEvent::Assigned:
+                std::cout << "Транспортному средству присвоены новые значения.\n";
+                break;
+            case LogEvent::Destroyed:
+                std::cout << "Транспортное средство уничтожено. Всего: " << record.value << '\n';
+                break;
+            case LogEvent::Embarked:
+                std::cout << "Посажено " << record.value << " пассажиров.\n";
+                break;
+            case LogEvent::NoRoom:
+                std::cout << "Недостаточно места для " << record.value << " пассажиров.\n";
+                break;
+            case LogEvent::Disembarked:
+                std::cout << "Высажено " << record.value << " пассажиров.\n";
+                break;
+            case LogEvent::DisembarkedAll:
+                std::cout << "Высажено " << record.value << " пассажиров (все).\n";
+                break;
+            case LogEvent::ChildDiscount:
+                std::cout << "Применена детская скидка (50%).\n";
+                break;
+            case LogEvent::SeniorDiscount:
+                std::cout << "Применена пенсионная скидка (30%).\n";
+                break;
+            case LogEvent::NoDiscount:
+                std::cout << "Скидка не применена.\n";
+                break;
+        }
+    }
+
+    // Фоновый поток: выводит всё, что есть в буфере, и засыпает, когда буфер пуст
+    void drain() {
+        LogRecord record;
+        for (;;) {
+            size_t count = 0;
+            while (pop(record)) {
+                print(record);
+                count++;
+            }
+            if (count) {
+                std::cout.flush();
+                processed.fetch_add(count, std::memory_order_release);
+                notify();
+            } else if (stopping.load() && processed.load() == head.load()) {
+                break;
+            } else {
+                // Флаг ставится до проверки буфера, а писатель проверяет его после публикации
+                // записи (барьеры с обеих сторон), поэтому хотя бы один из них видит другого
+                std::unique_lock<std::mutex> guard(wakeLock);
+                idle.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                wake.wait(guard, [this] { return !idle.load(std::memory_order_relaxed) || stopping.load() || ready(); });
+                idle.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+
+public:
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    ~EventLog() {
+        stopping = true;
+        notify();
+        drainer.join();
+        if (dropped.load()) {
+            std::cerr << "Журнал: потеряно записей: " << dropped.load() << std::endl;
+        }
+    }
+
+    static EventLog& instance() {
+        static EventLog log;
+        return log;
+    }
+
+    // Уровень, начиная с которого записи попадают в журнал во время работы
+    void setLevel(LogLevel newLevel) { level.store(newLevel, std::memory_order_relaxed); }
+    LogLevel getLevel() const { return level.load(std::memory_order_relaxed); }
+    bool enabled(LogLevel recordLevel) const { return recordLevel >= getLevel(); }
+
+    void push(const LogRecord& record) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & (CAPACITY - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence == pos) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.record = record;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    if (idle.load(std::memory_order_relaxed) && idle.exchange(false)) {
+                        notify(); // Буфер был пуст
+                    }
+                    return;
+                }
+            } else if (sequence < pos) {
+                dropped.fetch_add(1, std::memory_order_relaxed); // Буфер полон
+                return;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Ожидание вывода всех записей, сделанных до вызова (перед выводом меню)
+    void flush() {
+        size_t target = head.load();
+        std::unique_lock<std::mutex> guard(wakeLock);
+        wake.wait(guard, [this, target] { return processed.load(std::memory_order_acquire) >= target; });
+    }
+};
+
+// Запись события в журнал; события уровня ниже TRANSPORT_LOG_LEVEL не компилируются
+template <LogLevel Level>
+inline void logEvent(LogEvent event, unsigned value = 0) {
+    if constexpr (static_cast<int>(Level) >= TRANSPORT_LOG_LEVEL) {
+        EventLog& log = EventLog::instance();
+        if (log.enabled(Level)) {
+            log.push({Level, event, value});
+        }
+    }
+}
+
+// Ожидание вывода событий журнала (перед выводом меню); без журнала ничего не делает
+inline void flushLog() {
+    if constexpr (LOG_COMPILED) {
+        EventLog::instance().flush();
+    }
+}
+
+// Временное изменение уровня журнала (например, отключение на время замера)
+class LogLevelScope {
+private:
+    LogLevel saved = LogLevel::Off;
+
+public:
+    explicit LogLevelScope(LogLevel level) {
+        if constexpr (LOG_COMPILED) {
+            saved = EventLog::instance().getLevel();
+            EventLog::instance().setLevel(level);
+        } else {
+            (void)level;
+        }
+    }
+    LogLevelScope(const LogLevelScope&) = delete;
+    LogLevelScope& operator=(const LogLevelScope&) = delete;
+    ~LogLevelScope() {
+        if constexpr (LOG_COMPILED) {
+            EventLog::instance().setLevel(saved);
+        }
+    }
+};
+
+// Тип транспортного средства. Набор типов закрыт, поэтому тип хранится в самом объекте,
+// и по нему можно выбрать производный класс без виртуального вызова и dynamic_cast.
+enum class VehicleType : unsigned char {
+    Bus,
+    Tram
+};
+
+const size_t VEHICLE_TYPE_COUNT = 2;
+
+// Название типа, как у getType()
+const char* vehicleTypeName(VehicleType type) {
+    return type == VehicleType::Bus ? "Автобус" : "Трамвай";
+}
+
+// Номер маршрута в пуле названий: плотный, с 0
+using RouteId = unsigned;
+
+const RouteId NO_ROUTE = static_cast<RouteId>(-1);
+
+// Пул названий маршрутов: каждое название хранится один раз, а ТС хранят номер маршрута
+// и представление названия из пула вместо своей копии строки. Названия не удаляются и не
+// перемещаются, поэтому представления действительны до конца программы.
+class RoutePool {
+private:
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, RouteId> ids; // Ключи - представления строк names
+    mutable std::mutex lock; // ТС могут создаваться в нескольких потоках
+
+    RoutePool() = default;
+
+public:
+    RoutePool(const RoutePool&) = delete;
+    RoutePool& operator=(const RoutePool&) = delete;
+
+    static RoutePool& instance() {
+        static RoutePool pool;
+        return pool;
+    }
+
+    // Номер маршрута (название добавляется в пул, если его там нет)
+    RouteId intern(std::string_view name) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = ids.find(name);
+        if (it != ids.end()) {
+            return it->second;
+        }
+        names.emplace_back(name);
+        RouteId id = static_cast<RouteId>(names.size() - 1);
+        ids.emplace(names.back(), id);
+        return id;
+    }
+
+    // Номер маршрута без добавления; NO_ROUTE, если такого названия нет
+    RouteId find(std::string_view name) const {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = ids.find(name);
+        return it != ids.end() ? it->second : NO_ROUTE;
+    }
+
+    std::string_view name(RouteId id) const {
+        std::lock_guard<std::mutex> guard(lock);
+        return names.at(id);
+    }
+
+    size_t size() const {
+        std::lock_guard<std::mutex> guard(lock);
+        return names.size();
+    }
+};
+
+// Итоги по группе транспортных средств
+struct FleetTotals {
+    size_t vehicles = 0;
+    unsigned long long capacity = 0;
+    unsigned long long passengers = 0;
+    double revenue = 0.0;
+};
+
+// Выручка в счётчиках итогов хранится целым числом в 1/REVENUE_SCALE денежной единицы:
+// тогда приращения складываются точно и атомарно, без накопления ошибки округления
+const long long REVENUE_SCALE = 10000;
+
+// Итоги группы ТС, которые обновляются атомарными приращениями и читаются без блокировок.
+// Поля читаются по отдельности, поэтому во время обновлений снимок может сочетать значения
+// до и после одного изменения.
+struct LiveTotals {
+    std::atomic<long long> vehicles{0};
+    std::atomic<long long> capacity{0};
+    std::atomic<long long> passengers{0};
+    std::atomic<long long> revenue{0}; // В 1/REVENUE_SCALE
+
+    void add(long long vehicleDelta, long long capacityDelta, long long passengerDelta, long long revenueDelta) {
+        if (vehicleDelta) {
+            vehicles.fetch_add(vehicleDelta, std::memory_order_relaxed);
+            capacity.fetch_add(capacityDelta, std::memory_order_relaxed);
+        }
+        passengers.fetch_add(passengerDelta, std::memory_order_relaxed);
+        revenue.fetch_add(revenueDelta, std::memory_order_relaxed);
+    }
+
+    FleetTotals snapshot() const {
+        FleetTotals totals;
+        totals.vehicles = static_cast<size_t>(vehicles.load(std::memory_order_relaxed));
+        totals.capacity = static_cast<unsigned long long>(capacity.load(std::memory_order_relaxed));
+        totals.passengers = static_cast<unsigned long long>(passengers.load(std::memory_order_relaxed));
+        totals.revenue = static_cast<double>(revenue.load(std::memory_order_relaxed)) / REVENUE_SCALE;
+        return totals;
+    }
+};
+
+// Текущие итоги парка: всего, по типам и по маршрутам. Посадка и высадка меняют их за O(1)
+// (несколько атомарных сложений), поэтому итоги можно читать из других потоков сколько
+// угодно часто без прохода по парку. Итоги маршрутов лежат в участках по ROUTE_CHUNK,
+// которые создаются при первом ТС маршрута и не перемещаются; таблица участков постоянного
+// размера, поэтому читатели обходятся без блокировок.
+class FleetAggregates {
+private:
+    static const size_t ROUTE_CHUNK = 1024;
+    static const size_t ROUTE_CHUNKS = 4096; // До 4 млн маршрутов
+
+    LiveTotals total;
+    std::array<LiveTotals, VEHICLE_TYPE_COUNT> byType;
+    std::unique_ptr<std::atomic<LiveTotals*>[]> routeChunks;
+
+    LiveTotals* findRoute(RouteId route) const {
+        if (route / ROUTE_CHUNK >= ROUTE_CHUNKS) {
+            return nullptr;
+        }
+        LiveTotals* chunk = routeChunks[route / ROUTE_CHUNK].load(std::memory_order_acquire);
+        return chunk ? &chunk[route % ROUTE_CHUNK] : nullptr;
+    }
+
+    // Итоги маршрута для изменения; участок создаётся при первом обращении
+    LiveTotals& routeSlot(RouteId route) {
+        if (route / ROUTE_CHUNK >= ROUTE_CHUNKS) {
+            throw std::length_error("Слишком много маршрутов для итогов парка");
+        }
+        std::atomic<LiveTotals*>& slot = routeChunks[route / ROUTE_CHUNK];
+        LiveTotals* chunk = slot.load(std::memory_order_acquire);
+        if (!chunk) {
+            LiveTotals* created = new LiveTotals[ROUTE_CHUNK];
+            if (slot.compare_exchange_strong(chunk, created, std::memory_order_acq_rel)) {
+                chunk = created;
+            } else {
+                delete[] created; // Участок успел создать другой поток
+            }
+        }
+        return chunk[route % ROUTE_CHUNK];
+    }
+
+public:
+    FleetAggregates() : routeChunks(new std::atomic<LiveTotals*>[ROUTE_CHUNKS]) {
+        for (size_t i = 0; i < ROUTE_CHUNKS; ++i) {
+            routeChunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    FleetAggregates(const FleetAggregates&) = delete;
+    FleetAggregates& operator=(const FleetAggregates&) = delete;
+
+    ~FleetAggregates() {
+        for (size_t i = 0; i < ROUTE_CHUNKS; ++i) {
+            delete[] routeChunks[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Изменение итогов ТС типа type на маршруте route (выручка - в 1/REVENUE_SCALE)
+    void update(VehicleType type, RouteId route, long long vehicleDelta, long long capacityDelta,
+                long long passengerDelta, long long revenueDelta) {
+        LiveTotals& routeTotal = routeSlot(route);
+        total.add(vehicleDelta, capacityDelta, passengerDelta, revenueDelta);
+        byType[static_cast<size_t>(type)].add(vehicleDelta, capacityDelta, passengerDelta, revenueDelta);
+        routeTotal.add(vehicleDelta, capacityDelta, passengerDelta, revenueDelta);
+    }
+
+    // Создание итогов маршрута заранее, чтобы update для него не выделял память и не бросал
+    void reserveRoute(RouteId route) { routeSlot(route); }
+
+    FleetTotals totals() const { return total.snapshot(); }
+    FleetTotals typeTotals(VehicleType type) const { return byType[static_cast<size_t>(type)].snapshot(); }
+
+    FleetTotals routeTotals(RouteId route) const {
+        const LiveTotals* totals = findRoute(route);
+        return totals ? totals->snapshot() : FleetTotals();
+    }
+};
+
+class Fleet;
 
 class PassengerTransport {
 protected:
-    std::string routeNumber; // Номер маршрута
+    RouteId routeId; // Номер маршрута в пуле названий
+    std::string_view routeNumber; // Название маршрута (из пула)
     unsigned passengerCapacity; // Вместимость пассажиров
-    unsigned currentPassengers; // Текущее количество пассажиров
+    std::atomic<unsigned> currentPassengers; // Текущее количество пассажиров (меняется из нескольких потоков)
     double ticketPrice; // Цена билета
+    VehicleType vehicleType; // Тип (задаётся производным классом)
+    Fleet* fleet = nullptr; // Парк, в который входит ТС (задаёт Fleet)
+    FleetAggregates* aggregates = nullptr; // Итоги этого парка
 
-    static unsigned totalVehicles; // Общее количество транспортных средств
+    static std::atomic<unsigned> totalVehicles; // Общее количество транспортных средств
 
-public:
-    // Конструктор по умолчанию
-    PassengerTransport(const std::string& route = "Неизвестно", unsigned capacity = 50, double price = 20.0) :
-        routeNumber(route), passengerCapacity(capacity), currentPassengers(0), ticketPrice(price) {
-        totalVehicles++;
-        std::cout << "Создано транспортное средство. Всего: " << totalVehicles << std::endl;
+    // Конструктор по умолчанию (класс абстрактный, тип передаёт производный класс)
+    PassengerTransport(VehicleType type, const std::string& route = "Неизвестно", unsigned capacity = 50, double price = 20.0) :
+        routeId(RoutePool::instance().intern(route)), routeNumber(RoutePool::instance().name(routeId)),
+        passengerCapacity(capacity), currentPassengers(0), ticketPrice(price), vehicleType(type) {
+        unsigned total = ++totalVehicles;
+        logEvent<LogLevel::Debug>(LogEvent::Created, total);
     }
 
+public:
     // Конструктор копирования
     PassengerTransport(const PassengerTransport& other) :
-        routeNumber(other.routeNumber), passengerCapacity(other.passengerCapacity),
-        currentPassengers(other.currentPassengers), ticketPrice(other.ticketPrice) {
-        totalVehicles++;
-        std::cout << "Создана копия транспортного средства. Всего: " << totalVehicles << std::endl;
+        routeId(other.routeId), routeNumber(other.routeNumber), passengerCapacity(other.passengerCapacity),
+        currentPassengers(other.getCurrentPassengers()), ticketPrice(other.ticketPrice), vehicleType(other.vehicleType) {
+        unsigned total = ++totalVehicles;
+        logEvent<LogLevel::Debug>(LogEvent::Copied, total);
     }
 
     // Оператор присваивания
     PassengerTransport& operator=(const PassengerTransport& other) {
         if (this != &other) {
+            if (other.routeId != routeId) {
+                moveToRoute(other.routeId); // Списки маршрутов парка
+            }
+            contribute(-1); // Итоги парка пересчитываются по новым значениям
+            routeId = other.routeId;
             routeNumber = other.routeNumber;
             passengerCapacity = other.passengerCapacity;
-            currentPassengers = other.currentPassengers;
+            currentPassengers.store(other.getCurrentPassengers(), std::memory_order_relaxed);
             ticketPrice = other.ticketPrice;
+            contribute(1);
         }
-        std::cout << "Транспортному средству присвоены новые значения." << std::endl;
+        logEvent<LogLevel::Debug>(LogEvent::Assigned);
         return *this;
     }
 
     // Виртуальный деструктор
     virtual ~PassengerTransport() {
-        totalVehicles--;
-        std::cout << "Транспортное средство уничтожено. Всего: " << totalVehicles << std::endl;
+        unsigned total = --totalVehicles;
+        logEvent<LogLevel::Debug>(LogEvent::Destroyed, total);
     }
 
     // Константные методы
-    std::string getRouteNumber() const { return routeNumber; }
+    std::string_view getRouteNumber() const { return routeNumber; }
+    RouteId getRouteId() const { return routeId; }
     unsigned getPassengerCapacity() const { return passengerCapacity; }
-    unsigned getCurrentPassengers() const { return currentPassengers; }
+    unsigned getCurrentPassengers() const { return currentPassengers.load(std::memory_order_relaxed); }
     double getTicketPrice() const { return ticketPrice; }
+    VehicleType getVehicleType() const { return vehicleType; }
     static unsigned getTotalVehicles() { return totalVehicles; }
     virtual std::string getType() const { return "Пассажирский транспорт"; }
 
+private:
+    friend class Fleet;
+
+    // Цена билета в единицах итогов парка
+    long long priceUnits() const { return std::llround(ticketPrice * REVENUE_SCALE); }
+
+    // Учёт изменения числа пассажиров в итогах парка
+    void passengersChanged(long long delta) {
+        if (aggregates && delta) {
+            aggregates->update(vehicleType, routeId, 0, 0, delta, delta * priceUnits());
+        }
+    }
+
+    // Перенос ТС парка в список маршрута route до смены маршрута (определён после Fleet)
+    void moveToRoute(RouteId route);
+
+    // Добавление (sign == 1) или вычитание (sign == -1) всего ТС из итогов парка
+    void contribute(long long sign) {
+        if (aggregates) {
+            long long passengers = getCurrentPassengers();
+            aggregates->update(vehicleType, routeId, sign, sign * passengerCapacity, sign * passengers,
+                               sign * passengers * priceUnits());
+        }
+    }
+
+public:
+    // Посадка без сообщений; можно вызывать из нескольких потоков одновременно. Проверка
+    // места и увеличение выполняются одним сравнением с обменом: если другой поток успел
+    // изменить число пассажиров, проверка повторяется с новым значением.
+    bool tryEmbark(unsigned numPassengers) {
+        unsigned current = currentPassengers.load(std::memory_order_relaxed);
+        do {
+            if (current > passengerCapacity || numPassengers > passengerCapacity - current) {
+                return false;
+            }
+        } while (!currentPassengers.compare_exchange_weak(current, current + numPassengers, std::memory_order_relaxed));
+        passengersChanged(numPassengers);
+        return true;
+    }
+
+    // Высадка без сообщений (потокобезопасна так же); если пассажиров меньше, высаживаются все.
+    // Возвращает число высаженных.
+    unsigned tryDisembark(unsigned numPassengers) {
+        unsigned current = currentPassengers.load(std::memory_order_relaxed);
+        unsigned left;
+        do {
+            left = numPassengers > current ? 0 : current - numPassengers;
+        } while (!currentPassengers.compare_exchange_weak(current, left, std::memory_order_relaxed));
+        passengersChanged(-static_cast<long long>(current - left));
+        return current - left;
+    }
+
     // Другие методы
     virtual bool embarkPassengers(unsigned numPassengers) {
-        if (currentPassengers + numPassengers <= passengerCapacity) {
-            currentPassengers += numPassengers;
-            std::cout << "Посажено " << numPassengers << " пассажиров." << std::endl;
+        if (tryEmbark(numPassengers)) {
+            logEvent<LogLevel::Info>(LogEvent::Embarked, numPassengers);
             return true;
         }
-        std::cout << "Недостаточно места для " << numPassengers << " пассажиров." << std::endl;
+        logEvent<LogLevel::Warning>(LogEvent::NoRoom, numPassengers);
         return false;
     }
 
     virtual void disembarkPassengers(unsigned numPassengers) {
-        if (numPassengers > currentPassengers) {
-            std::cout << "Высажено " << currentPassengers << " пассажиров (все)." << std::endl;
-            currentPassengers = 0;
+        unsigned removed = tryDisembark(numPassengers);
+        if (removed < numPassengers) {
+            logEvent<LogLevel::Info>(LogEvent::DisembarkedAll, removed);
         } else {
-            currentPassengers -= numPassengers;
-            std::cout << "Высажено " << numPassengers << " пассажиров." << std::endl;
+            logEvent<LogLevel::Info>(LogEvent::Disembarked, numPassengers);
         }
     }
 
     // Дружественная функция для вывода в поток
     friend std::ostream& operator<<(std::ostream& os, const PassengerTransport& transport) {
-        os << "Тип: " << transport.getType() << ", Маршрут: " << transport.routeNumber << ", Вместимость: " << transport.passengerCapacity
-           << ", Пассажиров: " << transport.currentPassengers << ", Цена: " << transport.ticketPrice
+        os << "Тип: " << vehicleTypeName(transport.vehicleType) << ", Маршрут: " << transport.routeNumber << ", Вместимость: " << transport.passengerCapacity
+           << ", Пассажиров: " << transport.getCurrentPassengers() << ", Цена: " << transport.ticketPrice
            << ", Всего ТС: " << PassengerTransport::getTotalVehicles();
         return os;
     }
@@ -89,12 +611,12 @@ public:
         double discount = 0.0;
         if (age <= 7) {
             discount = 0.5; // 50% скидка для детей до 7 лет
-            std::cout << "Применена детская скидка (50%)." << std::endl;
+            logEvent<LogLevel::Debug>(LogEvent::ChildDiscount);
         } else if (age >= 65) {
             discount = 0.3; // 30% скидка для пенсионеров
-            std::cout << "Применена пенсионная скидка (30%)." << std::endl;
+            logEvent<LogLevel::Debug>(LogEvent::SeniorDiscount);
         } else {
-            std::cout << "Скидка не применена." << std::endl;
+            logEvent<LogLevel::Debug>(LogEvent::NoDiscount);
         }
         return ticketPrice * (1 - discount); // Цена со скидкой
     }
@@ -103,15 +625,15 @@ public:
     virtual double calculateRevenue() const = 0;
 };
 
-unsigned PassengerTransport::totalVehicles = 0;
+std::atomic<unsigned> PassengerTransport::totalVehicles{0};
 
-class Bus : public PassengerTransport {
+class Bus final : public PassengerTransport {
 private:
     bool hasWifi; // Есть ли Wi-Fi
 
 public:
     Bus(const std::string& route = "Городской", unsigned capacity = 40, double price = 25.0, bool wifi = false) :
-        PassengerTransport(route, capacity, price), hasWifi(wifi) {}
+        PassengerTransport(VehicleType::Bus, route, capacity, price), hasWifi(wifi) {}
 
     Bus(const Bus& other) : PassengerTransport(other), hasWifi(other.hasWifi) {}
 
@@ -135,17 +657,17 @@ public:
     std::string getType() const override { return "Автобус"; }
 
     double calculateRevenue() const override {
-        return currentPassengers * ticketPrice;
+        return getCurrentPassengers() * ticketPrice;
     }
 };
 
-class Tram : public PassengerTransport {
+class Tram final : public PassengerTransport {
 private:
     unsigned numberOfCars; // Количество вагонов
 
 public:
     Tram(const std::string& route = "Трамвайная линия", unsigned capacity = 100, double price = 18.0, unsigned cars = 3) :
-        PassengerTransport(route, capacity, price), numberOfCars(cars) {}
+        PassengerTransport(VehicleType::Tram, route, capacity, price), numberOfCars(cars) {}
 
     Tram(const Tram& other) : PassengerTransport(other), numberOfCars(other.numberOfCars) {}
 
@@ -164,16 +686,930 @@ public:
         return os;
     }
 
+    unsigned getNumberOfCars() const { return numberOfCars; }
+
     std::string getType() const override { return "Трамвай"; }
 
     double calculateRevenue() const override {
-        return currentPassengers * ticketPrice;
+        return getCurrentPassengers() * ticketPrice;
+    }
+};
+
+// Пул объектов одного типа: память выделяется участками (slab) по SlabSize объектов и не
+// перемещается, поэтому адреса объектов постоянны, а объекты одного типа лежат плотно.
+// Освобождённые ячейки образуют односвязный список и занимаются повторно за O(1).
+// Объекты, созданные create, нужно уничтожить через destroy до уничтожения пула.
+template <typename T, size_t SlabSize = 1024>
+class ObjectPool {
+private:
+    union Slot {
+        Slot* next; // Следующая свободная ячейка
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> slabs;
+    Slot* freeList = nullptr;
+    size_t slabUsed = SlabSize; // Сколько ячеек последнего участка уже выдано
+    size_t live = 0;
+
+    Slot* take() {
+        if (freeList) {
+            Slot* slot = freeList;
+            freeList = slot->next;
+            return slot;
+        }
+        if (slabUsed == SlabSize) {
+            // Участок принадлежит unique_ptr ещё до роста вектора: при bad_alloc он не теряется
+            auto slab = std::make_unique<Slot[]>(SlabSize);
+            slabs.push_back(std::move(slab));
+            slabUsed = 0;
+        }
+        return &slabs.back()[slabUsed++];
+    }
+
+    void release(Slot* slot) {
+        slot->next = freeList;
+        freeList = slot;
+    }
+
+public:
+    ObjectPool() = default;
+    ObjectPool(const ObjectPool&) = delete;
+    ObjectPool& operator=(const ObjectPool&) = delete;
+
+    template <typename... Args>
+    T* create(Args&&... args) {
+        Slot* slot = take();
+        try {
+            T* object = new (slot->storage) T(std::forward<Args>(args)...);
+            live++;
+            return object;
+        } catch (...) {
+            release(slot);
+            throw;
+        }
+    }
+
+    void destroy(T* object) {
+        object->~T();
+        release(reinterpret_cast<Slot*>(object));
+        live--;
+    }
+
+    size_t size() const { return live; }
+};
+
+// Парк главного меню: автобусы и трамваи создаются в своих пулах, порядок добавления
+// хранится в массиве указателей. Удалённое ТС освобождает ячейку пула для следующего.
+// Для каждого маршрута ведётся список его ТС (индекс - номер маршрута), поэтому ТС
+// маршрута находятся без просмотра всего парка. Если ТС парка присваивается ТС с другим
+// маршрутом, оно переносится в список нового маршрута.
+// Итоги парка (FleetAggregates) обновляются при добавлении и удалении ТС и при каждой
+// посадке и высадке.
+class Fleet {
+private:
+    ObjectPool<Bus> buses;
+    ObjectPool<Tram> trams;
+    std::vector<PassengerTransport*> vehicles;
+    std::vector<std::vector<PassengerTransport*>> routes;
+    FleetAggregates aggregates;
+
+    void attach(PassengerTransport* vehicle) {
+        vehicle->fleet = this;
+        vehicle->aggregates = &aggregates;
+        vehicle->contribute(1);
+    }
+
+    void detach(PassengerTransport* vehicle) {
+        vehicle->contribute(-1);
+        vehicle->fleet = nullptr;
+        vehicle->aggregates = nullptr;
+    }
+
+    void destroy(PassengerTransport* vehicle) {
+        detach(vehicle);
+        if (vehicle->getVehicleType() == VehicleType::Bus) {
+            buses.destroy(static_cast<Bus*>(vehicle));
+        } else {
+            trams.destroy(static_cast<Tram*>(vehicle));
+        }
+    }
+
+    template <typename T>
+    T* add(ObjectPool<T>& pool, T* vehicle) {
+        RouteId route = vehicle->getRouteId();
+        try {
+            if (route >= routes.size()) {
+                routes.resize(route + 1);
+            }
+            aggregates.reserveRoute(route);
+            routes[route].push_back(vehicle);
+            try {
+                vehicles.push_back(vehicle);
+            } catch (...) {
+                routes[route].pop_back();
+                throw;
+            }
+            attach(vehicle);
+        } catch (...) {
+            pool.destroy(vehicle);
+            throw;
+        }
+        return vehicle;
+    }
+
+    // Удаление ТС из списка его маршрута (порядок в списке не сохраняется)
+    void unindex(PassengerTransport* vehicle) {
+        std::vector<PassengerTransport*>& list = routes[vehicle->getRouteId()];
+        auto it = std::find(list.begin(), list.end(), vehicle);
+        assert(it != list.end() && "ТС нет в списке своего маршрута");
+        *it = list.back();
+        list.pop_back();
+    }
+
+    // Перенос ТС в список маршрута route (вызывается из присваивания до смены маршрута).
+    // Память под список и итоги нового маршрута выделяется до изменений: если выделить
+    // не удалось, ТС остаётся в прежнем списке.
+    void reindex(PassengerTransport* vehicle, RouteId route) {
+        if (route >= routes.size()) {
+            routes.resize(route + 1);
+        }
+        aggregates.reserveRoute(route);
+        routes[route].push_back(vehicle);
+        unindex(vehicle);
+    }
+
+    friend class PassengerTransport;
+
+public:
+    Fleet() = default;
+    Fleet(const Fleet&) = delete;
+    Fleet& operator=(const Fleet&) = delete;
+    ~Fleet() { clear(); }
+
+    Bus* addBus(const std::string& route, unsigned capacity, double price, bool wifi) {
+        return add(buses, buses.create(route, capacity, price, wifi));
+    }
+
+    Tram* addTram(const std::string& route, unsigned capacity, double price, unsigned cars) {
+        return add(trams, trams.create(route, capacity, price, cars));
+    }
+
+    void reserve(size_t count) { vehicles.reserve(count); }
+    size_t size() const { return vehicles.size(); }
+    PassengerTransport* operator[](size_t index) const { return vehicles[index]; }
+
+    // Удаление ТС с сохранением порядка остальных
+    void remove(size_t index) {
+        if (index >= vehicles.size()) {
+            throw std::out_of_range("Индекс транспортного средства вне диапазона");
+        }
+        unindex(vehicles[index]);
+        destroy(vehicles[index]);
+        vehicles.erase(vehicles.begin() + index);
+    }
+
+    // Удаление всех ТС в порядке добавления
+    void clear() {
+        for (PassengerTransport* vehicle : vehicles) {
+            destroy(vehicle);
+        }
+        vehicles.clear();
+        routes.clear();
+    }
+
+    // ТС маршрута (за O(1))
+    const std::vector<PassengerTransport*>& onRoute(RouteId route) const {
+        static const std::vector<PassengerTransport*> none;
+        return route < routes.size() ? routes[route] : none;
+    }
+
+    const std::vector<PassengerTransport*>& onRoute(std::string_view route) const {
+        return onRoute(RoutePool::instance().find(route));
+    }
+
+    // Текущие итоги: количество ТС, вместимость, пассажиры и выручка (за O(1), из любого потока)
+    FleetTotals totals() const { return aggregates.totals(); }
+    FleetTotals typeTotals(VehicleType type) const { return aggregates.typeTotals(type); }
+    FleetTotals routeTotals(RouteId route) const { return aggregates.routeTotals(route); }
+};
+
+void PassengerTransport::moveToRoute(RouteId route) {
+    if (fleet) {
+        fleet->reindex(this, route);
+    }
+}
+
+// Хранилище парка в виде параллельных массивов: маршрут, вместимость, пассажиры, цена билета
+// и тип каждого ТС лежат в отдельных непрерывных массивах под одним индексом. Массовые
+// подсчёты по всему парку проходят по памяти подряд без виртуальных вызовов, и компилятор
+// их векторизует. Для работы с отдельным ТС есть представление Vehicle с интерфейсом
+// PassengerTransport (без вывода сообщений в консоль).
+class FleetStore {
+private:
+    std::vector<RouteId> routes;
+    std::vector<unsigned> capacities;
+    std::vector<unsigned> passengers;
+    std::vector<double> prices;
+    std::vector<VehicleType> types;
+    std::vector<unsigned> extras; // Wi-Fi (0 или 1) у автобуса, количество вагонов у трамвая
+
+    size_t add(VehicleType type, const std::string& route, unsigned capacity, double price, unsigned extra) {
+        routes.push_back(RoutePool::instance().intern(route));
+        capacities.push_back(capacity);
+        passengers.push_back(0);
+        prices.push_back(price);
+        types.push_back(type);
+        extras.push_back(extra);
+        return types.size() - 1;
+    }
+
+public:
+    // Представление одного ТС хранилища; действительно, пока хранилище существует
+    class Vehicle {
+    private:
+        FleetStore* store;
+        size_t index;
+
+    public:
+        Vehicle(FleetStore* store, size_t index) : store(store), index(index) {}
+
+        size_t getIndex() const { return index; }
+        std::string_view getRouteNumber() const { return RoutePool::instance().name(getRouteId()); }
+        RouteId getRouteId() const { return store->routes[index]; }
+        unsigned getPassengerCapacity() const { return store->capacities[index]; }
+        unsigned getCurrentPassengers() const { return store->passengers[index]; }
+        double getTicketPrice() const { return store->prices[index]; }
+        VehicleType getVehicleType() const { return store->types[index]; }
+        std::string getType() const { return vehicleTypeName(getVehicleType()); }
+        bool getHasWifi() const { return getVehicleType() == VehicleType::Bus && store->extras[index] != 0; }
+        unsigned getNumberOfCars() const { return getVehicleType() == VehicleType::Tram ? store->extras[index] : 0; }
+
+        bool embarkPassengers(unsigned numPassengers) {
+            unsigned& current = store->passengers[index];
+            unsigned capacity = store->capacities[index];
+            if (current > capacity || numPassengers > capacity - current) {
+                return false; // Сравнение без сложения, которое переполнилось бы
+            }
+            current += numPassengers;
+            return true;
+        }
+
+        void disembarkPassengers(unsigned numPassengers) {
+            unsigned& current = store->passengers[index];
+            current = numPassengers > current ? 0 : current - numPassengers;
+        }
+
+        double calculateRevenue() const { return getCurrentPassengers() * getTicketPrice(); }
+
+        // Цена билета по возрасту, как у PassengerTransport::operator[]
+        double operator[](unsigned age) const {
+            double discount = age <= 7 ? 0.5 : age >= 65 ? 0.3 : 0.0;
+            return getTicketPrice() * (1 - discount);
+        }
+
+        friend std::ostream& operator<<(std::ostream& os, const Vehicle& vehicle) {
+            os << "Тип: " << vehicle.getType() << ", Маршрут: " << vehicle.getRouteNumber()
+               << ", Вместимость: " << vehicle.getPassengerCapacity() << ", Пассажиров: " << vehicle.getCurrentPassengers()
+               << ", Цена: " << vehicle.getTicketPrice() << ", Всего ТС: " << vehicle.store->size();
+            if (vehicle.getVehicleType() == VehicleType::Bus) {
+                os << ", Wi-Fi: " << (vehicle.getHasWifi() ? "Да" : "Нет");
+            } else {
+                os << ", Вагонов: " << vehicle.getNumberOfCars();
+            }
+            return os;
+        }
+    };
+
+    size_t addBus(const std::string& route, unsigned capacity, double price, bool wifi) {
+        return add(VehicleType::Bus, route, capacity, price, wifi ? 1 : 0);
+    }
+
+    size_t addTram(const std::string& route, unsigned capacity, double price, unsigned cars) {
+        return add(VehicleType::Tram, route, capacity, price, cars);
+    }
+
+    void reserve(size_t count) {
+        routes.reserve(count);
+        capacities.reserve(count);
+        passengers.reserve(count);
+        prices.reserve(count);
+        types.reserve(count);
+        extras.reserve(count);
+    }
+
+    size_t size() const { return types.size(); }
+
+    Vehicle operator[](size_t index) { return Vehicle(this, index); }
+
+    Vehicle at(size_t index) {
+        if (index >= size()) {
+            throw std::out_of_range("Индекс транспортного средства вне диапазона");
+        }
+        return Vehicle(this, index);
+    }
+
+    // Выручка всего парка. Сумма ведётся в четыре независимых накопителя: сложение double
+    // по порядку компилятор векторизовать не может, а четыре суммы складываются параллельно.
+    double totalRevenue() const {
+        const unsigned* p = passengers.data();
+        const double* c = prices.data();
+        size_t n = size();
+        double sum[4] = {0.0, 0.0, 0.0, 0.0};
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            for (size_t k = 0; k < 4; ++k) {
+                sum[k] += p[i + k] * c[i + k];
+            }
+        }
+        for (; i < n; ++i) {
+            sum[0] += p[i] * c[i];
+        }
+        return (sum[0] + sum[1]) + (sum[2] + sum[3]);
+    }
+
+    // Итоги по каждому типу ТС (индекс - VehicleType). Каждый тип считается отдельным
+    // проходом: значения умножаются на маску 0 или 1 вместо ветвления, чтобы цикл векторизовался.
+    std::array<FleetTotals, VEHICLE_TYPE_COUNT> totalsByType() const {
+        std::array<FleetTotals, VEHICLE_TYPE_COUNT> totals;
+        const unsigned* cap = capacities.data();
+        const unsigned* p = passengers.data();
+        const double* c = prices.data();
+        const VehicleType* t = types.data();
+        size_t n = size();
+        for (size_t type = 0; type < VEHICLE_TYPE_COUNT; ++type) {
+            VehicleType match = static_cast<VehicleType>(type);
+            size_t vehicles = 0;
+            unsigned long long capacity = 0, current = 0;
+            double sum[4] = {0.0, 0.0, 0.0, 0.0};
+            size_t i = 0;
+            for (; i + 4 <= n; i += 4) {
+                for (size_t k = 0; k < 4; ++k) {
+                    unsigned m = t[i + k] == match;
+                    vehicles += m;
+                    capacity += cap[i + k] * m;
+                    current += p[i + k] * m;
+                    sum[k] += p[i + k] * m * c[i + k];
+                }
+            }
+            for (; i < n; ++i) {
+                unsigned m = t[i] == match;
+                vehicles += m;
+                capacity += cap[i] * m;
+                current += p[i] * m;
+                sum[0] += p[i] * m * c[i];
+            }
+            totals[type].vehicles = vehicles;
+            totals[type].capacity = capacity;
+            totals[type].passengers = current;
+            totals[type].revenue = (sum[0] + sum[1]) + (sum[2] + sum[3]);
+        }
+        return totals;
+    }
+
+    // Распределение ТС по заполненности: bins равных интервалов от 0 до 100%, полные ТС
+    // попадают в последний. Номера интервалов для блока ТС считаются отдельным циклом
+    // без ветвлений (он векторизуется), а раскладываются по интервалам вторым.
+    std::vector<size_t> occupancyHistogram(unsigned bins) const {
+        std::vector<size_t> histogram(bins, 0);
+        if (bins == 0) {
+            return histogram;
+        }
+        const unsigned* cap = capacities.data();
+        const unsigned* p = passengers.data();
+        size_t n = size();
+        const size_t BLOCK = 256;
+        unsigned bin[BLOCK];
+        for (size_t start = 0; start < n; start += BLOCK) {
+            size_t len = std::min(BLOCK, n - start);
+            for (size_t k = 0; k < len; ++k) {
+                float occupancy = static_cast<float>(p[start + k]) / static_cast<float>(std::max(cap[start + k], 1u));
+                unsigned b = static_cast<unsigned>(occupancy * bins);
+                bin[k] = std::min(b, bins - 1);
+            }
+            for (size_t k = 0; k < len; ++k) {
+                histogram[bin[k]]++;
+            }
+        }
+        return histogram;
+    }
+};
+
+// Парк с закрытым набором типов: ТС каждого типа хранятся в своём массиве объектов, и проход
+// по парку вызывает функцию отдельно для каждого типа с объектом точного типа. Bus и Tram
+// объявлены final, поэтому их методы вызываются напрямую, без таблицы виртуальных функций,
+// и компилятор может подставить их в цикл. ТС адресуется описателем (тип и номер в массиве типа).
+class TypedFleet {
+private:
+    std::vector<Bus> buses;
+    std::vector<Tram> trams;
+
+public:
+    struct Handle {
+        VehicleType type;
+        size_t index;
+    };
+
+    // Резерв места: при росте массива объекты копируются (с сообщениями конструкторов)
+    void reserve(size_t busCount, size_t tramCount) {
+        buses.reserve(busCount);
+        trams.reserve(tramCount);
+    }
+
+    Handle addBus(const std::string& route, unsigned capacity, double price, bool wifi) {
+        buses.emplace_back(route, capacity, price, wifi);
+        return {VehicleType::Bus, buses.size() - 1};
+    }
+
+    Handle addTram(const std::string& route, unsigned capacity, double price, unsigned cars) {
+        trams.emplace_back(route, capacity, price, cars);
+        return {VehicleType::Tram, trams.size() - 1};
+    }
+
+    size_t size() const { return buses.size() + trams.size(); }
+    std::vector<Bus>& getBuses() { return buses; }
+    const std::vector<Bus>& getBuses() const { return buses; }
+    std::vector<Tram>& getTrams() { return trams; }
+    const std::vector<Tram>& getTrams() const { return trams; }
+
+    // Вызов f для каждого ТС: сначала все автобусы, затем все трамваи
+    template <typename F>
+    void forEach(F&& f) {
+        for (Bus& bus : buses) {
+            f(bus);
+        }
+        for (Tram& tram : trams) {
+            f(tram);
+        }
+    }
+
+    template <typename F>
+    void forEach(F&& f) const {
+        for (const Bus& bus : buses) {
+            f(bus);
+        }
+        for (const Tram& tram : trams) {
+            f(tram);
+        }
+    }
+
+    // Вызов f для одного ТС; f должна возвращать один тип для Bus и Tram
+    template <typename F>
+    decltype(auto) visit(Handle handle, F&& f) {
+        if (handle.type == VehicleType::Bus) {
+            return f(buses.at(handle.index));
+        }
+        return f(trams.at(handle.index));
+    }
+
+    double totalRevenue() const {
+        double sum = 0.0;
+        forEach([&](const auto& vehicle) { sum += vehicle.calculateRevenue(); });
+        return sum;
+    }
+
+    // Автобусы с Wi-Fi: проход только по массиву автобусов вместо dynamic_cast каждого ТС
+    size_t countBusesWithWifi() const {
+        size_t count = 0;
+        for (const Bus& bus : buses) {
+            count += bus.getHasWifi();
+        }
+        return count;
     }
 };
 
+// Время выполнения f в миллисекундах
+template <typename F>
+double measureMs(F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Замер массовых подсчётов по хранилищу парка из count случайных ТС
+void benchmarkFleetStore(size_t count) {
+    FleetStore store;
+    store.reserve(count);
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<unsigned> capacityDist(30, 150);
+    std::uniform_int_distribution<unsigned> priceDist(15, 40);
+    double fillMs = measureMs([&] {
+        for (size_t i = 0; i < count; ++i) {
+            unsigned capacity = capacityDist(rng);
+            std::string route = std::to_string(i % 500);
+            size_t index = rng() % 2 ? store.addBus(route, capacity, priceDist(rng), rng() % 2)
+                                     : store.addTram(route, capacity, priceDist(rng), 1 + rng() % 4);
+            store[index].embarkPassengers(rng() % (capacity + 1));
+        }
+    });
+
+    double revenue = 0.0, perVehicle = 0.0;
+    std::array<FleetTotals, VEHICLE_TYPE_COUNT> totals;
+    std::vector<size_t> histogram;
+    double revenueMs = measureMs([&] { revenue = store.totalRevenue(); });
+    double perVehicleMs = measureMs([&] {
+        for (size_t i = 0; i < store.size(); ++i) {
+            perVehicle += store[i].calculateRevenue();
+        }
+    });
+    double totalsMs = measureMs([&] { totals = store.totalsByType(); });
+    double histogramMs = measureMs([&] { histogram = store.occupancyHistogram(10); });
+
+    std::cout << "Заполнение (" << count << " ТС): " << fillMs << " мс\n";
+    std::cout << "Общая выручка: " << revenue << " (" << revenueMs << " мс), по одному ТС: " << perVehicle << " ("
+              << perVehicleMs << " мс)\n";
+    std::cout << "Итоги по типам (" << totalsMs << " мс):\n";
+    for (size_t type = 0; type < VEHICLE_TYPE_COUNT; ++type) {
+        std::cout << "  " << vehicleTypeName(static_cast<VehicleType>(type)) << ": " << totals[type].vehicles
+                  << " ТС, вместимость " << totals[type].capacity << ", пассажиров " << totals[type].passengers
+                  << ", выручка " << totals[type].revenue << "\n";
+    }
+    std::cout << "Заполненность (" << histogramMs << " мс):\n";
+    for (size_t b = 0; b < histogram.size(); ++b) {
+        std::cout << "  " << b * 10 << "-" << (b + 1) * 10 << "%: " << histogram[b] << "\n";
+    }
+}
+
+// Сравнение прохода по парку через виртуальные вызовы (массив указателей на отдельно
+// созданные ТС, как в main) и через TypedFleet с вызовами по точному типу
+void benchmarkDispatch(size_t count) {
+    double virtualRevenue = 0.0, typedRevenue = 0.0;
+    size_t virtualWifi = 0, typedWifi = 0;
+    double virtualRevenueMs, typedRevenueMs, virtualWifiMs, typedWifiMs;
+    {
+        LogLevelScope quiet(LogLevel::Off); // Объявлен первым, поэтому действует и при удалении парков
+        std::vector<std::unique_ptr<PassengerTransport>> vehicles;
+        TypedFleet fleet;
+        vehicles.reserve(count);
+        fleet.reserve(count, count);
+        std::mt19937 rng(42);
+        for (size_t i = 0; i < count; ++i) {
+            std::string route = std::to_string(i % 500);
+            unsigned capacity = 30 + rng() % 121;
+            double price = 15 + rng() % 26;
+            unsigned passengers = rng() % (capacity + 1);
+            if (rng() % 2) {
+                bool wifi = rng() % 2;
+                vehicles.push_back(std::make_unique<Bus>(route, capacity, price, wifi));
+                fleet.visit(fleet.addBus(route, capacity, price, wifi),
+                            [&](auto& vehicle) { return vehicle.embarkPassengers(passengers); });
+            } else {
+                unsigned cars = 1 + rng() % 4;
+                vehicles.push_back(std::make_unique<Tram>(route, capacity, price, cars));
+                fleet.visit(fleet.addTram(route, capacity, price, cars),
+                            [&](auto& vehicle) { return vehicle.embarkPassengers(passengers); });
+            }
+            vehicles.back()->embarkPassengers(passengers);
+        }
+
+        virtualRevenueMs = measureMs([&] {
+            for (const auto& vehicle : vehicles) {
+                virtualRevenue += vehicle->calculateRevenue();
+            }
+        });
+        typedRevenueMs = measureMs([&] { typedRevenue = fleet.totalRevenue(); });
+        virtualWifiMs = measureMs([&] {
+            for (const auto& vehicle : vehicles) {
+                const Bus* bus = dynamic_cast<const Bus*>(vehicle.get());
+                virtualWifi += bus && bus->getHasWifi();
+            }
+        });
+        typedWifiMs = measureMs([&] { typedWifi = fleet.countBusesWithWifi(); });
+    }
+
+    std::cout << "Выручка: виртуальные вызовы " << virtualRevenue << " (" << virtualRevenueMs << " мс), по типам "
+              << typedRevenue << " (" << typedRevenueMs << " мс)\n";
+    std::cout << "Автобусы с Wi-Fi: dynamic_cast " << virtualWifi << " (" << virtualWifiMs << " мс), по типам "
+              << typedWifi << " (" << typedWifiMs << " мс)\n";
+}
+
+// Сравнение создания, прохода и удаления парка: отдельные объекты в куче с массивом указателей,
+// который растёт удвоением (как было в main), и Fleet с пулами по типам
+void benchmarkPools(size_t count) {
+    LogLevelScope quiet(LogLevel::Off);
+    double heapCreateMs, heapIterateMs, heapDestroyMs, poolCreateMs, poolIterateMs, poolDestroyMs;
+    double heapRevenue = 0.0, poolRevenue = 0.0;
+
+    {
+        PassengerTransport** vehicles = nullptr;
+        size_t vehiclesCount = 0, vehiclesCapacity = 0;
+        std::mt19937 rng(42);
+        heapCreateMs = measureMs([&] {
+            for (size_t i = 0; i < count; ++i) {
+                if (vehiclesCount == vehiclesCapacity) {
+                    size_t newCapacity = vehiclesCapacity == 0 ? 1 : vehiclesCapacity * 2;
+                    PassengerTransport** newVehicles = new PassengerTransport*[newCapacity];
+                    std::copy(vehicles, vehicles + vehiclesCount, newVehicles);
+                    delete[] vehicles;
+                    vehicles = newVehicles;
+                    vehiclesCapacity = newCapacity;
+                }
+                unsigned capacity = 30 + rng() % 121;
+                std::unique_ptr<PassengerTransport> vehicle;
+                if (rng() % 2) {
+                    vehicle = std::make_unique<Bus>(std::to_string(i % 500), capacity, 25.0, true);
+                } else {
+                    vehicle = std::make_unique<Tram>(std::to_string(i % 500), capacity, 18.0, 3);
+                }
+                vehicle->tryEmbark(capacity / 2);
+                vehicles[vehiclesCount++] = vehicle.release();
+            }
+        });
+        heapIterateMs = measureMs([&] {
+            for (size_t i = 0; i < vehiclesCount; ++i) {
+                heapRevenue += vehicles[i]->calculateRevenue();
+            }
+        });
+        heapDestroyMs = measureMs([&] {
+            for (size_t i = 0; i < vehiclesCount; ++i) {
+                delete vehicles[i];
+            }
+            delete[] vehicles;
+        });
+    }
+
+    {
+        Fleet fleet;
+        std::mt19937 rng(42);
+        poolCreateMs = measureMs([&] {
+            for (size_t i = 0; i < count; ++i) {
+                unsigned capacity = 30 + rng() % 121;
+                PassengerTransport* vehicle;
+                if (rng() % 2) {
+                    vehicle = fleet.addBus(std::to_string(i % 500), capacity, 25.0, true);
+                } else {
+                    vehicle = fleet.addTram(std::to_string(i % 500), capacity, 18.0, 3);
+                }
+                vehicle->tryEmbark(capacity / 2);
+            }
+        });
+        poolIterateMs = measureMs([&] {
+            for (size_t i = 0; i < fleet.size(); ++i) {
+                poolRevenue += fleet[i]->calculateRevenue();
+            }
+        });
+        poolDestroyMs = measureMs([&] { fleet.clear(); });
+    }
+
+    std::cout << "Отдельные объекты: создание " << heapCreateMs << " мс, проход " << heapIterateMs << " мс (выручка "
+              << heapRevenue << "), удаление " << heapDestroyMs << " мс\n";
+    std::cout << "Пулы по типам:     создание " << poolCreateMs << " мс, проход " << poolIterateMs << " мс (выручка "
+              << poolRevenue << "), удаление " << poolDestroyMs << " мс\n";
+}
+
+// Проверка посадки и высадки из нескольких потоков: потоки одновременно сажают и высаживают
+// пассажиров одного автобуса и создают и удаляют свои ТС, а наблюдатель следит, чтобы число
+// пассажиров не превышало вместимость. В конце число пассажиров должно совпасть с суммой
+// изменений, которые насчитали потоки, а общее количество ТС - вернуться к прежнему.
+bool stressTestBoarding(unsigned threads, size_t operations) {
+    const unsigned capacity = 100;
+    unsigned vehiclesBefore = PassengerTransport::getTotalVehicles();
+    std::vector<long long> balance(threads, 0);
+    std::atomic<bool> running{true};
+    std::atomic<bool> overflow{false};
+    unsigned passengers;
+    {
+        LogLevelScope quiet(LogLevel::Off); // События конструкторов и деструкторов ТС
+        Bus bus("Нагрузка", capacity, 25.0, true);
+        std::thread observer([&] {
+            while (running.load()) {
+                if (bus.getCurrentPassengers() > capacity) {
+                    overflow = true;
+                }
+                std::this_thread::yield();
+            }
+        });
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                long long net = 0;
+                for (size_t i = 0; i < operations; ++i) {
+                    unsigned n = 1 + rng() % 10;
+                    if (rng() % 2) {
+                        net += bus.tryEmbark(n) ? n : 0;
+                    } else {
+                        net -= bus.tryDisembark(n);
+                    }
+                    if (i % 1024 == 0) {
+                        Tram tram;
+                    }
+                }
+                balance[t] = net;
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        running = false;
+        observer.join();
+        passengers = bus.getCurrentPassengers();
+    }
+
+    long long expected = 0;
+    for (long long net : balance) {
+        expected += net;
+    }
+    bool ok = !overflow && expected == passengers && PassengerTransport::getTotalVehicles() == vehiclesBefore;
+    std::cout << "Проверка (потоков: " << threads << ", операций на поток: " << operations << "): пассажиров "
+              << passengers << ", ожидалось " << expected << ", всего ТС "
+              << PassengerTransport::getTotalVehicles() << " - " << (ok ? "верно" : "ОШИБКА") << "\n";
+    return ok;
+}
+
+// Операций посадки и высадки в секунду (млн) у threads потоков. shared - все потоки работают
+// с одним автобусом (иначе у каждого свой), withMutex - каждая операция под общим мьютексом.
+double boardingThroughput(unsigned threads, size_t operations, bool shared, bool withMutex) {
+    LogLevelScope quiet(LogLevel::Off);
+    Bus sharedBus("Общий", 1000, 25.0, false);
+    std::mutex lock;
+    double ms = measureMs([&] {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&] {
+                Bus ownBus("Свой", 1000, 25.0, false); // На стеке своего потока: не делит строку кэша с другими
+                Bus& bus = shared ? sharedBus : ownBus;
+                for (size_t i = 0; i < operations; ++i) {
+                    if (withMutex) {
+                        std::lock_guard<std::mutex> guard(lock);
+                        if (i % 2 == 0) {
+                            bus.tryEmbark(1);
+                        } else {
+                            bus.tryDisembark(1);
+                        }
+                    } else if (i % 2 == 0) {
+                        bus.tryEmbark(1);
+                    } else {
+                        bus.tryDisembark(1);
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    });
+    return threads * operations / ms / 1000.0;
+}
+
+// Проверка и замер пропускной способности посадки и высадки при росте числа потоков
+void benchmarkBoarding(size_t operations) {
+    unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+    stressTestBoarding(std::max(4u, cores), operations);
+    std::cout << "Млн операций в секунду (потоки: общий автобус CAS / общий автобус мьютекс / свой автобус CAS):\n";
+    for (unsigned threads = 1;; threads *= 2) {
+        threads = std::min(threads, cores);
+        std::cout << "  " << threads << ": " << boardingThroughput(threads, operations, true, false) << " / "
+                  << boardingThroughput(threads, operations, true, true) << " / "
+                  << boardingThroughput(threads, operations, false, false) << "\n";
+        if (threads == cores) {
+            break;
+        }
+    }
+}
+
+// Итоги парка во время посадки и высадки: threads потоков сажают и высаживают пассажиров
+// случайных ТС, а отчётный поток всё это время читает итоги парка. После остановки итоги
+// сверяются с проходом по всем ТС (пассажиры и выручка в 1/REVENUE_SCALE должны совпасть
+// точно), и время чтения итогов сравнивается со временем прохода.
+bool benchmarkAggregates(size_t count, unsigned threads, size_t operations) {
+    LogLevelScope quiet(LogLevel::Off);
+    Fleet fleet;
+    std::mt19937 rng(42);
+    for (size_t i = 0; i < count; ++i) {
+        unsigned capacity = 30 + rng() % 121;
+        double price = 15 + rng() % 26 + (rng() % 100) / 100.0;
+        if (rng() % 2) {
+            fleet.addBus(std::to_string(i % 500), capacity, price, rng() % 2);
+        } else {
+            fleet.addTram(std::to_string(i % 500), capacity, price, 1 + rng() % 4);
+        }
+    }
+
+    std::atomic<bool> running{true};
+    size_t polls = 0;
+    unsigned long long maxPassengers = 0;
+    std::thread reporter([&] {
+        while (running.load(std::memory_order_relaxed)) {
+            maxPassengers = std::max(maxPassengers, fleet.totals().passengers);
+            polls++;
+        }
+    });
+    double workMs = measureMs([&] {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t] {
+                std::mt19937 rng(t);
+                for (size_t i = 0; i < operations; ++i) {
+                    PassengerTransport* vehicle = fleet[rng() % fleet.size()];
+                    unsigned n = 1 + rng() % 10;
+                    if (rng() % 2) {
+                        vehicle->tryEmbark(n);
+                    } else {
+                        vehicle->tryDisembark(n);
+                    }
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    });
+    running = false;
+    reporter.join();
+
+    FleetTotals live;
+    double liveMs = measureMs([&] { live = fleet.totals(); });
+    unsigned long long passengers = 0;
+    long long revenueUnits = 0;
+    double sweepMs = measureMs([&] {
+        for (size_t i = 0; i < fleet.size(); ++i) {
+            unsigned current = fleet[i]->getCurrentPassengers();
+            passengers += current;
+            revenueUnits += current * std::llround(fleet[i]->getTicketPrice() * REVENUE_SCALE);
+        }
+    });
+
+    bool ok = live.vehicles == fleet.size() && live.passengers == passengers &&
+              std::llround(live.revenue * REVENUE_SCALE) == revenueUnits;
+    std::cout << "Посадка и высадка (" << count << " ТС, потоков: " << threads << ", операций на поток: "
+              << operations << "): " << workMs << " мс, итоги прочитаны " << polls << " раз (наибольшее число пассажиров "
+              << maxPassengers << ")\n";
+    std::cout << "Итоги: пассажиров " << live.passengers << ", выручка " << live.revenue << " (" << liveMs
+              << " мс); проход по парку: пассажиров " << passengers << ", выручка "
+              << static_cast<double>(revenueUnits) / REVENUE_SCALE << " (" << sweepMs << " мс) - "
+              << (ok ? "верно" : "ОШИБКА") << "\n";
+    return ok;
+}
+
+// Меню замеров производительности
+void benchmarkMenu() {
+    int choice;
+    do {
+        flushLog(); // События предыдущего действия выводятся до меню
+        std::cout << "\n--- Замеры производительности ---\n";
+        std::cout << "1. Хранилище парка (параллельные массивы)\n";
+        std::cout << "2. Виртуальные вызовы и вызовы по типу\n";
+        std::cout << "3. Посадка и высадка из нескольких потоков\n";
+        std::cout << "4. Пулы объектов и отдельные объекты в куче\n";
+        std::cout << "5. Итоги парка во время посадки и высадки\n";
+        std::cout << "0. Назад\n";
+        std::cout << "Выберите действие: ";
+        std::cin >> choice;
+
+        switch (choice) {
+            case 1: {
+                size_t count;
+                std::cout << "Введите количество транспортных средств: ";
+                std::cin >> count;
+                benchmarkFleetStore(count);
+                break;
+            }
+            case 2: {
+                size_t count;
+                std::cout << "Введите количество транспортных средств: ";
+                std::cin >> count;
+                benchmarkDispatch(count);
+                break;
+            }
+            case 3: {
+                size_t operations;
+                std::cout << "Введите количество операций на поток: ";
+                std::cin >> operations;
+                benchmarkBoarding(operations);
+                break;
+            }
+            case 4: {
+                size_t count;
+                std::cout << "Введите количество транспортных средств: ";
+                std::cin >> count;
+                benchmarkPools(count);
+                break;
+            }
+            case 5: {
+                size_t count, operations;
+                std::cout << "Введите количество транспортных средств: ";
+                std::cin >> count;
+                std::cout << "Введите количество операций на поток: ";
+                std::cin >> operations;
+                if (count > 0) {
+                    benchmarkAggregates(count, std::max(2u, std::thread::hardware_concurrency()), operations);
+                }
+                break;
+            }
+            case 0:
+                break;
+            default:
+                std::cout << "Неверный выбор. Пожалуйста, попробуйте снова.\n";
+        }
+    } while (choice != 0);
+}
+
 void testTransport(PassengerTransport* transport) {
     int choice;
     do {
+        flushLog(); // События предыдущего действия выводятся до меню
         std::cout << "\n--- Меню тестирования ---\n";
         std::cout << "1. Получить номер маршрута\n";
         std::cout << "2. Получить вместимость\n";
@@ -232,8 +1668,8 @@ void testTransport(PassengerTransport* transport) {
                     break;
 
                 case 10: {  // Added case for Wi-Fi check
-                    Bus* bus = dynamic_cast<Bus*>(transport); // Check if it's a Bus
-                    if (bus) {
+                    if (transport->getVehicleType() == VehicleType::Bus) { // Check if it's a Bus
+                        Bus* bus = static_cast<Bus*>(transport);
                         std::cout << "Наличие Wi-Fi: " << (bus->getHasWifi() ? "Да" : "Нет") << std::endl;
                     } else {
                         std::cout << "Это не автобус, проверка Wi-Fi невозможна.\n";
@@ -254,53 +1690,18 @@ void testTransport(PassengerTransport* transport) {
 }
 
 int main() {
-    PassengerTransport** vehicles = nullptr; // Указатель на массив указателей на PassengerTransport
-    size_t vehiclesCount = 0;             // Количество транспортных средств в массиве
-    size_t vehiclesCapacity = 0;          // Вместимость массива (сколько можно добавить без перевыделения)
-
-    // Функция для добавления транспортного средства в массив
-    auto addVehicle = [&](std::unique_ptr<PassengerTransport> vehicle) {
-        if (vehiclesCount == vehiclesCapacity) {
-            // Массив заполнен, нужно перевыделить память
-            size_t newCapacity = (vehiclesCapacity == 0) ? 1 : vehiclesCapacity * 2; // Удваиваем размер
-            PassengerTransport** newVehicles = new PassengerTransport*[newCapacity]; // Создаем новый массив
-
-            
-            for (size_t i = 0; i < vehiclesCount; ++i) {
-                newVehicles[i] = vehicles[i];
-            }
-
-            
-            delete[] vehicles;
-
-            
-            vehicles = newVehicles;
-            vehiclesCapacity = newCapacity;
-        }
-
-       
-        vehicles[vehiclesCount] = vehicle.release(); // передаем владение сырым указателем
-        vehiclesCount++;
-    };
-
-
-    auto cleanupVehicles = [&]() {
-        for (size_t i = 0; i < vehiclesCount; ++i) {
-            delete vehicles[i];
-        }
-        delete[] vehicles;
-        vehicles = nullptr;
-        vehiclesCount = 0;
-        vehiclesCapacity = 0;
-    };
+    Fleet vehicles; // Транспортные средства в порядке добавления (объекты - в пулах по типам)
 
     int choice;
     do {
+        flushLog(); // События предыдущего действия выводятся до меню
         std::cout << "\n--- Главное меню ---\n";
         std::cout << "1. Добавить автобус\n";
         std::cout << "2. Добавить трамвай\n";
         std::cout << "3. Тестировать транспортное средство (по индексу)\n";
         std::cout << "4. Вывести информацию о всех транспортных средствах\n";
+        std::cout << "5. Транспортные средства маршрута\n";
+        std::cout << "6. Замеры производительности\n";
         std::cout << "0. Выход\n";
         std::cout << "Выберите действие: ";
         std::cin >> choice;
@@ -322,7 +1723,7 @@ int main() {
                 std::cin >> wifi;
 
                 try {
-                    addVehicle(std::make_unique<Bus>(route, capacity, price, wifi));
+                    vehicles.addBus(route, capacity, price, wifi);
                 } catch (const std::bad_alloc& e) {
                     std::cerr << "Ошибка выделения памяти: " << e.what() << std::endl;
                 }
@@ -344,21 +1745,21 @@ int main() {
                 std::cin >> cars;
 
                 try {
-                   addVehicle(std::make_unique<Tram>(route, capacity, price, cars));
+                   vehicles.addTram(route, capacity, price, cars);
                 } catch (const std::bad_alloc& e) {
                     std::cerr << "Ошибка выделения памяти: " << e.what() << std::endl;
                 }
                 break;
             }
             case 3: {
-                if (vehiclesCount == 0) {
+                if (vehicles.size() == 0) {
                     std::cout << "Нет доступных транспортных средств для тестирования.\n";
                 } else {
                     unsigned index;
-                    std::cout << "Введите индекс транспортного средства для тестирования (0 - " << vehiclesCount - 1 << "): ";
+                    std::cout << "Введите индекс транспортного средства для тестирования (0 - " << vehicles.size() - 1 << "): ";
                     std::cin >> index;
 
-                    if (index < vehiclesCount) {
+                    if (index < vehicles.size()) {
                         testTransport(vehicles[index]);
                     } else {
                         std::cout << "Неверный индекс транспортного средства.\n";
@@ -367,16 +1768,42 @@ int main() {
                 break;
             }
             case 4: {
-                if (vehiclesCount == 0) {
+                if (vehicles.size() == 0) {
                     std::cout << "Нет транспортных средств для вывода.\n";
                 } else {
                     std::cout << "\n--- Информация о транспортных средствах ---\n";
-                    for (size_t i = 0; i < vehiclesCount; ++i) {
+                    for (size_t i = 0; i < vehicles.size(); ++i) {
                         std::cout << "Транспортное средство [" << i << "]: " << *vehicles[i] << std::endl;
                     }
+                    FleetTotals totals = vehicles.totals();
+                    std::cout << "Всего: пассажиров " << totals.passengers << " из " << totals.capacity
+                              << ", выручка: " << totals.revenue << std::endl;
                 }
                 break;
             }
+            case 5: {
+                std::string route;
+                std::cout << "Введите номер маршрута: ";
+                std::cin >> route;
+
+                RouteId id = RoutePool::instance().find(route);
+                if (vehicles.onRoute(id).empty()) {
+                    std::cout << "На маршруте " << route << " нет транспортных средств.\n";
+                } else {
+                    std::cout << "\n--- Маршрут " << route << " ---\n";
+                    for (const PassengerTransport* vehicle : vehicles.onRoute(id)) {
+                        std::cout << *vehicle << std::endl;
+                    }
+                    FleetTotals totals = vehicles.routeTotals(id);
+                    std::cout << "Транспортных средств: " << totals.vehicles << ", пассажиров: " << totals.passengers
+                              << " из " << totals.capacity << " (" << (totals.capacity ? 100.0 * totals.passengers / totals.capacity : 0.0)
+                              << "%), выручка: " << totals.revenue << std::endl;
+                }
+                break;
+            }
+            case 6:
+                benchmarkMenu();
+                break;
             case 0:
                 std::cout << "Выход из программы...\n";
                 std::cout << "Общее количество транспортных средств: " << PassengerTransport::getTotalVehicles() << std::endl;
@@ -387,6 +1814,6 @@ int main() {
     } while (choice != 0);
 
     
-    cleanupVehicles();
+    vehicles.clear();
     return 0;
 }
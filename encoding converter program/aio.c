@@ -0,0 +1,543 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "aio.h"
+
+// io_uring используется напрямую через системные вызовы, без liburing
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define AIO_HAVE_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef AIO_HAVE_URING
+// Кольца очередей io_uring, отображённые из ядра
+typedef struct {
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+    void *sq_map;
+    size_t sq_map_size;
+    void *cq_map;  // Совпадает с sq_map при IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    size_t sqes_size;
+} aio_ring;
+#endif
+
+struct aio_stream {
+    int fd;
+    int mode;                           // AIO_URING, AIO_THREADS или AIO_SYNC
+    int writer;                         // 1 - поток записи
+    size_t block;
+    unsigned char *bufs[AIO_DEPTH];
+    ssize_t lens[AIO_DEPTH];            // Длина блока или результат чтения
+    size_t queued;                      // Номер следующего блока: прочитанного потоком или отданного на запись
+    size_t taken;                       // Чтение: блоков выдано вызывающему
+    size_t done;                        // Чтение: блоков освобождено; запись: блоков записано
+    int held;                           // Чтение: вызывающий держит последний выданный блок
+    int finished;                       // Чтение: вход кончился или ошибка, результат в last
+    ssize_t last;
+    int error;
+    int stop;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#ifdef AIO_HAVE_URING
+    aio_ring ring;
+    int busy[AIO_DEPTH];                // Операция над буфером ещё в ядре
+    off_t offsets[AIO_DEPTH];
+    off_t offset;                       // Смещение следующей операции в файле (-1 - не определено)
+    int inflight;
+    int eof;                            // Чтение: дальше конца файла не читаем
+#endif
+};
+
+static const char *mode_names[] = {"auto", "uring", "threads", "sync"};
+
+// Функция для определения способа по имени
+int aio_mode(const char *name) {
+    for (int k = 0; k < (int)(sizeof(mode_names) / sizeof(mode_names[0])); k++) {
+        if (strcmp(name, mode_names[k]) == 0) {
+            return k;
+        }
+    }
+    return -1;
+}
+
+const char *aio_stream_mode(const aio_stream *s) {
+    return mode_names[s->mode];
+}
+
+static ssize_t read_retry(int fd, unsigned char *buf, size_t len) {
+    ssize_t r;
+    do {
+        r = read(fd, buf, len);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static int write_all(int fd, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0) {
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+#ifdef AIO_HAVE_URING
+static int ring_enter(aio_ring *r, unsigned submit, unsigned wait) {
+    for (;;) {
+        long rc = syscall(__NR_io_uring_enter, r->fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if (rc >= 0 || (errno != EINTR && errno != EAGAIN && errno != EBUSY)) {
+            return rc < 0 ? -1 : 0;
+        }
+    }
+}
+
+static void ring_close(aio_ring *r) {
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_map && r->cq_map != r->sq_map) {
+        munmap(r->cq_map, r->cq_map_size);
+    }
+    if (r->sq_map) {
+        munmap(r->sq_map, r->sq_map_size);
+    }
+    close(r->fd);
+}
+
+// Создание колец на entries операций; -1, если ядро не поддерживает io_uring
+// или запрещает его (seccomp в контейнерах)
+static int ring_setup(aio_ring *r, unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(r, 0, sizeof(*r));
+    r->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (r->fd < 0) {
+        return -1;
+    }
+    // IORING_OP_READ и IORING_OP_WRITE появились в том же ядре (5.6), что и этот признак
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(r->fd);
+        return -1;
+    }
+
+    r->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && r->cq_map_size > r->sq_map_size) {
+        r->sq_map_size = r->cq_map_size;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                     IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        ring_close(r);
+        return -1;
+    }
+    r->cq_map = single ? r->sq_map
+                       : mmap(NULL, r->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd,
+                              IORING_OFF_CQ_RING);
+    r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->cq_map == MAP_FAILED || r->sqes == MAP_FAILED) {
+        r->cq_map = r->cq_map == MAP_FAILED ? NULL : r->cq_map;
+        r->sqes = r->sqes == MAP_FAILED ? NULL : r->sqes;
+        ring_close(r);
+        return -1;
+    }
+
+    unsigned char *sq = r->sq_map;
+    unsigned char *cq = r->cq_map;
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return 0;
+}
+
+// Постановка чтения или записи буфера slot в очередь и передача её ядру
+static int ring_submit(aio_stream *s, unsigned slot, size_t len) {
+    aio_ring *r = &s->ring;
+    unsigned tail = *r->sq_tail;
+    unsigned idx = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = s->writer ? IORING_OP_WRITE : IORING_OP_READ;
+    sqe->fd = s->fd;
+    sqe->addr = (uintptr_t)s->bufs[slot];
+    sqe->len = (unsigned)len;
+    sqe->off = (uint64_t)s->offsets[slot];
+    sqe->user_data = slot;
+    r->sq_array[idx] = idx;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    s->busy[slot] = 1;
+    s->lens[slot] = (ssize_t)len;
+    s->inflight++;
+    return ring_enter(r, 1, 0);
+}
+
+// Завершение операции: недочитанный или недописанный остаток обрабатывается синхронно
+static void ring_complete(aio_stream *s, unsigned slot, int res) {
+    s->busy[slot] = 0;
+    s->inflight--;
+    if (res < 0) {
+        s->lens[slot] = -1;
+        s->error = 1;
+        return;
+    }
+
+    size_t want = (size_t)s->lens[slot];
+    size_t got = (size_t)res;
+    while (got < want) {
+        ssize_t n = s->writer ? pwrite(s->fd, s->bufs[slot] + got, want - got, s->offsets[slot] + got)
+                              : pread(s->fd, s->bufs[slot] + got, want - got, s->offsets[slot] + got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 || (n == 0 && s->writer)) {
+            s->lens[slot] = -1;
+            s->error = 1;
+            return;
+        }
+        if (n == 0) {
+            break;  // Конец файла
+        }
+        got += (size_t)n;
+    }
+    s->lens[slot] = (ssize_t)got;
+}
+
+// Обработка готовых завершений; при wait - с ожиданием хотя бы одного
+static int ring_reap(aio_stream *s, int wait) {
+    aio_ring *r = &s->ring;
+    if (wait && ring_enter(r, 0, 1) != 0) {
+        return -1;
+    }
+    unsigned head = *r->cq_head;
+    while (head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+        ring_complete(s, (unsigned)cqe->user_data, cqe->res);
+        head++;
+    }
+    __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Ожидание завершения операции над буфером slot
+static int ring_wait_slot(aio_stream *s, unsigned slot) {
+    while (s->busy[slot]) {
+        if (ring_reap(s, 1) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Чтение следующего блока файла в буфер slot
+static void ring_read_next(aio_stream *s, unsigned slot) {
+    s->offsets[slot] = s->offset;
+    s->offset += (off_t)s->block;
+    if (ring_submit(s, slot, s->block) != 0) {
+        s->busy[slot] = 0;
+        s->inflight--;
+        s->lens[slot] = -1;
+    }
+}
+
+// io_uring подходит для обычных файлов с известной позицией; при O_APPEND запись
+// по смещениям не работает, а каналы не гарантируют порядок нескольких чтений
+static int uring_start(aio_stream *s) {
+    struct stat st;
+    if (fstat(s->fd, &st) != 0 || !S_ISREG(st.st_mode) || lseek(s->fd, 0, SEEK_CUR) < 0) {
+        return -1;
+    }
+    if (s->writer && (fcntl(s->fd, F_GETFL) & O_APPEND)) {
+        return -1;
+    }
+    if (ring_setup(&s->ring, AIO_DEPTH) != 0) {
+        return -1;
+    }
+
+    s->mode = AIO_URING;
+    s->offset = -1;  // Для записи позиция берётся при первой записи: до неё может писать stdio
+    if (!s->writer) {
+        s->offset = lseek(s->fd, 0, SEEK_CUR);
+        for (unsigned k = 0; k < AIO_DEPTH; k++) {
+            ring_read_next(s, k);
+        }
+        s->queued = AIO_DEPTH;
+    }
+    return 0;
+}
+#endif
+
+// Поток чтения: заполняет свободные буферы по порядку до конца входа или ошибки
+static void *reader_thread(void *arg) {
+    aio_stream *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->stop && s->queued - s->done >= AIO_DEPTH) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        if (s->stop) {
+            break;
+        }
+        size_t slot = s->queued % AIO_DEPTH;
+        pthread_mutex_unlock(&s->lock);
+
+        ssize_t r = read_retry(s->fd, s->bufs[slot], s->block);
+
+        pthread_mutex_lock(&s->lock);
+        s->lens[slot] = r;
+        s->queued++;
+        pthread_cond_broadcast(&s->cond);
+        if (r <= 0) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+// Поток записи: записывает отправленные буферы по порядку
+static void *writer_thread(void *arg) {
+    aio_stream *s = arg;
+    pthread_mutex_lock(&s->lock);
+    for (;;) {
+        while (!s->stop && s->done == s->queued) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        if (s->done == s->queued) {
+            break;
+        }
+        size_t slot = s->done % AIO_DEPTH;
+        int failed = s->error;
+        pthread_mutex_unlock(&s->lock);
+
+        // После ошибки буферы только освобождаются, чтобы не останавливать перекодирование
+        int rc = failed ? -1 : write_all(s->fd, s->bufs[slot], (size_t)s->lens[slot]);
+
+        pthread_mutex_lock(&s->lock);
+        s->error |= rc != 0;
+        s->done++;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+    return NULL;
+}
+
+static aio_stream *aio_open(int fd, int mode, size_t block, int writer) {
+    aio_stream *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return NULL;
+    }
+    s->fd = fd;
+    s->writer = writer;
+    s->block = block;
+    s->mode = AIO_SYNC;
+    int nbufs = mode == AIO_SYNC ? 1 : AIO_DEPTH;
+    for (int k = 0; k < nbufs; k++) {
+        s->bufs[k] = malloc(block);
+        if (!s->bufs[k]) {
+            for (int j = 0; j < k; j++) {
+                free(s->bufs[j]);
+            }
+            free(s);
+            return NULL;
+        }
+    }
+    if (mode == AIO_SYNC) {
+        return s;
+    }
+
+#ifdef AIO_HAVE_URING
+    if ((mode == AIO_AUTO || mode == AIO_URING) && uring_start(s) == 0) {
+        return s;
+    }
+#endif
+
+    // Не удалось запустить поток - работаем синхронно с тем же первым буфером
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->cond, NULL);
+    if (pthread_create(&s->thread, NULL, writer ? writer_thread : reader_thread, s) == 0) {
+        s->mode = AIO_THREADS;
+    } else {
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+    }
+    return s;
+}
+
+// Функция для открытия чтения
+aio_stream *aio_open_reader(int fd, int mode, size_t block) {
+    return aio_open(fd, mode, block, 0);
+}
+
+// Функция для открытия записи
+aio_stream *aio_open_writer(int fd, int mode, size_t block) {
+    return aio_open(fd, mode, block, 1);
+}
+
+// Следующий блок входа
+ssize_t aio_read(aio_stream *s, const unsigned char **data) {
+    if (s->finished) {
+        return s->last;
+    }
+
+    ssize_t r;
+    size_t slot = 0;
+    if (s->mode == AIO_SYNC) {
+        r = read_retry(s->fd, s->bufs[0], s->block);
+    } else if (s->mode == AIO_THREADS) {
+        pthread_mutex_lock(&s->lock);
+        if (s->held) {
+            s->done++;
+            s->held = 0;
+            pthread_cond_broadcast(&s->cond);
+        }
+        while (s->queued == s->taken) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        slot = s->taken % AIO_DEPTH;
+        r = s->lens[slot];
+        pthread_mutex_unlock(&s->lock);
+    } else {
+#ifdef AIO_HAVE_URING
+        // Освобождённый буфер сразу уходит за следующим блоком
+        if (s->held && !s->eof) {
+            ring_read_next(s, (s->taken - 1) % AIO_DEPTH);
+        }
+        slot = s->taken % AIO_DEPTH;
+        r = ring_wait_slot(s, slot) == 0 ? s->lens[slot] : -1;
+        if (r >= 0 && (size_t)r < s->block) {
+            s->eof = 1;  // Короткое чтение дочитывается до конца файла
+        }
+#else
+        r = -1;
+#endif
+    }
+
+    s->taken++;
+    s->held = r > 0;
+    if (r <= 0) {
+        s->finished = 1;
+        s->last = r;
+    }
+    *data = s->bufs[slot];
+    return r;
+}
+
+// Свободный буфер для следующего блока выхода
+unsigned char *aio_write_buffer(aio_stream *s) {
+    size_t slot = 0;
+    if (s->mode == AIO_THREADS) {
+        pthread_mutex_lock(&s->lock);
+        while (s->queued - s->done >= AIO_DEPTH) {
+            pthread_cond_wait(&s->cond, &s->lock);
+        }
+        slot = s->queued % AIO_DEPTH;
+        pthread_mutex_unlock(&s->lock);
+    } else if (s->mode == AIO_URING) {
+#ifdef AIO_HAVE_URING
+        slot = s->queued % AIO_DEPTH;
+        if (ring_wait_slot(s, slot) != 0) {
+            s->error = 1;
+            s->busy[slot] = 0;
+        }
+#endif
+    }
+    return s->bufs[slot];
+}
+
+// Отправка буфера на запись
+void aio_write(aio_stream *s, size_t len) {
+    if (s->mode == AIO_SYNC) {
+        s->error |= write_all(s->fd, s->bufs[0], len) != 0;
+    } else if (s->mode == AIO_THREADS) {
+        pthread_mutex_lock(&s->lock);
+        s->lens[s->queued % AIO_DEPTH] = (ssize_t)len;
+        s->queued++;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+    } else {
+#ifdef AIO_HAVE_URING
+        size_t slot = s->queued % AIO_DEPTH;
+        if (s->offset < 0) {
+            s->offset = lseek(s->fd, 0, SEEK_CUR);
+        }
+        s->queued++;
+        if (s->offset < 0 || s->error) {
+            s->error = 1;
+            return;
+        }
+        s->offsets[slot] = s->offset;
+        s->offset += (off_t)len;
+        if (ring_submit(s, (unsigned)slot, len) != 0) {
+            s->busy[slot] = 0;
+            s->inflight--;
+            s->error = 1;
+        }
+#endif
+    }
+}
+
+// Завершение всех операций и освобождение потока
+int aio_close(aio_stream *s) {
+    if (!s) {
+        return 0;
+    }
+    if (s->mode == AIO_THREADS) {
+        pthread_mutex_lock(&s->lock);
+        s->stop = 1;
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        pthread_join(s->thread, NULL);
+        pthread_mutex_destroy(&s->lock);
+        pthread_cond_destroy(&s->cond);
+    }
+#ifdef AIO_HAVE_URING
+    if (s->mode == AIO_URING) {
+        // Буферы освобождаются только после того, как ядро закончит с ними работать
+        while (s->inflight > 0 && ring_reap(s, 1) == 0) {
+        }
+        if (s->writer && s->offset >= 0) {
+            lseek(s->fd, s->offset, SEEK_SET);  // Позиция - за последним записанным байтом
+        }
+        ring_close(&s->ring);
+    }
+#endif
+
+    int status = s->error ? -1 : 0;
+    for (int k = 0; k < AIO_DEPTH; k++) {
+        free(s->bufs[k]);
+    }
+    free(s);
+    return status;
+}
@@ -0,0 +1,47 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Способы ввода-вывода
+#define AIO_AUTO 0     // io_uring, если его поддерживают ядро и файл, иначе потоки
+#define AIO_URING 1    // io_uring (только обычные файлы без O_APPEND, иначе потоки)
+#define AIO_THREADS 2  // Отдельный поток чтения или записи
+#define AIO_SYNC 3     // Блокирующие read и write в вызывающем потоке
+
+// Сколько буферов одновременно в работе у потока ввода-вывода
+#define AIO_DEPTH 4
+
+// Поток ввода-вывода с двойной (AIO_DEPTH-кратной) буферизацией: чтение идёт
+// на несколько блоков впереди перекодирования, запись - позади него
+typedef struct aio_stream aio_stream;
+
+// Функция для определения способа по имени (auto, uring, threads, sync); -1 - неизвестное имя
+int aio_mode(const char *name);
+
+// Функция для открытия чтения из fd блоками до block байтов (NULL при нехватке памяти)
+aio_stream *aio_open_reader(int fd, int mode, size_t block);
+
+// Следующий блок входа по порядку. Возвращает длину, 0 в конце входа или -1 при ошибке
+// чтения. Блок действителен до следующего вызова.
+ssize_t aio_read(aio_stream *s, const unsigned char **data);
+
+// Функция для открытия записи в fd блоками до block байтов (NULL при нехватке памяти).
+// Данные, записанные в fd раньше (например, через stdio), должны быть уже сброшены.
+aio_stream *aio_open_writer(int fd, int mode, size_t block);
+
+// Свободный буфер для следующего блока выхода (ждёт, пока один из буферов запишется)
+unsigned char *aio_write_buffer(aio_stream *s);
+
+// Отправка на запись len байтов буфера, полученного от aio_write_buffer
+void aio_write(aio_stream *s, size_t len);
+
+// Завершение всех операций и освобождение потока (s может быть NULL).
+// Возвращает 0 или -1, если запись не удалась.
+int aio_close(aio_stream *s);
+
+// Название способа, которым на самом деле работает поток
+const char *aio_stream_mode(const aio_stream *s);
+
+#endif  // AIO_H
@@ -0,0 +1,443 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "batch.h"
+#include "check.h"
+#include "convert.h"
+#include "diag.h"
+#include "parallel.h"
+
+// Размер выходного буфера потока: хватает на блок при перекодировании в любом направлении
+#define BATCH_OUT_SIZE CONVERT_DECODER_OUT_MAX(CONVERT_BLOCK_SIZE)
+
+// Файл пакета и результат его перекодирования
+typedef struct {
+    char *input;
+    char *output;         // NULL, если путь выходит за пределы каталога результатов
+    const char *failure;  // Причина неудачи или NULL
+    size_t in_bytes;
+    size_t out_bytes;
+    size_t errors;
+    int encoding;         // Кодировка входа (определённая, если задано auto)
+    int little_endian;
+    int bom;
+    int done;
+} batch_file;
+
+typedef struct {
+    batch_file *files;
+    size_t count;
+    size_t capacity;
+    size_t next;  // Следующий файл для перекодирования
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    const batch_options *opt;
+} batch_ctx;
+
+// Буферы потока выполнения, общие для всех его файлов
+typedef struct {
+    batch_ctx *ctx;
+    unsigned char *in;
+    unsigned char *out;
+} batch_worker;
+
+// Соединение двух частей пути через '/'
+static char *join_path(const char *dir, const char *name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char *path = malloc(dir_len + name_len + 2);
+    if (path) {
+        memcpy(path, dir, dir_len);
+        path[dir_len] = '/';
+        memcpy(path + dir_len + 1, name, name_len + 1);
+    }
+    return path;
+}
+
+// Путь внутри каталога результатов для отдельно указанного файла: без начального '/'
+// и компонентов "."; путь с ".." не отображается (NULL в *output)
+static int mirror_path(const char *out_dir, const char *path, char **output) {
+    *output = NULL;
+    while (*path == '/' || (path[0] == '.' && path[1] == '/')) {
+        path += *path == '/' ? 1 : 2;
+    }
+    for (const char *p = path; *p; ) {
+        size_t len = strcspn(p, "/");
+        if (len == 2 && p[0] == '.' && p[1] == '.') {
+            return 0;
+        }
+        p += len;
+        p += *p == '/';
+    }
+    *output = join_path(out_dir, path);
+    return *output ? 0 : -1;
+}
+
+static int add_file(batch_ctx *ctx, char *input, char *output) {
+    if (ctx->count == ctx->capacity) {
+        size_t capacity = ctx->capacity ? ctx->capacity * 2 : 64;
+        batch_file *files = realloc(ctx->files, capacity * sizeof(*files));
+        if (!files) {
+            return -1;
+        }
+        ctx->files = files;
+        ctx->capacity = capacity;
+    }
+    batch_file *f = &ctx->files[ctx->count++];
+    memset(f, 0, sizeof(*f));
+    f->input = input;
+    f->output = output;
+    if (!output) {
+        f->failure = "output path outside of output directory";
+        f->done = 1;
+    }
+    return 0;
+}
+
+// Обход каталога dir; файлы попадают в out_dir с тем же относительным путём.
+// Записи обходятся в алфавитном порядке, чтобы отчёт не зависел от файловой системы.
+static int add_directory(batch_ctx *ctx, const char *dir, const char *out_dir, int recursive) {
+    struct dirent **entries;
+    int n = scandir(dir, &entries, NULL, alphasort);
+    if (n < 0) {
+        fprintf(stderr, "Error: could not read directory %s\n", dir);
+        return -1;
+    }
+
+    int status = 0;
+    for (int k = 0; k < n; k++) {
+        const char *name = entries[k]->d_name;
+        if (status == 0 && strcmp(name, ".") != 0 && strcmp(name, "..") != 0) {
+            char *input = join_path(dir, name);
+            char *output = join_path(out_dir, name);
+            struct stat st;
+            if (!input || !output) {
+                status = -1;
+            } else if (stat(input, &st) == 0 && S_ISDIR(st.st_mode)) {
+                if (recursive) {
+                    status = add_directory(ctx, input, output, recursive);
+                }
+            } else if (add_file(ctx, input, output) == 0) {
+                input = output = NULL;  // Теперь принадлежат списку
+            } else {
+                status = -1;
+            }
+            free(input);
+            free(output);
+        }
+        free(entries[k]);
+    }
+    free(entries);
+    return status;
+}
+
+static int add_path(batch_ctx *ctx, const char *path) {
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        return add_directory(ctx, path, ctx->opt->out_dir, ctx->opt->recursive);
+    }
+
+    // Несуществующий файл тоже попадает в список: ошибка будет в отчёте
+    char *input = strdup(path);
+    char *output;
+    if (!input || mirror_path(ctx->opt->out_dir, path, &output) != 0) {
+        free(input);
+        return -1;
+    }
+    if (add_file(ctx, input, output) != 0) {
+        free(input);
+        free(output);
+        return -1;
+    }
+    return 0;
+}
+
+// Список файлов из стандартного ввода: по одному пути в строке, пустые строки пропускаются
+static int add_manifest(batch_ctx *ctx, FILE *in) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int status = 0;
+    while (status == 0 && (len = getline(&line, &cap, in)) >= 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len > 0) {
+            status = add_path(ctx, line);
+        }
+    }
+    free(line);
+    return status;
+}
+
+// Создание каталогов, в которых будет лежать файл path
+static int make_parents(const char *path) {
+    char *dir = strdup(path);
+    if (!dir) {
+        return -1;
+    }
+    int status = 0;
+    for (char *p = strchr(dir + 1, '/'); p && status == 0; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        // Каталог мог уже создать другой поток
+        if (mkdir(dir, 0777) != 0 && errno != EEXIST) {
+            status = -1;
+        }
+        *p = '/';
+    }
+    free(dir);
+    return status;
+}
+
+static int write_all(int fd, const unsigned char *buf, size_t len) {
+    while (len > 0) {
+        ssize_t w = write(fd, buf, len);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0) {
+            return -1;
+        }
+        buf += w;
+        len -= (size_t)w;
+    }
+    return 0;
+}
+
+// Перекодирование одного файла буферами потока
+static void convert_file(batch_worker *w, batch_file *f) {
+    const batch_options *opt = w->ctx->opt;
+    int in = open(f->input, O_RDONLY);
+    if (in < 0) {
+        f->failure = "could not open input file";
+        return;
+    }
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) != 0 || S_ISDIR(in_st.st_mode)) {
+        close(in);
+        f->failure = "could not read input file";
+        return;
+    }
+
+    // Файл открывается без усечения: сначала убеждаемся, что это не сам вход
+    int out = make_parents(f->output) == 0 ? open(f->output, O_WRONLY | O_CREAT, 0666) : -1;
+    if (out < 0) {
+        close(in);
+        f->failure = "could not open output file";
+        return;
+    }
+    if (fstat(out, &out_st) == 0 && out_st.st_dev == in_st.st_dev && out_st.st_ino == in_st.st_ino) {
+        close(in);
+        close(out);
+        f->failure = "output file is the input file";
+        return;
+    }
+    int status = ftruncate(out, 0);
+
+    unsigned char bom[4];
+    size_t bom_len = convert_write_bom(opt->to, opt->out_little_endian, bom);
+    if (status == 0 && bom_len) {
+        status = write_all(out, bom, bom_len);
+        f->out_bytes += bom_len;
+    }
+
+    // Диагностика с именем файла; строки разных потоков не перемешиваются
+    diag_log diag;
+    if (diag_init(&diag, opt->errors, opt->max_errors, stderr, f->input) != 0) {
+        close(in);
+        close(out);
+        f->failure = "out of memory";
+        return;
+    }
+    convert_decoder dec;
+    convert_decoder_init_pair(&dec, opt->from, opt->to, opt->little_endian, opt->out_little_endian);
+    dec.on_error = opt->on_error;
+    convert_errors errors = {NULL, 0, 0, diag_report, &diag, 0};
+    size_t out_len;
+
+    // У обычного файла известен размер: лишнее чтение ради конца файла не нужно
+    while (status == 0 && (!S_ISREG(in_st.st_mode) || f->in_bytes < (size_t)in_st.st_size)) {
+        ssize_t r = read(in, w->in, CONVERT_BLOCK_SIZE);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r < 0) {
+            f->failure = "read error";
+            break;
+        }
+        if (r == 0) {
+            break;
+        }
+        f->in_bytes += (size_t)r;
+        convert_decoder_push(&dec, w->in, (size_t)r, w->out, BATCH_OUT_SIZE, &out_len, &errors);
+        status = write_all(out, w->out, out_len);
+        f->out_bytes += out_len;
+    }
+    if (status == 0 && !f->failure) {
+        convert_decoder_finish(&dec, w->out, BATCH_OUT_SIZE, &out_len, &errors);
+        status = write_all(out, w->out, out_len);
+        f->out_bytes += out_len;
+    }
+
+    if (close(out) != 0 || status != 0) {
+        f->failure = f->failure ? f->failure : "write error";
+    }
+    if (dec.aborted && !f->failure) {
+        f->failure = "aborted on invalid input";
+    }
+    close(in);
+    diag_finish(&diag);
+    diag_free(&diag);
+    f->errors = errors.count;
+    f->encoding = dec.from;
+    f->little_endian = dec.little_endian;
+    f->bom = dec.bom_found;
+}
+
+static void *worker(void *arg) {
+    batch_worker *w = arg;
+    batch_ctx *ctx = w->ctx;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        while (ctx->next < ctx->count && ctx->files[ctx->next].done) {
+            ctx->next++;  // Файлы, отклонённые ещё при составлении списка
+        }
+        if (ctx->next >= ctx->count) {
+            break;
+        }
+        batch_file *f = &ctx->files[ctx->next++];
+        pthread_mutex_unlock(&ctx->lock);
+
+        convert_file(w, f);
+
+        pthread_mutex_lock(&ctx->lock);
+        f->done = 1;
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+static void print_file_report(FILE *f, const batch_file *file, int json) {
+    const char *encoding = file->encoding == CONVERT_ENC_UTF16 ? (file->little_endian ? "UTF-16LE" : "UTF-16BE")
+                           : file->encoding == CONVERT_ENC_UTF32 ? (file->little_endian ? "UTF-32LE" : "UTF-32BE")
+                           : convert_encoding_name(file->encoding);
+    if (json) {
+        fprintf(f, "{\"file\": ");
+        print_json_string(f, file->input);
+        fprintf(f, ", \"output\": ");
+        if (file->output) {
+            print_json_string(f, file->output);
+        } else {
+            fprintf(f, "null");
+        }
+        if (file->failure) {
+            fprintf(f, ", \"status\": \"failed\", \"error\": ");
+            print_json_string(f, file->failure);
+            fprintf(f, "}\n");
+        } else {
+            fprintf(f, ", \"status\": \"ok\", \"encoding\": \"%s\", \"bom\": %s, \"bytes_in\": %zu, "
+                       "\"bytes_out\": %zu, \"errors\": %zu}\n",
+                    encoding, file->bom ? "true" : "false", file->in_bytes, file->out_bytes, file->errors);
+        }
+        return;
+    }
+
+    if (file->failure) {
+        fprintf(f, "%s: failed: %s\n", file->input, file->failure);
+    } else {
+        fprintf(f, "%s -> %s: %s%s, %zu -> %zu bytes, %zu error%s\n", file->input, file->output, encoding,
+                file->bom ? " with BOM" : "", file->in_bytes, file->out_bytes, file->errors,
+                file->errors == 1 ? "" : "s");
+    }
+}
+
+// Пакетное перекодирование
+int batch_convert(char *paths[], size_t npaths, const batch_options *opt, FILE *report) {
+    batch_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.opt = opt;
+
+    int status = 0;
+    for (size_t k = 0; k < npaths && status == 0; k++) {
+        status = add_path(&ctx, paths[k]);
+    }
+    if (npaths == 0) {
+        status = add_manifest(&ctx, stdin);
+    }
+
+    int nthreads = parallel_threads(opt->threads);
+    if ((size_t)nthreads > ctx.count) {
+        nthreads = ctx.count > 0 ? (int)ctx.count : 1;
+    }
+    batch_worker *workers = calloc(nthreads, sizeof(batch_worker));
+    pthread_t *threads = calloc(nthreads, sizeof(pthread_t));
+    if (status != 0 || !workers || !threads) {
+        if (status == 0) {
+            fprintf(stderr, "Error: out of memory\n");
+        }
+        status = -1;
+        nthreads = 0;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+
+    int started = 0;
+    for (; started < nthreads; started++) {
+        batch_worker *w = &workers[started];
+        w->ctx = &ctx;
+        w->in = malloc(CONVERT_BLOCK_SIZE);
+        w->out = malloc(BATCH_OUT_SIZE);
+        if (!w->in || !w->out || pthread_create(&threads[started], NULL, worker, w) != 0) {
+            free(w->in);
+            free(w->out);
+            break;
+        }
+    }
+    if (started == 0 && nthreads > 0) {
+        fprintf(stderr, "Error: could not start worker threads\n");
+        status = -1;
+    }
+
+    // Отчёт строго в порядке списка, по мере готовности файлов
+    size_t failed = 0;
+    size_t invalid = 0;
+    for (size_t k = 0; k < ctx.count && started > 0; k++) {
+        pthread_mutex_lock(&ctx.lock);
+        while (!ctx.files[k].done) {
+            pthread_cond_wait(&ctx.cond, &ctx.lock);
+        }
+        pthread_mutex_unlock(&ctx.lock);
+
+        print_file_report(report, &ctx.files[k], opt->json);
+        failed += ctx.files[k].failure != NULL;
+        invalid += !ctx.files[k].failure && ctx.files[k].errors;
+    }
+    if (status == 0 && !opt->json) {
+        fprintf(report, "%zu files: %zu converted, %zu with invalid data, %zu failed\n",
+                ctx.count, ctx.count - failed, invalid, failed);
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+        free(workers[t].in);
+        free(workers[t].out);
+    }
+    for (size_t k = 0; k < ctx.count; k++) {
+        free(ctx.files[k].input);
+        free(ctx.files[k].output);
+    }
+    free(ctx.files);
+    free(workers);
+    free(threads);
+    pthread_mutex_destroy(&ctx.lock);
+    pthread_cond_destroy(&ctx.cond);
+    return status != 0 || failed ? 1 : 0;
+}
@@ -0,0 +1,30 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdio.h>
+
+// Параметры пакетного перекодирования
+typedef struct {
+    int from;               // Кодировка входа (CONVERT_ENC_*, AUTO - своя для каждого файла)
+    int to;                 // Кодировка результата
+    int little_endian;      // Порядок байтов входа UTF-16 и UTF-32 при отсутствии BOM
+    int out_little_endian;  // Порядок байтов результата UTF-16 и UTF-32
+    int threads;            // Число потоков выполнения, 0 - по числу процессоров
+    int recursive;          // Обходить подкаталоги
+    int json;               // Отчёт строками JSON
+    const char *out_dir;    // Каталог для результатов
+    int errors;             // Формат диагностики ошибок входа (DIAG_*)
+    size_t max_errors;      // Сколько ошибок каждого файла выводить подробно
+    int on_error;           // Что делать с некорректным входом (CONVERT_ON_ERROR_*)
+} batch_options;
+
+// Пакетное перекодирование файлов в одном процессе. paths - файлы и каталоги; при
+// npaths == 0 список файлов читается из стандартного ввода (по одному пути в строке).
+// Файлы каталога перекодируются в тот же относительный путь внутри out_dir, отдельные
+// файлы - в указанный путь внутри out_dir. Файлы распределяются между потоками, у каждого
+// потока свои буферы на всё время работы. Отчёт по каждому файлу выводится в report
+// в порядке списка, диагностика ошибок входа - в stderr с именем файла. Возвращает 0
+// или 1, если хотя бы один файл не удалось перекодировать.
+int batch_convert(char *paths[], size_t npaths, const batch_options *opt, FILE *report);
+
+#endif  // BATCH_H
@@ -0,0 +1,95 @@
+#!/bin/sh
+# Замер пропускной способности конвертеров на синтетических корпусах.
+# Запускается из каталога программы: make bench или sh bench/bench.sh
+#
+# Параметры (переменные окружения):
+#   BENCH_SIZES    размеры корпусов                     (по умолчанию "4K 1M 64M", можно "4G")
+#   BENCH_KINDS    виды текста, вид:процент_ошибок      (ascii cyrillic cjk emoji mixed mixed:0.1 mixed:10)
+#   BENCH_ENGINES  варианты перекодирования             (reference stdio mmap replace parallel impl)
+#                  replace - с заменой ошибок на U+FFFD (на корпусах с ошибками)
+#                  io=способ - чтение без отображения с заданным способом ввода-вывода
+#                  (io=sync io=threads io=uring)
+#   BENCH_IMPLS    реализации для варианта impl         (все поддерживаемые процессором)
+#   BENCH_THREADS  число потоков для parallel, 0 - по числу процессоров (0)
+#   BENCH_REPEAT   число запусков, берётся лучший       (3)
+#   BENCH_ICONV    1 - сравнить с системным iconv       (0)
+# Корпуса кешируются в bench/corpus и создаются заново только при смене параметров.
+
+set -e
+
+SIZES=${BENCH_SIZES:-"4K 1M 64M"}
+KINDS=${BENCH_KINDS:-"ascii cyrillic cjk emoji mixed mixed:0.1 mixed:10"}
+ENGINES=${BENCH_ENGINES:-"reference stdio mmap replace parallel impl"}
+IMPLS=${BENCH_IMPLS:-$(./utf16_to_utf8 --list-impls | awk '$2 == "supported" { print $1 }')}
+THREADS=${BENCH_THREADS:-0}
+REPEAT=${BENCH_REPEAT:-3}
+ICONV=${BENCH_ICONV:-0}
+
+CORPUS=bench/corpus
+mkdir -p "$CORPUS"
+
+# Корпус и количество символов в нём (в файле .cp рядом с корпусом)
+corpus() {
+    file="$CORPUS/$1-$2-$3.$4"
+    if [ ! -f "$file" ] || [ ! -f "$file.cp" ]; then
+        bench/gencorpus -k "$1" -m "$2" -s "$3" -e "$4" -o "$file" > "$file.cp"
+    fi
+    echo "$file"
+}
+
+# Флаги командной строки для варианта перекодирования (impl=имя - однопоточный
+# с отображением файла и заданной реализацией)
+engine_flags() {
+    case $1 in
+        impl=*) echo "--mmap --impl=${1#impl=}" ;;
+        io=*) echo "--no-mmap --io=${1#io=}" ;;
+        reference) echo "--reference" ;;
+        stdio) echo "--no-mmap" ;;
+        mmap) echo "--mmap" ;;
+        replace) echo "--mmap --on-error=replace" ;;
+        parallel) echo "--mmap -j $THREADS" ;;
+        *) echo "Unknown engine $1" >&2; exit 1 ;;
+    esac
+}
+
+# Вариант impl раскрывается в замер каждой реализации
+engines=
+for engine in $ENGINES; do
+    if [ "$engine" = impl ]; then
+        for impl in $IMPLS; do
+            engines="$engines impl=$impl"
+        done
+    else
+        engines="$engines $engine"
+    fi
+done
+
+for size in $SIZES; do
+    for spec in $KINDS; do
+        kind=${spec%%:*}
+        bad=0
+        [ "$kind" != "$spec" ] && bad=${spec#*:}
+
+        utf8=$(corpus "$kind" "$bad" "$size" utf8)
+        utf16=$(corpus "$kind" "$bad" "$size" utf16le)
+        echo "== $kind, $bad% malformed, $size"
+
+        for engine in $engines; do
+            # Замена отличается от пропуска только на входе с ошибками
+            [ "$engine" = replace ] && [ "$bad" = 0 ] && continue
+            flags=$(engine_flags "$engine")
+            bench/runbench -n "$REPEAT" -b "$(wc -c < "$utf16")" -c "$(cat "$utf16.cp")" \
+                -l "utf16_to_utf8 $engine" -- ./utf16_to_utf8 $flags -i "$utf16" -o /dev/null
+            bench/runbench -n "$REPEAT" -b "$(wc -c < "$utf8")" -c "$(cat "$utf8.cp")" \
+                -l "utf8_to_utf16 $engine" -- ./utf8_to_utf16 $flags -i "$utf8" -o /dev/null
+        done
+
+        if [ "$ICONV" = 1 ]; then
+            # -c: некорректные последовательности пропускаются, а не прерывают перекодирование
+            bench/runbench -n "$REPEAT" -b "$(wc -c < "$utf16")" -c "$(cat "$utf16.cp")" \
+                -l "utf16_to_utf8 iconv" -- iconv -c -f UTF-16 -t UTF-8 "$utf16"
+            bench/runbench -n "$REPEAT" -b "$(wc -c < "$utf8")" -c "$(cat "$utf8.cp")" \
+                -l "utf8_to_utf16 iconv" -- iconv -c -f UTF-8 -t UTF-16LE "$utf8"
+        fi
+    done
+done
@@ -0,0 +1,238 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Генератор синтетических корпусов для замеров: воспроизводимый текст заданного вида,
+// размера и кодировки с заданной долей некорректных последовательностей.
+// В стандартный вывод печатается количество символов (кодовых точек) в корпусе.
+
+#define OUT_BUF_SIZE (1 << 20)
+
+static const char *kinds[] = {"ascii", "cyrillic", "cjk", "emoji", "mixed"};
+
+static uint64_t state;
+
+// xorshift64*: одна и та же последовательность при одном и том же seed
+static uint64_t next_random(void) {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+static unsigned int random_below(unsigned int n) {
+    return (unsigned int)((next_random() >> 32) % n);
+}
+
+static unsigned char buf[OUT_BUF_SIZE];
+static size_t buf_len;
+static FILE *out;
+
+// Буфер сбрасывается в основном цикле, запас - на один символ
+static void put_byte(unsigned char b) {
+    buf[buf_len++] = b;
+}
+
+static void put_utf8(unsigned int cp) {
+    if (cp < 0x80) {
+        put_byte(cp);
+    } else if (cp < 0x800) {
+        put_byte(0xC0 | (cp >> 6));
+        put_byte(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        put_byte(0xE0 | (cp >> 12));
+        put_byte(0x80 | ((cp >> 6) & 0x3F));
+        put_byte(0x80 | (cp & 0x3F));
+    } else {
+        put_byte(0xF0 | (cp >> 18));
+        put_byte(0x80 | ((cp >> 12) & 0x3F));
+        put_byte(0x80 | ((cp >> 6) & 0x3F));
+        put_byte(0x80 | (cp & 0x3F));
+    }
+}
+
+static void put_unit(unsigned int unit, int little_endian) {
+    if (little_endian) {
+        put_byte(unit & 0xFF);
+        put_byte(unit >> 8);
+    } else {
+        put_byte(unit >> 8);
+        put_byte(unit & 0xFF);
+    }
+}
+
+static void put_utf16(unsigned int cp, int little_endian) {
+    if (cp >= 0x10000) {
+        cp -= 0x10000;
+        put_unit(0xD800 | (cp >> 10), little_endian);
+        put_unit(0xDC00 | (cp & 0x3FF), little_endian);
+    } else {
+        put_unit(cp, little_endian);
+    }
+}
+
+// Некорректная последовательность: лишний байт продолжения, запрещённый байт,
+// оборванная или избыточная запись в UTF-8; одиночная часть суррогатной пары в UTF-16
+static void put_malformed(int encoding) {
+    static const unsigned char utf8_bad[][3] = {
+        {1, 0x80}, {1, 0xFF}, {2, 0xE0, 0xA0}, {2, 0xC0, 0xAF}, {2, 0xED, 0xA0}, {1, 0xF5},
+    };
+    if (encoding == 0) {
+        const unsigned char *bad = utf8_bad[random_below(sizeof(utf8_bad) / sizeof(utf8_bad[0]))];
+        for (int i = 1; i <= bad[0]; i++) {
+            put_byte(bad[i]);
+        }
+    } else {
+        put_unit(random_below(2) ? 0xD800 + random_below(0x400) : 0xDC00 + random_below(0x400), encoding == 1);
+    }
+}
+
+// Пробелы, знаки препинания и перевод строки между словами
+static unsigned int separator(void) {
+    static const char seps[] = "      ,.\n";
+    return seps[random_below(sizeof(seps) - 1)];
+}
+
+static unsigned int letter(int kind) {
+    switch (kind) {
+    case 0:
+        return 0x21 + random_below(0x7F - 0x21);
+    case 1:
+        return 0x410 + random_below(0x40);
+    case 2:
+        return 0x4E00 + random_below(0x9FFF - 0x4E00 + 1);
+    default:
+        return 0x1F300 + random_below(0x1FAFF - 0x1F300 + 1);
+    }
+}
+
+static int parse_size(const char *s, unsigned long long *size) {
+    char *end;
+    unsigned long long n = strtoull(s, &end, 10);
+    if (end == s) {
+        return -1;
+    }
+    switch (*end) {
+    case 'G': case 'g': n <<= 10;  // fallthrough
+    case 'M': case 'm': n <<= 10;  // fallthrough
+    case 'K': case 'k': n <<= 10; end++;
+    }
+    if (*end != '\0') {
+        return -1;
+    }
+    *size = n;
+    return 0;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s -k ascii|cyrillic|cjk|emoji|mixed -s size[K|M|G] [-m malformed_percent]\n"
+                    "       [-e utf8|utf16le|utf16be] [-r seed] -o output_file\n", name);
+}
+
+int main(int argc, char *argv[]) {
+    int kind = -1;
+    int encoding = 0;  // 0 - UTF-8, 1 - UTF-16LE, 2 - UTF-16BE
+    unsigned long long size = 0;
+    double malformed = 0;
+    unsigned long long seed = 1;
+    const char *output_file = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = i + 1 < argc ? argv[i + 1] : NULL;
+        if (arg == NULL) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-k") == 0) {
+            for (int k = 0; k < (int)(sizeof(kinds) / sizeof(kinds[0])); k++) {
+                if (strcmp(arg, kinds[k]) == 0) {
+                    kind = k;
+                }
+            }
+        } else if (strcmp(argv[i], "-s") == 0) {
+            if (parse_size(arg, &size) != 0) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-m") == 0) {
+            malformed = atof(arg);
+        } else if (strcmp(argv[i], "-e") == 0) {
+            if (strcmp(arg, "utf8") == 0) {
+                encoding = 0;
+            } else if (strcmp(arg, "utf16le") == 0) {
+                encoding = 1;
+            } else if (strcmp(arg, "utf16be") == 0) {
+                encoding = 2;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-r") == 0) {
+            seed = strtoull(arg, NULL, 10);
+        } else if (strcmp(argv[i], "-o") == 0) {
+            output_file = arg;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+        i++;
+    }
+    if (kind < 0 || output_file == NULL) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    out = fopen(output_file, "wb");
+    if (!out) {
+        fprintf(stderr, "Error: could not open output file %s\n", output_file);
+        return 1;
+    }
+
+    state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    // Порог для доли некорректных последовательностей среди символов
+    uint64_t bad_threshold = (uint64_t)(malformed / 100.0 * 4294967296.0);
+    unsigned long long written = 0;
+    unsigned long long codepoints = 0;
+    int word_kind = kind;
+    int word_left = 0;
+
+    if (encoding != 0) {
+        put_utf16(0xFEFF, encoding == 1);
+    }
+    while (written + buf_len < size) {
+        unsigned int cp;
+        if (word_left == 0) {
+            // Слова по 1-10 символов; в смешанном тексте у каждого слова свой алфавит
+            word_left = 1 + random_below(10);
+            word_kind = kind == 4 ? (int)random_below(4) : kind;
+            cp = separator();
+        } else {
+            word_left--;
+            cp = letter(word_kind);
+        }
+        if (bad_threshold && (next_random() >> 32) < bad_threshold) {
+            put_malformed(encoding);
+        } else {
+            if (encoding == 0) {
+                put_utf8(cp);
+            } else {
+                put_utf16(cp, encoding == 1);
+            }
+            codepoints++;
+        }
+        if (buf_len >= OUT_BUF_SIZE - 8) {
+            fwrite(buf, 1, buf_len, out);
+            written += buf_len;
+            buf_len = 0;
+        }
+    }
+    fwrite(buf, 1, buf_len, out);
+
+    if (fclose(out) != 0) {
+        fprintf(stderr, "Error: could not write output file %s\n", output_file);
+        return 1;
+    }
+    printf("%llu\n", codepoints);
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Замер одной команды: лучшее время из нескольких запусков, пропускная способность
+// в МБ/с и символах/с, пиковый объём резидентной памяти дочернего процесса.
+// Стандартные потоки команды перенаправляются в /dev/null (диагностика тоже замеряется).
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n repeat] -b bytes -c codepoints -l label -- command [args...]\n", name);
+}
+
+// Один запуск: время в секундах и пиковый RSS в килобайтах; -1 при ошибке команды
+static double run_once(char *argv[], long *max_rss) {
+    struct timespec start, stop;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+    if (pid == 0) {
+        int null = open("/dev/null", O_RDWR);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) < 0) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    *max_rss = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 127) {
+        return -1;
+    }
+    return (stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    int repeat = 3;
+    double bytes = 0;
+    double codepoints = 0;
+    const char *label = "";
+    int i;
+
+    for (i = 1; i < argc && strcmp(argv[i], "--") != 0; i++) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+            return 1;
+        }
+        if (strcmp(argv[i], "-n") == 0) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0) {
+            bytes = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-c") == 0) {
+            codepoints = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0) {
+            label = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (i + 1 >= argc || repeat < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    double best = -1;
+    long peak_rss = 0;
+    for (int r = 0; r < repeat; r++) {
+        long rss;
+        double t = run_once(argv + i + 1, &rss);
+        if (t < 0) {
+            printf("%-40s failed\n", label);
+            return 1;
+        }
+        if (best < 0 || t < best) {
+            best = t;
+        }
+        if (rss > peak_rss) {
+            peak_rss = rss;
+        }
+    }
+
+    // Защита от деления на ноль на очень маленьких корпусах
+    if (best < 1e-9) {
+        best = 1e-9;
+    }
+    printf("%-40s %10.4f s %10.1f MB/s %10.1f Mcp/s %10ld KB\n",
+           label, best, bytes / best / 1e6, codepoints / best / 1e6, peak_rss);
+    return 0;
+}
@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include "check.h"
+#include "convert.h"
+
+// Длина BOM в начале входа; для UTF-16 по нему определяется порядок байтов
+static size_t bom_length(const unsigned char *data, size_t size, int direction, int *little_endian) {
+    return direction == CONVERT_UTF16_TO_UTF8 ? (size_t)utf16_bom(data, size, little_endian)
+                                              : (size_t)utf8_bom(data, size);
+}
+
+// Название кодировки входа
+static const char *input_encoding(int direction, int little_endian) {
+    return direction == CONVERT_UTF8_TO_UTF16 ? "UTF-8" : little_endian ? "UTF-16LE" : "UTF-16BE";
+}
+
+// Проверка (и подсчёт) участка входа
+static size_t scan_block(int direction, const unsigned char *in, size_t len, int little_endian,
+                         long offset, int final, convert_errors *errors, convert_counts *counts) {
+    if (counts) {
+        return direction == CONVERT_UTF16_TO_UTF8
+            ? utf16_count_block(in, len, little_endian, offset, final, errors, counts)
+            : utf8_count_block(in, len, little_endian, offset, final, errors, counts);
+    }
+    return direction == CONVERT_UTF16_TO_UTF8
+        ? utf16_validate_block(in, len, little_endian, offset, final, errors)
+        : utf8_validate_block(in, len, little_endian, offset, final, errors);
+}
+
+// Строка в кавычках JSON
+void print_json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            fprintf(f, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void print_report(FILE *f, const char *name, const char *encoding, int bom, size_t size,
+                         const convert_errors *errors, int json) {
+    size_t shown = errors->count < errors->capacity ? errors->count : errors->capacity;
+
+    if (json) {
+        fprintf(f, "{\"file\": ");
+        print_json_string(f, name);
+        fprintf(f, ", \"encoding\": \"%s\", \"bom\": %s, \"bytes\": %zu, \"valid\": %s, \"errors\": %zu, "
+                   "\"first_errors\": [",
+                encoding, bom ? "true" : "false", size, errors->count ? "false" : "true", errors->count);
+        for (size_t k = 0; k < shown; k++) {
+            const convert_error *err = &errors->list[k];
+            fprintf(f, "%s{\"offset\": %ld, \"kind\": \"%s\", \"bytes\": [", k ? ", " : "", err->offset,
+                    convert_error_name(err->kind));
+            for (size_t b = 0; b < err->length; b++) {
+                fprintf(f, "%s%u", b ? ", " : "", err->bytes[b]);
+            }
+            fprintf(f, "]}");
+        }
+        fprintf(f, "]}\n");
+        return;
+    }
+
+    if (errors->count == 0) {
+        fprintf(f, "%s: valid %s%s, %zu bytes\n", name, encoding, bom ? " with BOM" : "", size);
+        return;
+    }
+    fprintf(f, "%s: invalid %s%s, %zu bytes, %zu error%s\n", name, encoding, bom ? " with BOM" : "", size,
+            errors->count, errors->count == 1 ? "" : "s");
+    for (size_t k = 0; k < shown; k++) {
+        const convert_error *err = &errors->list[k];
+        fprintf(f, "  offset %ld: %s", err->offset, convert_error_name(err->kind));
+        for (size_t b = 0; b < err->length; b++) {
+            fprintf(f, " 0x%02X", err->bytes[b]);
+        }
+        fputc('\n', f);
+    }
+    if (errors->count > shown) {
+        fprintf(f, "  ... %zu more\n", errors->count - shown);
+    }
+}
+
+// Чтение входа целиком с проверкой (и подсчётом, если counts != NULL): BOM пропускается,
+// порядок байтов UTF-16 уточняется по нему. Возвращает 0 или CHECK_FAILED при ошибке чтения.
+static int scan_input(input_source *src, int direction, int *little_endian, size_t *bom, size_t *size,
+                      convert_errors *errors, convert_counts *counts) {
+    *bom = 0;
+    *size = 0;
+
+    if (src->mapped) {
+        // Отображённый файл проверяется за один вызов
+        *bom = bom_length(src->data, src->size, direction, little_endian);
+        scan_block(direction, src->data + *bom, src->size - *bom, *little_endian, (long)*bom, 1, errors, counts);
+        *size = src->size;
+        return 0;
+    }
+
+    // Поток читается полными блоками; незаконченная последовательность переносится в следующий.
+    // Прочитанное заранее начало (input_peek, не длиннее блока) входит в первый блок.
+    unsigned char *buf = malloc(CONVERT_BLOCK_SIZE + 8);
+    if (!buf) {
+        fprintf(stderr, "Error: out of memory\n");
+        return CHECK_FAILED;
+    }
+    size_t have = 0;
+    long offset = 0;
+    int status = 0;
+    size_t head_len = src->head_len < CONVERT_BLOCK_SIZE ? src->head_len : CONVERT_BLOCK_SIZE;
+    memcpy(buf, src->head, head_len);
+    for (;;) {
+        size_t n = head_len + fread(buf + have + head_len, 1, CONVERT_BLOCK_SIZE - head_len, src->file);
+        head_len = 0;
+        if (ferror(src->file)) {
+            fprintf(stderr, "Error: read error at offset %zu\n", *size);
+            status = CHECK_FAILED;
+            break;
+        }
+        int at_end = n < CONVERT_BLOCK_SIZE;
+        size_t pos = 0;
+        if (*size == 0) {
+            *bom = bom_length(buf, n, direction, little_endian);
+            pos = *bom;
+            offset = (long)*bom;
+        }
+        *size += n;
+        have += n;
+
+        size_t used = scan_block(direction, buf + pos, have - pos, *little_endian, offset, at_end, errors, counts);
+        offset += (long)used;
+        pos += used;
+        memmove(buf, buf + pos, have - pos);
+        have -= pos;
+        if (at_end) {
+            break;
+        }
+    }
+    free(buf);
+    return status;
+}
+
+// Проверка входа без перекодирования
+int check_input(input_source *src, const char *name, int direction, int little_endian,
+                size_t first, int json, FILE *report) {
+    convert_error *list = first ? malloc(first * sizeof(*list)) : NULL;
+    if (first && !list) {
+        fprintf(stderr, "Error: out of memory\n");
+        return CHECK_FAILED;
+    }
+    convert_errors errors = {list, first, 0, NULL, NULL, 0};
+    size_t bom, size;
+    int status = scan_input(src, direction, &little_endian, &bom, &size, &errors, NULL);
+
+    if (status == CHECK_VALID) {
+        print_report(report, name, input_encoding(direction, little_endian), bom != 0, size, &errors, json);
+        status = errors.count ? CHECK_INVALID : CHECK_VALID;
+    }
+    free(list);
+    return status;
+}
+
+// Сумма длин некорректных последовательностей (для подсчёта результата в той же кодировке)
+static void add_error_bytes(const convert_error *err, void *arg) {
+    *(size_t *)arg += err->length;
+}
+
+// Подсчёт размеров входа и результата без перекодирования
+int count_input(input_source *src, const char *name, int direction, int little_endian, int to, int out_le,
+                int json, FILE *report) {
+    size_t error_bytes = 0;
+    convert_errors errors = {NULL, 0, 0, add_error_bytes, &error_bytes, 0};
+    convert_counts counts = {0, 0};
+    size_t bom, size;
+    if (scan_input(src, direction, &little_endian, &bom, &size, &errors, &counts) != 0) {
+        return CHECK_FAILED;
+    }
+
+    // Кодовые единицы входа; нечётный последний байт UTF-16 единицей не считается
+    size_t in_units = direction == CONVERT_UTF16_TO_UTF8 ? (size - bom) / 2 : size - bom;
+    const char *in_encoding = input_encoding(direction, little_endian);
+    const char *out_encoding;
+    size_t out_units;
+    size_t out_bytes;
+    int out_bom;
+    // В ту же кодировку (UTF-8 без BOM, UTF-16 с другим порядком байтов) переходит весь вход,
+    // кроме BOM и некорректных последовательностей
+    int same = (direction == CONVERT_UTF16_TO_UTF8) == (to == CONVERT_ENC_UTF16);
+    if (to == CONVERT_ENC_UTF8) {
+        out_encoding = "UTF-8";
+        out_units = same ? size - bom - error_bytes : counts.units;
+        out_bytes = out_units;
+        out_bom = 0;
+    } else {
+        // Программа всегда записывает BOM UTF-16
+        out_encoding = out_le ? "UTF-16LE" : "UTF-16BE";
+        out_units = same ? (size - bom - error_bytes) / 2 : counts.units;
+        out_bytes = 2 + 2 * out_units;
+        out_bom = 1;
+    }
+
+    if (json) {
+        fprintf(report, "{\"file\": ");
+        print_json_string(report, name);
+        fprintf(report, ", \"input\": {\"encoding\": \"%s\", \"bom\": %s, \"bytes\": %zu, \"code_units\": %zu}, "
+                        "\"codepoints\": %zu, \"errors\": %zu, "
+                        "\"output\": {\"encoding\": \"%s\", \"bom\": %s, \"bytes\": %zu, \"code_units\": %zu}}\n",
+                in_encoding, bom ? "true" : "false", size, in_units, counts.codepoints, errors.count,
+                out_encoding, out_bom ? "true" : "false", out_bytes, out_units + out_bom);
+    } else {
+        fprintf(report, "%s: %s%s, %zu bytes, %zu code units, %zu code points, %zu error%s\n",
+                name, in_encoding, bom ? " with BOM" : "", size, in_units, counts.codepoints, errors.count,
+                errors.count == 1 ? "" : "s");
+        fprintf(report, "  output: %s%s, %zu bytes, %zu code units\n",
+                out_encoding, out_bom ? " with BOM" : "", out_bytes, out_units + out_bom);
+    }
+    return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <stdio.h>
+#include "input.h"
+
+// Сколько первых ошибок выводится в отчёте по умолчанию
+#define CHECK_FIRST_ERRORS 10
+
+// Результат проверки (код завершения программы)
+#define CHECK_VALID 0    // Вход корректен
+#define CHECK_FAILED 1   // Ошибка чтения или нехватка памяти
+#define CHECK_INVALID 2  // Во входе есть некорректные последовательности
+
+// Проверка входа без перекодирования самой быстрой доступной реализацией.
+// Отчёт (корректность, число ошибок, первые first ошибок) выводится в report,
+// при json == 1 - одной строкой JSON. name - имя входа для отчёта.
+int check_input(input_source *src, const char *name, int direction, int little_endian,
+                size_t first, int json, FILE *report);
+
+// Подсчёт без перекодирования: символы, кодовые единицы и байты входа и результата,
+// число некорректных последовательностей (в результат они не попадают). Результат - в
+// кодировке to (CONVERT_ENC_UTF8 или CONVERT_ENC_UTF16, в том числе та же, что у входа)
+// с порядком байтов out_le; little_endian - порядок байтов входа UTF-16 без BOM. Размер
+// результата включает BOM, который записывает программа. Возвращает 0 или CHECK_FAILED.
+int count_input(input_source *src, const char *name, int direction, int little_endian, int to, int out_le,
+                int json, FILE *report);
+
+// Вывод строки в кавычках JSON (для отчётов в формате JSON)
+void print_json_string(FILE *f, const char *s);
+
+#endif  // CHECK_H
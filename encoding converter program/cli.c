@@ -0,0 +1,649 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "aio.h"
+#include "batch.h"
+#include "check.h"
+#include "cli.h"
+#include "convert.h"
+#include "diag.h"
+#include "index.h"
+#include "input.h"
+#include "parallel.h"
+#include "stats.h"
+
+// Размер выходного буфера: хватает на блок при перекодировании в любом направлении
+#define OUT_BUF_SIZE CONVERT_DECODER_OUT_MAX(CONVERT_BLOCK_SIZE)
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s -i input_file -o output_file [-f encoding] [-t encoding] [-le | -be] [--mmap | --no-mmap]\n"
+                    "       [-j threads] [--reference]\n"
+                    "       [--io=auto|uring|threads|sync] [--impl=name] [--list-impls] [--check [--json] [--first n]] [--count [--json]]\n"
+                    "       [--errors=summary|text|json] [--max-errors n] [--on-error=skip|replace|abort]\n"
+                    "       [--index index_file [--index-interval n]] [--stats[=file] [--json]]\n"
+                    "       %s --batch [-r] [-j threads] [--json] [-f encoding] [-t encoding] -o output_dir [path...]\n"
+                    "Encodings: utf-8, utf-16, utf-16le, utf-16be, utf-32, utf-32le, utf-32be,\n"
+                    "           cp1251, koi8-r, cp866, iso-8859-1, iso-8859-5; -f auto detects the input encoding\n"
+                    "           (--from=name and --to=name are the same as -f and -t)\n",
+            name, name);
+}
+
+// Сообщение о найденном (или не найденном) BOM UTF-16 в поток f
+static void print_bom_banner(FILE *f, int found, int little_endian) {
+    if (found) {
+        fprintf(f, "BOM detected. Using %s-endian.\n", little_endian ? "little" : "big");
+    } else {
+        fprintf(f, "No BOM found. Using %s-endian.\n", little_endian ? "little" : "big");
+    }
+}
+
+// Ошибки входа при построении индекса идут и в диагностику, и в построитель
+typedef struct {
+    diag_log *diag;
+    convert_index_builder *index;
+} error_sinks;
+
+static void report_error(const convert_error *err, void *arg) {
+    error_sinks *sinks = arg;
+    diag_report(err, sinks->diag);
+    convert_index_report(err, sinks->index);
+}
+
+// Однопоточное перекодирование через потоковый декодер. Отображённый файл подаётся
+// участками без копирования, канал читается по мере поступления данных, без поиска назад.
+// Чтение идёт на несколько блоков впереди, запись - позади перекодирования (aio.h).
+// Если index != NULL, по результату строится индекс позиций, если stats != NULL - статистика.
+// Если banner != NULL, в него выводится сообщение о BOM, как только декодер его найдёт.
+static int convert_single(input_source *src, FILE *out, convert_decoder *dec, convert_errors *errors,
+                          convert_index_builder *index, stats_counters *stats, FILE *banner, int io_mode) {
+    fflush(out);  // BOM UTF-16 записан через stdio, дальше запись идёт мимо него
+    aio_stream *reader = src->mapped ? NULL : aio_open_reader(fileno(src->file), io_mode, CONVERT_BLOCK_SIZE);
+    aio_stream *writer = aio_open_writer(fileno(out), io_mode, OUT_BUF_SIZE);
+    if ((!src->mapped && !reader) || !writer) {
+        aio_close(reader);
+        aio_close(writer);
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+    uint64_t mark = 0;  // Начало текущей фазы (только со статистикой)
+    if (stats) {
+        stats->io_read = reader ? aio_stream_mode(reader) : "mmap";
+        stats->io_write = aio_stream_mode(writer);
+        mark = stats_now();
+    }
+
+    const unsigned char *p = src->data;
+    size_t left = src->size;
+    int head = !src->mapped && src->head_len > 0;  // Начало потока, прочитанное input_peek
+    int status = 0;
+
+    for (;;) {
+        const unsigned char *chunk;
+        size_t n;
+        if (src->mapped) {
+            if (left == 0) {
+                break;
+            }
+            n = left < CONVERT_BLOCK_SIZE ? left : CONVERT_BLOCK_SIZE;
+            chunk = p;
+            p += n;
+            left -= n;
+        } else if (head) {
+            chunk = src->head;
+            n = src->head_len;
+            head = 0;
+        } else {
+            ssize_t r = aio_read(reader, &chunk);
+            if (r < 0) {
+                fprintf(stderr, "Error: read error at offset %ld\n", dec->offset + (long)dec->pending_len);
+                status = -1;
+                break;
+            }
+            if (r == 0) {
+                break;
+            }
+            n = (size_t)r;
+        }
+        if (stats) {
+            stats->bytes_in += n;
+            stats_lap(stats, STATS_READ, &mark);
+        }
+
+        // Выход блока пишется прямо в буфер записи; блоки по мере готовности уходят
+        // на запись, поэтому медленный вход не задерживает вывод
+        size_t out_len;
+        unsigned char *obuf = aio_write_buffer(writer);
+        stats_lap(stats, STATS_WRITE, &mark);
+        convert_decoder_push(dec, chunk, n, obuf, OUT_BUF_SIZE, &out_len, errors);
+        if (index) {
+            convert_index_add(index, dec, obuf, out_len);
+        }
+        stats_count(stats, obuf, out_len);
+        stats_lap(stats, STATS_TRANSCODE, &mark);
+        if (banner && !dec->bom_phase) {
+            print_bom_banner(banner, dec->bom_found, dec->little_endian);
+            fflush(banner);  // Сообщение идёт раньше данных
+            banner = NULL;
+        }
+        if (out_len) {
+            aio_write(writer, out_len);
+            stats_lap(stats, STATS_WRITE, &mark);
+        }
+    }
+
+    size_t out_len;
+    unsigned char *obuf = aio_write_buffer(writer);
+    stats_lap(stats, STATS_WRITE, &mark);
+    convert_decoder_finish(dec, obuf, OUT_BUF_SIZE, &out_len, errors);
+    if (index) {
+        convert_index_add(index, dec, obuf, out_len);
+    }
+    stats_count(stats, obuf, out_len);
+    stats_lap(stats, STATS_TRANSCODE, &mark);
+    if (banner) {
+        print_bom_banner(banner, dec->bom_found, dec->little_endian);
+        fflush(banner);
+    }
+    if (out_len) {
+        aio_write(writer, out_len);
+    }
+
+    aio_close(reader);
+    if (aio_close(writer) != 0) {
+        fprintf(stderr, "Error: could not write output\n");
+        status = -1;
+    }
+    stats_lap(stats, STATS_WRITE, &mark);
+    return status;
+}
+
+// Список реализаций перекодирования и их поддержка процессором
+static void list_impls(void) {
+    for (size_t k = 0; k < convert_impl_count(); k++) {
+        const char *impl = convert_impl_name(k);
+        printf("%-8s %s%s\n", impl, convert_impl_supported(k) ? "supported" : "unsupported",
+               strcmp(impl, convert_current_impl()) == 0 ? " (default)" : "");
+    }
+}
+
+// Посимвольное перекодирование исходными функциями через stdio (эталон для сравнения)
+static void convert_reference(FILE *in, FILE *out, FILE *banner, int direction, int little_endian) {
+    unsigned int codepoint;
+    if (direction == CONVERT_UTF16_TO_UTF8) {
+        int found = read_bom(in, &little_endian);
+        if (banner) {
+            print_bom_banner(banner, found, little_endian);
+        }
+        while (!feof(in)) {
+            if ((codepoint = read_utf16_char(in, little_endian)) != (unsigned int)-1) {
+                write_utf8(out, codepoint);
+            }
+        }
+    } else {
+        while (!feof(in)) {
+            if ((codepoint = read_utf8_char(in)) != (unsigned int)-1) {
+                write_utf16(out, codepoint, little_endian);
+            }
+        }
+    }
+}
+
+int cli_main(int argc, char *argv[]) {
+    // Под прежними именами программа работает как раньше: направление задаётся именем,
+    // а для UTF-16 на входе выводится сообщение о BOM: в stdout или, если результат идёт
+    // в stdout, в stderr
+    const char *name = strrchr(argv[0], '/') ? strrchr(argv[0], '/') + 1 : argv[0];
+    int direction = -1;
+    if (strcmp(name, "utf16_to_utf8") == 0) {
+        direction = CONVERT_UTF16_TO_UTF8;
+    } else if (strcmp(name, "utf8_to_utf16") == 0) {
+        direction = CONVERT_UTF8_TO_UTF16;
+    }
+    int legacy = direction >= 0;
+    char *input_file = NULL;
+    char *output_file = NULL;
+    int little_endian = -1;  // -le и -be: порядок байтов входа и результата, если кодировка его не задаёт
+    int from_le = -1;
+    int to_le = -1;
+    int from = -1;  // Кодировки входа и результата; по умолчанию - по имени программы
+    int to = -1;
+    int input_mode = INPUT_AUTO;
+    int io_mode = AIO_AUTO;
+    int threads = -1;  // Не задано: 1, в пакетном режиме - по числу процессоров
+    int reference = 0;
+    int check = 0;
+    int count = 0;
+    int json = 0;
+    size_t first = CHECK_FIRST_ERRORS;
+    int errors_mode = DIAG_TEXT;
+    long max_errors = -1;  // Не задано: DIAG_MAX_ERRORS, при проверке - first
+    int on_error = CONVERT_ON_ERROR_SKIP;
+    char *index_file = NULL;
+    size_t index_interval = CONVERT_INDEX_INTERVAL;
+    const char *stats_file = NULL;  // Куда выводить статистику: "-" - stderr
+    int batch = 0;
+    int recursive = 0;
+    // Файлы и каталоги пакетного режима собираются в начало argv на место разобранных аргументов
+    char **paths = argv + 1;
+    size_t npaths = 0;
+
+    // Парсим аргументы командной строки
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-i") == 0) {
+            if (input_file != NULL) {
+                fprintf(stderr, "Too many arguments\n");
+                usage(name);
+                return 1;
+            }
+            if (i + 1 < argc) {
+                input_file = argv[++i];
+            } else {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-o") == 0) {
+            if (output_file != NULL) {
+                fprintf(stderr, "Too many arguments\n");
+                usage(name);
+                return 1;
+            }
+            if (i + 1 < argc) {
+                output_file = argv[++i];
+            } else {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-le") == 0) {
+            if (little_endian != -1) {
+                fprintf(stderr, "Too many arguments\n");
+                usage(name);
+                return 1;
+            }
+            little_endian = 1;
+        } else if (strcmp(argv[i], "-be") == 0) {
+            if (little_endian != -1) {
+                fprintf(stderr, "Too many arguments\n");
+                usage(name);
+                return 1;
+            }
+            little_endian = 0;
+        } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "-t") == 0 ||
+                   strncmp(argv[i], "--from=", 7) == 0 || strncmp(argv[i], "--to=", 5) == 0) {
+            int is_from = argv[i][1] == 'f' || argv[i][2] == 'f';
+            const char *value;
+            if (argv[i][1] == '-') {
+                value = strchr(argv[i], '=') + 1;
+            } else if (i + 1 < argc) {
+                value = argv[++i];
+            } else {
+                usage(name);
+                return 1;
+            }
+            int encoding = convert_encoding(value, is_from ? &from_le : &to_le);
+            if (encoding == -1 || (!is_from && encoding == CONVERT_ENC_AUTO)) {
+                fprintf(stderr, "Error: unknown encoding %s\n", value);
+                return 1;
+            }
+            *(is_from ? &from : &to) = encoding;
+        } else if (strcmp(argv[i], "-j") == 0) {
+            char *end;
+            if (i + 1 >= argc || (threads = (int)strtol(argv[++i], &end, 10)) < 0 || *end != '\0') {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--check") == 0) {
+            check = 1;
+        } else if (strcmp(argv[i], "--count") == 0) {
+            count = 1;
+        } else if (strcmp(argv[i], "--json") == 0) {
+            json = 1;
+        } else if (strcmp(argv[i], "--first") == 0) {
+            char *end;
+            long n;
+            if (i + 1 >= argc || (n = strtol(argv[++i], &end, 10)) < 0 || *end != '\0') {
+                usage(name);
+                return 1;
+            }
+            first = (size_t)n;
+        } else if (strncmp(argv[i], "--errors=", 9) == 0) {
+            if ((errors_mode = diag_mode(argv[i] + 9)) < 0) {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--max-errors") == 0) {
+            char *end;
+            if (i + 1 >= argc || (max_errors = strtol(argv[++i], &end, 10)) < 0 || *end != '\0') {
+                usage(name);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--on-error=", 11) == 0) {
+            const char *policy = argv[i] + 11;
+            if (strcmp(policy, "skip") == 0) {
+                on_error = CONVERT_ON_ERROR_SKIP;
+            } else if (strcmp(policy, "replace") == 0) {
+                on_error = CONVERT_ON_ERROR_REPLACE;
+            } else if (strcmp(policy, "abort") == 0) {
+                on_error = CONVERT_ON_ERROR_ABORT;
+            } else {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--index") == 0) {
+            if (i + 1 >= argc) {
+                usage(name);
+                return 1;
+            }
+            index_file = argv[++i];
+        } else if (strcmp(argv[i], "--index-interval") == 0) {
+            char *end;
+            long n;
+            if (i + 1 >= argc || (n = strtol(argv[++i], &end, 10)) <= 0 || *end != '\0') {
+                usage(name);
+                return 1;
+            }
+            index_interval = (size_t)n;
+        } else if (strcmp(argv[i], "--stats") == 0 || strncmp(argv[i], "--stats=", 8) == 0) {
+            stats_file = argv[i][7] == '=' ? argv[i] + 8 : "-";
+            if (*stats_file == '\0') {
+                usage(name);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = 1;
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--recursive") == 0) {
+            recursive = 1;
+        } else if (argv[i][0] != '-') {
+            paths[npaths++] = argv[i];
+        } else if (strcmp(argv[i], "--reference") == 0) {
+            reference = 1;
+        } else if (strncmp(argv[i], "--impl=", 7) == 0) {
+            if (convert_select_impl(argv[i] + 7) != 0) {
+                fprintf(stderr, "Error: unknown or unsupported implementation %s\n", argv[i] + 7);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--list-impls") == 0) {
+            list_impls();
+            return 0;
+        } else if (strcmp(argv[i], "--mmap") == 0) {
+            input_mode = INPUT_MMAP;
+        } else if (strcmp(argv[i], "--no-mmap") == 0) {
+            input_mode = INPUT_STDIO;
+        } else if (strncmp(argv[i], "--io=", 5) == 0) {
+            if ((io_mode = aio_mode(argv[i] + 5)) < 0) {
+                usage(name);
+                return 1;
+            }
+        } else {
+            usage(name);
+            return 1;
+        }
+    }
+
+    if (little_endian == -1) {
+        little_endian = 1;  // По умолчанию используем LE
+    }
+    from_le = from_le == -1 ? little_endian : from_le;
+    to_le = to_le == -1 ? little_endian : to_le;
+    if (from == -1) {
+        from = !legacy ? CONVERT_ENC_AUTO : direction == CONVERT_UTF16_TO_UTF8 ? CONVERT_ENC_UTF16 : CONVERT_ENC_UTF8;
+    }
+    if (to == -1) {
+        to = !legacy ? CONVERT_ENC_UTF8 : direction == CONVERT_UTF16_TO_UTF8 ? CONVERT_ENC_UTF8 : CONVERT_ENC_UTF16;
+    }
+    // UTF-16 и UTF-32 можно перекодировать в ту же кодировку с другим порядком байтов
+    if (from == to && ((from != CONVERT_ENC_UTF16 && from != CONVERT_ENC_UTF32) || from_le == to_le)) {
+        fprintf(stderr, "Error: input and output encodings are the same\n");
+        return 1;
+    }
+    if (index_file && (batch || check || count || reference)) {
+        fprintf(stderr, "Error: --index is supported only for a single conversion\n");
+        return 1;
+    }
+    if (stats_file && (batch || check || count || reference)) {
+        fprintf(stderr, "Error: --stats is supported only for a single conversion\n");
+        return 1;
+    }
+
+    if (batch) {
+        // Пакетный режим: -o - каталог результатов, -i - ещё один входной путь
+        if (output_file == NULL || check || count || reference) {
+            usage(name);
+            return 1;
+        }
+        if (input_file != NULL) {
+            paths[npaths++] = input_file;
+        }
+        batch_options opt = {from, to, from_le, to_le, threads < 0 ? 0 : threads, recursive, json, output_file,
+                             errors_mode, max_errors < 0 ? DIAG_MAX_ERRORS : (size_t)max_errors, on_error};
+        return batch_convert(paths, npaths, &opt, stdout);
+    }
+    if (npaths > 0 || recursive) {
+        usage(name);
+        return 1;
+    }
+
+    // Открытие файлов
+    // Обычные файлы отображаются в память, каналы и стандартный ввод читаются через stdio
+    input_source src;
+    int rc = input_open(&src, input_file, input_mode);
+    if (rc == INPUT_ERR_OPEN) {
+        fprintf(stderr, "Error: could not open input file %s\n", input_file);
+        return 1;
+    } else if (rc == INPUT_ERR_MMAP) {
+        fprintf(stderr, "Error: could not memory-map input file %s\n", input_file ? input_file : "stdin");
+        return 1;
+    }
+
+    // Проверке, подсчёту, эталону и многопоточному пути кодировка входа нужна заранее: при -f auto
+    // она определяется по началу входа, как это сделал бы декодер. Эталон читает поток через
+    // stdio сам, поэтому для него кодировка определяется только у файлов в памяти.
+    if (from == CONVERT_ENC_AUTO && (check || count || (reference && src.mapped) || threads == 0 || threads > 1)) {
+        const unsigned char *head;
+        size_t head_len;
+        if (input_peek(&src, CONVERT_BLOCK_SIZE, &head, &head_len) != 0) {
+            fprintf(stderr, "Error: could not read input %s\n", input_file ? input_file : "stdin");
+            input_close(&src);
+            return 1;
+        }
+        from = convert_detect(head, head_len, &from_le);
+    }
+
+    // Проверка работает с входом UTF-8 и UTF-16, подсчёт - ещё и с результатом в одной из них,
+    // эталон и многопоточный путь - только между UTF-8 и UTF-16
+    int utf_input = from == CONVERT_ENC_UTF8 || from == CONVERT_ENC_UTF16;
+    int utf_output = to == CONVERT_ENC_UTF8 || to == CONVERT_ENC_UTF16;
+    int utf_pair = utf_input && utf_output && from != to;
+    direction = from == CONVERT_ENC_UTF16 ? CONVERT_UTF16_TO_UTF8 : CONVERT_UTF8_TO_UTF16;
+    little_endian = from == CONVERT_ENC_UTF16 ? from_le : to_le;  // Порядок байтов UTF-16 этой пары
+    if ((check && !utf_input) || (count && !(utf_input && utf_output)) || (reference && !utf_pair)) {
+        fprintf(stderr, "Error: --check, --count and --reference support only UTF-8 and UTF-16\n");
+        input_close(&src);
+        return 1;
+    }
+    if (threads < 0 || check || count) {
+        threads = 1;
+    } else if (threads != 1 && !utf_pair) {
+        fprintf(stderr, "Warning: -j is ignored for %s -> %s: only UTF-8 <-> UTF-16 runs in parallel\n",
+                convert_encoding_name(from), convert_encoding_name(to));
+        threads = 1;
+    } else if (threads != 1 && (on_error != CONVERT_ON_ERROR_SKIP || index_file)) {
+        fprintf(stderr, "Warning: -j is ignored with --on-error=replace, --on-error=abort and --index\n");
+        threads = 1;
+    }
+
+    if (check) {
+        // Только проверка: выходной файл не создаётся, отчёт выводится в stdout.
+        // --errors и --max-errors задают формат отчёта и число ошибок в нём.
+        if (max_errors >= 0) {
+            first = (size_t)max_errors;
+        }
+        if (errors_mode == DIAG_SUMMARY) {
+            first = 0;
+        } else if (errors_mode == DIAG_JSON) {
+            json = 1;
+        }
+        int rc = check_input(&src, input_file ? input_file : "stdin", direction, little_endian, first, json, stdout);
+        input_close(&src);
+        return rc;
+    }
+    if (count) {
+        // Только подсчёт размеров: выходной файл не создаётся
+        int rc = count_input(&src, input_file ? input_file : "stdin", direction, from_le, to, to_le, json, stdout);
+        input_close(&src);
+        return rc;
+    }
+
+    FILE *out = output_file != NULL ? fopen(output_file, "wb") : stdout;
+    if (!out) {
+        fprintf(stderr, "Error: could not open output file %s\n", output_file);
+        input_close(&src);
+        return 1;
+    }
+
+    // Сообщение о BOM не должно попасть в результат
+    FILE *banner = legacy && from == CONVERT_ENC_UTF16 ? (out == stdout ? stderr : stdout) : NULL;
+
+    // Статистика ведётся только с --stats, иначе вместо неё везде передаётся NULL
+    stats_counters stats_data;
+    stats_counters *stats = NULL;
+    if (stats_file) {
+        stats = &stats_data;
+        stats_init(stats, to, to_le);
+        stats->threads = threads;
+        stats->from = from;
+        stats->from_le = from_le;
+    }
+
+    // Записать BOM для UTF-16 и UTF-32
+    unsigned char bom[4];
+    size_t bom_len = convert_write_bom(to, to_le, bom);
+    fwrite(bom, 1, bom_len, out);
+    if (stats) {
+        stats->bytes_out += bom_len;
+    }
+
+    // Диагностика выводится в stderr блоками по мере накопления ошибок и итогом в конце
+    diag_log diag;
+    if (diag_init(&diag, errors_mode, max_errors < 0 ? DIAG_MAX_ERRORS : (size_t)max_errors, stderr, NULL) != 0) {
+        fprintf(stderr, "Error: out of memory\n");
+        input_close(&src);
+        fclose(out);
+        return 1;
+    }
+    convert_errors errors = {NULL, 0, 0, diag_report, &diag, 0};
+
+    // Индекс позиций строится по ходу перекодирования и записывается в конце
+    convert_index_builder *index = NULL;
+    error_sinks sinks = {&diag, NULL};
+    if (index_file) {
+        index = convert_index_builder_new(index_interval, (long)bom_len);
+        if (!index) {
+            fprintf(stderr, "Error: out of memory\n");
+            diag_free(&diag);
+            input_close(&src);
+            fclose(out);
+            return 1;
+        }
+        sinks.index = index;
+        errors.report = report_error;
+        errors.arg = &sinks;
+    }
+
+    int status = 0;
+    if (reference) {
+        convert_reference(src.file, out, banner, direction, little_endian);
+    } else if (threads == 1) {
+        // BOM ищет сам декодер, BOM UTF-8 игнорируется
+        convert_decoder dec;
+        convert_decoder_init_pair(&dec, from, to, from_le, to_le);
+        dec.on_error = on_error;
+        status = convert_single(&src, out, &dec, &errors, index, stats, banner, io_mode);
+        if (dec.aborted) {
+            status = -1;  // Ошибка, на которой остановились, уже в диагностике
+        }
+        if (stats) {
+            stats->from = dec.from;  // Определённая по входу кодировка
+            stats->from_le = dec.little_endian;
+        }
+        if (index) {
+            convert_index ix;
+            if (convert_index_finish(index, &dec, &ix) != 0 || convert_index_save(&ix, index_file) != 0) {
+                fprintf(stderr, "Error: could not write index file %s\n", index_file);
+                status = -1;
+            }
+            convert_index_free(&ix);
+        }
+    } else {
+        // Многопоточное перекодирование: -j 0 - по числу процессоров.
+        // Прочитанные при поиске BOM байты без маркера и начало потока, прочитанное для
+        // определения кодировки, передаются дальше как данные.
+        unsigned char bom_head[3];
+        const unsigned char *head = bom_head;
+        size_t head_len = 0;
+        const unsigned char *start = src.data;
+        size_t avail = src.size;
+        if (src.head) {
+            head = src.head;
+            head_len = src.head_len;
+            start = head;
+            avail = head_len;
+        } else if (!src.mapped) {
+            head_len = fread(bom_head, 1, direction == CONVERT_UTF16_TO_UTF8 ? 2 : 3, src.file);
+            start = head;
+            avail = head_len;
+        }
+
+        convert_block_fn convert = utf8_to_utf16_block;
+        convert_boundary_fn boundary = utf8_boundary;
+        long offset;
+        if (direction == CONVERT_UTF16_TO_UTF8) {
+            convert = utf16_to_utf8_block;
+            boundary = utf16_boundary;
+            offset = utf16_bom(start, avail, &little_endian);
+            if (banner) {
+                print_bom_banner(banner, offset != 0, little_endian);
+            }
+        } else {
+            offset = utf8_bom(start, avail);
+        }
+        if (!src.mapped) {
+            head += offset;
+            head_len -= (size_t)offset;
+        }
+
+        threads = parallel_threads(threads);
+        if (stats) {
+            stats->threads = threads;
+            stats->from_le = little_endian;
+            stats->io_read = src.mapped ? "mmap" : "stdio";
+            stats->io_write = "stdio";
+        }
+        status = src.mapped
+            ? parallel_convert_buffer(src.data + offset, src.size - offset, out, little_endian, offset,
+                                      threads, convert, boundary, &diag, stats)
+            : parallel_convert_stream(src.file, out, little_endian, head, head_len, offset,
+                                      threads, convert, boundary, &diag, stats);
+    }
+    diag_finish(&diag);
+
+    // Закрытие файлов; дозапись буфера stdio входит в фазу записи
+    input_close(&src);
+    uint64_t mark = stats ? stats_now() : 0;
+    fclose(out);
+    stats_lap(stats, STATS_WRITE, &mark);
+
+    // Статистика выводится после закрытия результата
+    if (stats) {
+        FILE *f = strcmp(stats_file, "-") == 0 ? stderr : fopen(stats_file, "w");
+        if (f) {
+            stats_print(stats, &diag, json, f);
+        }
+        if (!f || (f != stderr && fclose(f) != 0)) {
+            fprintf(stderr, "Error: could not write stats file %s\n", stats_file);
+            status = -1;
+        }
+    }
+    diag_free(&diag);
+    return status ? 1 : 0;
+}
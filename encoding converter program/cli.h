@@ -0,0 +1,10 @@
+#ifndef CLI_H
+#define CLI_H
+
+// Общая часть программ-конвертеров: разбор аргументов, открытие файлов, обработка BOM
+// и перекодирование через libconvert. Кодировки по умолчанию задаются именем программы
+// (argv[0]): utf16_to_utf8 и utf8_to_utf16 работают как прежние отдельные программы,
+// под любым другим именем (transcode) вход определяется автоматически и перекодируется в UTF-8.
+int cli_main(int argc, char *argv[]);
+
+#endif  // CLI_H
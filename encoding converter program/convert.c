@@ -1,5 +1,24 @@
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 #include "convert.h"
 
+// На x86 векторные варианты собираются атрибутами target независимо от флагов компилятора,
+// подходящий выбирается при загрузке по возможностям процессора
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CONVERT_X86 1
+#include <immintrin.h>
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2,popcnt")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,popcnt")))
+#endif
+
+// Шаблон перекодирования, который подставляется в каждый вариант под набор инструкций
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Признак некорректной последовательности при декодировании
+#define INVALID_CODEPOINT ((unsigned int)-1)
+
 // Функция для записи символов UTF-8 в файл (уже была)
 void write_utf8(FILE *out, unsigned int codepoint) {
     if (codepoint <= 0x7F) {
@@ -155,3 +174,3583 @@ unsigned int read_utf16_char(FILE *in, int little_endian) {
 
     return wc; // Возвращаем обычный символ
 }
+
+// Функция для определения BOM UTF-32 в начале буфера
+int utf32_bom(const unsigned char *buf, size_t len, int *little_endian) {
+    if (len < 4) {
+        return 0;
+    }
+    if (buf[0] == 0xFF && buf[1] == 0xFE && buf[2] == 0 && buf[3] == 0) {
+        *little_endian = 1;
+        return 4;
+    }
+    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 0xFE && buf[3] == 0xFF) {
+        *little_endian = 0;
+        return 4;
+    }
+    return 0;
+}
+
+// BOM результата UTF-16 и UTF-32
+size_t convert_write_bom(int encoding, int little_endian, unsigned char *buf) {
+    if (encoding == CONVERT_ENC_UTF16) {
+        buf[0] = little_endian ? 0xFF : 0xFE;
+        buf[1] = little_endian ? 0xFE : 0xFF;
+        return 2;
+    }
+    if (encoding == CONVERT_ENC_UTF32) {
+        static const unsigned char le[4] = {0xFF, 0xFE, 0, 0};
+        static const unsigned char be[4] = {0, 0, 0xFE, 0xFF};
+        memcpy(buf, little_endian ? le : be, 4);
+        return 4;
+    }
+    return 0;
+}
+
+// Функция для определения BOM UTF-16 в начале буфера
+int utf16_bom(const unsigned char *buf, size_t len, int *little_endian) {
+    if (len < 2) {
+        return 0;
+    }
+    if (buf[0] == 0xFF && buf[1] == 0xFE) {
+        *little_endian = 1;
+        return 2;
+    }
+    if (buf[0] == 0xFE && buf[1] == 0xFF) {
+        *little_endian = 0;
+        return 2;
+    }
+    return 0;
+}
+
+// Чтение кодовой единицы UTF-16 из буфера с учётом порядка байтов
+static inline unsigned int load_utf16(const unsigned char *p, int little_endian) {
+    return little_endian ? (unsigned int)(p[0] | (p[1] << 8)) : (unsigned int)((p[0] << 8) | p[1]);
+}
+
+// Чтение 8 байтов как одного машинного слова
+static inline uint64_t load_word(const unsigned char *p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// Маски для проверки по словам задаются байтами в порядке памяти,
+// поэтому не зависят от порядка байтов машины
+static const unsigned char ascii_utf16le_mask[8] = {0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF};
+static const unsigned char ascii_utf16be_mask[8] = {0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80, 0xFF, 0x80};
+static const unsigned char two_utf16le_mask[8] = {0x00, 0xF8, 0x00, 0xF8, 0x00, 0xF8, 0x00, 0xF8};
+static const unsigned char two_utf16be_mask[8] = {0xF8, 0x00, 0xF8, 0x00, 0xF8, 0x00, 0xF8, 0x00};
+
+// Регистрация ошибки во входных данных
+static void push_error(convert_errors *errors, const convert_error *err) {
+    if (errors->count < errors->capacity) {
+        errors->list[errors->count] = *err;
+    }
+    errors->count++;
+    if (errors->report) {
+        errors->report(err, errors->arg);
+    }
+}
+
+static void add_error(convert_errors *errors, int kind, long offset,
+                      const unsigned char *bytes, size_t length, unsigned int value) {
+    convert_error err;
+    err.offset = offset;
+    err.kind = kind;
+    err.value = value;
+    err.length = length < sizeof(err.bytes) ? length : sizeof(err.bytes);
+    memcpy(err.bytes, bytes, err.length);
+    push_error(errors, &err);
+}
+
+// Место под символ замены в кодировке результата (0 без замены) и его запись на месте
+// ошибки: U+FFFD в UTF-8, UTF-16 и UTF-32, '?' в однобайтовой кодовой странице
+static inline size_t replacement_size(const convert_errors *errors, int encoding) {
+    if (!errors->replace) {
+        return 0;
+    }
+    return encoding == CONVERT_ENC_UTF8 ? 3 : encoding == CONVERT_ENC_UTF16 ? 2 : encoding == CONVERT_ENC_UTF32 ? 4 : 1;
+}
+
+static inline size_t put_replacement(const convert_errors *errors, int encoding, int little_endian,
+                                     unsigned char *out) {
+    if (!errors->replace) {
+        return 0;
+    }
+    if (encoding == CONVERT_ENC_UTF8) {
+        out[0] = 0xEF;
+        out[1] = 0xBF;
+        out[2] = 0xBD;
+        return 3;
+    }
+    if (encoding == CONVERT_ENC_UTF16 || encoding == CONVERT_ENC_UTF32) {
+        size_t n = encoding == CONVERT_ENC_UTF16 ? 2 : 4;
+        memset(out, 0, n);
+        out[little_endian ? 0 : n - 1] = 0xFD;
+        out[little_endian ? 1 : n - 2] = 0xFF;
+        return n;
+    }
+    out[0] = '?';
+    return 1;
+}
+
+// Текст диагностики в том виде, в каком её печатают программы (с переводом строки)
+size_t convert_format_error(char *buf, size_t size, const convert_error *err) {
+    int n;
+    switch (err->kind) {
+        case CONVERT_ERR_INVALID_LOW_SURROGATE:
+            n = snprintf(buf, size, "Error: invalid low surrogate at offset %ld, code: 0x%04X\n", err->offset, err->value);
+            break;
+        case CONVERT_ERR_INVALID_HIGH_SURROGATE:
+            n = snprintf(buf, size, "Error: invalid high surrogate at offset %ld, code: 0x%04X\n", err->offset, err->value);
+            break;
+        case CONVERT_ERR_INCOMPLETE_PAIR:
+            n = snprintf(buf, size, "Error: incomplete surrogate pair at offset %ld, code: 0x%04X\n", err->offset,
+                         err->value);
+            break;
+        case CONVERT_ERR_ODD_LENGTH:
+            n = snprintf(buf, size, "Error: odd number of bytes, trailing byte 0x%02X at offset %ld\n", err->value,
+                         err->offset);
+            break;
+        case CONVERT_ERR_UNDEFINED_BYTE:
+            n = snprintf(buf, size, "Error: undefined byte 0x%02X in source encoding. Offset: %ld.\n", err->value,
+                         err->offset);
+            break;
+        case CONVERT_ERR_UNMAPPABLE:
+            n = snprintf(buf, size, "Error: character U+%04X not representable in target encoding. Offset: %ld.\n",
+                         err->value, err->offset);
+            break;
+        case CONVERT_ERR_INVALID_UTF32:
+            n = snprintf(buf, size, "Error: invalid UTF-32 code unit 0x%08X. Offset: %ld.\n", err->value, err->offset);
+            break;
+        case CONVERT_ERR_TRUNCATED_UTF32:
+            n = snprintf(buf, size, "Error: truncated UTF-32 code unit, %u trailing byte%s. Offset: %ld.\n",
+                         err->length, err->length == 1 ? "" : "s", err->offset);
+            break;
+        default:
+            if (err->length == 1) {
+                n = snprintf(buf, size, "Error: invalid UTF-8 byte: 0x%02X. Offset: %ld.\n", err->bytes[0], err->offset);
+                break;
+            }
+            // Байты последовательности (не больше 4) и смещение
+            char seq[4 * 5 + 1] = "";
+            for (size_t k = 0; k < err->length; k++) {
+                snprintf(seq + 5 * k, sizeof(seq) - 5 * k, " 0x%02X", err->bytes[k]);
+            }
+            n = snprintf(buf, size, "Error: invalid UTF-8 sequence:%s. Offset: %ld.\n", seq, err->offset);
+    }
+    return n > 0 ? (size_t)n : 0;
+}
+
+// Вывод диагностики в том виде, в каком её печатают программы
+void convert_print_error(FILE *f, const convert_error *err) {
+    char buf[CONVERT_ERROR_TEXT_MAX];
+    fputs(convert_format_error(buf, sizeof(buf), err) ? buf : "", f);
+}
+
+// Название вида ошибки для машиночитаемого вывода
+const char *convert_error_name(int kind) {
+    switch (kind) {
+        case CONVERT_ERR_INVALID_UTF8: return "invalid_utf8";
+        case CONVERT_ERR_TRUNCATED_UTF8: return "truncated_utf8";
+        case CONVERT_ERR_INVALID_LOW_SURROGATE: return "invalid_low_surrogate";
+        case CONVERT_ERR_INVALID_HIGH_SURROGATE: return "invalid_high_surrogate";
+        case CONVERT_ERR_INCOMPLETE_PAIR: return "incomplete_pair";
+        case CONVERT_ERR_ODD_LENGTH: return "odd_length";
+        case CONVERT_ERR_UNDEFINED_BYTE: return "undefined_byte";
+        case CONVERT_ERR_UNMAPPABLE: return "unmappable";
+        case CONVERT_ERR_INVALID_UTF32: return "invalid_utf32";
+        case CONVERT_ERR_TRUNCATED_UTF32: return "truncated_utf32";
+        default: return "unknown";
+    }
+}
+
+// Обработчик ошибок, печатающий их в поток FILE *file
+void convert_report_to_file(const convert_error *err, void *file) {
+    convert_print_error(file, err);
+}
+
+// Векторное сужение серии ASCII UTF-16: проверяет и перекодирует окно фиксированной
+// ширины, возвращает количество обработанных байтов входа или 0, если в окне не только ASCII
+typedef size_t (*utf16_ascii_fn)(const unsigned char *p, unsigned char *o, int little_endian);
+
+#ifdef CONVERT_X86
+// Окно в 32 байта (16 кодовых единиц)
+TARGET_SSE2 static inline size_t utf16_ascii_sse2(const unsigned char *p, unsigned char *o, int little_endian) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i mask = _mm_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+    __m128i high = _mm_and_si128(_mm_or_si128(a, b), mask);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(high, _mm_setzero_si128())) != 0xFFFF) {
+        return 0;
+    }
+    if (!little_endian) {
+        a = _mm_srli_epi16(a, 8);
+        b = _mm_srli_epi16(b, 8);
+    }
+    _mm_storeu_si128((__m128i *)o, _mm_packus_epi16(a, b));
+    return 32;
+}
+
+// Окно в 64 байта (32 кодовые единицы)
+TARGET_AVX2 static inline size_t utf16_ascii_avx2(const unsigned char *p, unsigned char *o, int little_endian) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i mask = _mm256_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+    if (!_mm256_testz_si256(_mm256_or_si256(a, b), mask)) {
+        return 0;
+    }
+    if (!little_endian) {
+        a = _mm256_srli_epi16(a, 8);
+        b = _mm256_srli_epi16(b, 8);
+    }
+    // Упаковка идёт внутри 128-битных половин, восстанавливаем порядок
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i *)o, packed);
+    return 64;
+}
+
+// Окно в 128 байтов (64 кодовые единицы)
+TARGET_AVX512 static inline size_t utf16_ascii_avx512(const unsigned char *p, unsigned char *o, int little_endian) {
+    __m512i a = _mm512_loadu_si512(p);
+    __m512i b = _mm512_loadu_si512(p + 64);
+    __m512i mask = _mm512_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+    if (_mm512_test_epi16_mask(_mm512_or_si512(a, b), mask)) {
+        return 0;
+    }
+    if (!little_endian) {
+        a = _mm512_srli_epi16(a, 8);
+        b = _mm512_srli_epi16(b, 8);
+    }
+    _mm256_storeu_si256((__m256i *)o, _mm512_cvtepi16_epi8(a));
+    _mm256_storeu_si256((__m256i *)(o + 32), _mm512_cvtepi16_epi8(b));
+    return 128;
+}
+#endif
+
+// Продолжение серии ASCII или символов до U+07FF (кириллица, латиница с диакритикой):
+// проверка по 4 кодовые единицы за раз, суррогаты в такой серии невозможны.
+// Серии ASCII длиннее width байтов сужаются векторно, если есть ascii.
+// Возвращает позицию, где серия кончилась.
+static ALWAYS_INLINE size_t utf16_short_runs(const unsigned char *in, size_t len, size_t i, int little_endian,
+                                             unsigned char **op, unsigned char *end,
+                                             utf16_ascii_fn ascii, size_t width) {
+    uint64_t ascii_mask = load_word(little_endian ? ascii_utf16le_mask : ascii_utf16be_mask);
+    uint64_t two_mask = load_word(little_endian ? two_utf16le_mask : two_utf16be_mask);
+    size_t low_byte = little_endian ? 0 : 1;
+    unsigned char *o = *op;
+
+    while (i + 8 <= len && end - o >= 8) {
+        uint64_t w = load_word(in + i);
+        if ((w & ascii_mask) == 0) {
+            if (ascii && i + width <= len && (size_t)(end - o) >= width / 2) {
+                size_t used = ascii(in + i, o, little_endian);
+                if (used) {
+                    o += used / 2;
+                    i += used;
+                    continue;
+                }
+            }
+            o[0] = in[i + low_byte];
+            o[1] = in[i + 2 + low_byte];
+            o[2] = in[i + 4 + low_byte];
+            o[3] = in[i + 6 + low_byte];
+            o += 4;
+        } else if ((w & two_mask) == 0) {
+            // Без ветвлений: второй байт пишется всегда и для ASCII затирается следующим символом
+            for (size_t k = 0; k < 8; k += 2) {
+                unsigned int wc = load_utf16(in + i + k, little_endian);
+                unsigned int two = wc > 0x7F;
+                o[0] = two ? 0xC0 | (wc >> 6) : wc;
+                o[1] = 0x80 | (wc & 0x3F);
+                o += 1 + two;
+            }
+        } else {
+            break;
+        }
+        i += 8;
+    }
+
+    *op = o;
+    return i;
+}
+
+// Блочное перекодирование UTF-16 -> UTF-8 (шаблон вариантов utf16_to_utf8_block)
+static ALWAYS_INLINE size_t utf16_to_utf8_generic(const unsigned char *in, size_t len, int little_endian,
+                                                  unsigned char *out, size_t out_cap, size_t *out_len,
+                                                  long offset, int final, convert_errors *errors,
+                                                  utf16_ascii_fn ascii, size_t width) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    size_t spare = replacement_size(errors, CONVERT_ENC_UTF8);  // Место под замену ошибки
+    int full = 0;  // Выходной буфер заполнен
+
+    while (i + 1 < len) {
+        unsigned int wc = load_utf16(in + i, little_endian);
+
+        if (wc <= 0x7F) {
+            if (end - o < 1) { full = 1; break; }
+            *o++ = wc;  // 1 байт
+            i = utf16_short_runs(in, len, i + 2, little_endian, &o, end, ascii, width);
+        } else if (wc <= 0x7FF) {
+            if (end - o < 2) { full = 1; break; }
+            *o++ = 0xC0 | (wc >> 6);  // 2 байта
+            *o++ = 0x80 | (wc & 0x3F);
+            i = utf16_short_runs(in, len, i + 2, little_endian, &o, end, ascii, width);
+        } else if (wc < 0xD800 || wc > 0xDFFF) {
+            if (end - o < 3) { full = 1; break; }
+            *o++ = 0xE0 | (wc >> 12);  // 3 байта
+            *o++ = 0x80 | ((wc >> 6) & 0x3F);
+            *o++ = 0x80 | (wc & 0x3F);
+            i += 2;
+        } else if ((size_t)(end - o) < spare) {
+            full = 1;
+            break;
+        } else if (wc <= 0xDBFF) {
+            // Высокая часть суррогатной пары
+            if (i + 3 >= len) {
+                if (!final) {
+                    break;  // Нижняя часть придёт в следующем блоке
+                }
+                add_error(errors, CONVERT_ERR_INCOMPLETE_PAIR, offset + (long)i, in + i, 2, wc);
+                o += put_replacement(errors, CONVERT_ENC_UTF8, 0, o);
+                i += 2;
+                continue;
+            }
+
+            unsigned int low_wc = load_utf16(in + i + 2, little_endian);
+            if (low_wc < 0xDC00 || low_wc > 0xDFFF) {
+                // Пропускаем только высокую часть, следующая единица обрабатывается заново
+                add_error(errors, CONVERT_ERR_INVALID_LOW_SURROGATE, offset + (long)i + 2, in + i + 2, 2, low_wc);
+                o += put_replacement(errors, CONVERT_ENC_UTF8, 0, o);
+                i += 2;
+                continue;
+            }
+
+            if (end - o < 4) { full = 1; break; }
+            unsigned int codepoint = 0x10000 + ((wc - 0xD800) << 10) + (low_wc - 0xDC00);
+            *o++ = 0xF0 | (codepoint >> 18);  // 4 байта
+            *o++ = 0x80 | ((codepoint >> 12) & 0x3F);
+            *o++ = 0x80 | ((codepoint >> 6) & 0x3F);
+            *o++ = 0x80 | (codepoint & 0x3F);
+            i += 4;
+        } else {
+            // Нижняя часть суррогатной пары без высокой
+            add_error(errors, CONVERT_ERR_INVALID_HIGH_SURROGATE, offset + (long)i, in + i, 2, wc);
+            o += put_replacement(errors, CONVERT_ENC_UTF8, 0, o);
+            i += 2;
+        }
+    }
+
+    if (final && !full && i + 1 == len && (size_t)(end - o) >= spare) {
+        // Нечётное количество байтов во входном файле
+        add_error(errors, CONVERT_ERR_ODD_LENGTH, offset + (long)i, in + i, 1, in[i]);
+        o += put_replacement(errors, CONVERT_ENC_UTF8, 0, o);
+        i = len;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// Определение BOM UTF-8 в начале буфера: возвращает длину маркера или 0
+int utf8_bom(const unsigned char *buf, size_t len) {
+    if (len >= 3 && buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF) {
+        return 3;
+    }
+    return 0;
+}
+
+// Запись кодовой точки в буфер в UTF-16, возвращает количество записанных байтов
+static inline size_t put_utf16(unsigned char *p, unsigned int codepoint, int little_endian) {
+    if (codepoint <= 0xFFFF) {
+        p[little_endian ? 0 : 1] = codepoint & 0xFF;
+        p[little_endian ? 1 : 0] = codepoint >> 8;
+        return 2;
+    }
+
+    // Суррогатная пара для кодовых точек выше U+FFFF
+    unsigned int high_surrogate = 0xD800 + ((codepoint - 0x10000) >> 10);
+    unsigned int low_surrogate = 0xDC00 + (codepoint & 0x3FF);
+    p[little_endian ? 0 : 1] = high_surrogate & 0xFF;
+    p[little_endian ? 1 : 0] = high_surrogate >> 8;
+    p[little_endian ? 2 : 3] = low_surrogate & 0xFF;
+    p[little_endian ? 3 : 2] = low_surrogate >> 8;
+    return 4;
+}
+
+// Декодирование одного символа UTF-8 с полной проверкой (медленный путь).
+// Возвращает длину обработанного участка; 0 - последовательность обрывается на конце буфера.
+// Для некорректной последовательности *codepoint = INVALID_CODEPOINT, а длина равна
+// её максимальному корректному префиксу (не меньше 1 байта).
+static size_t decode_utf8(const unsigned char *p, size_t avail, unsigned int *codepoint) {
+    unsigned int c = p[0];
+    unsigned int lo = 0x80, hi = 0xBF;  // Допустимый диапазон второго байта
+    size_t need;
+
+    if (c <= 0x7F) {
+        *codepoint = c;
+        return 1;
+    } else if (c >= 0xC2 && c <= 0xDF) {
+        need = 2;
+        c &= 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        need = 3;
+        if (c == 0xE0) lo = 0xA0;  // Избыточная запись
+        if (c == 0xED) hi = 0x9F;  // Суррогаты U+D800..U+DFFF
+        c &= 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        need = 4;
+        if (c == 0xF0) lo = 0x90;  // Избыточная запись
+        if (c == 0xF4) hi = 0x8F;  // Больше U+10FFFF
+        c &= 0x07;
+    } else {
+        // Байт продолжения без начала, 0xC0, 0xC1 или 0xF5..0xFF
+        *codepoint = INVALID_CODEPOINT;
+        return 1;
+    }
+
+    for (size_t k = 1; k < need; k++) {
+        if (k >= avail) {
+            return 0;
+        }
+        if (p[k] < lo || p[k] > hi) {
+            *codepoint = INVALID_CODEPOINT;
+            return k;
+        }
+        lo = 0x80;
+        hi = 0xBF;
+        c = (c << 6) | (p[k] & 0x3F);
+    }
+
+    *codepoint = c;
+    return need;
+}
+
+// Декодирование окна, уже проверенного векторно. Символ, выходящий за границу окна,
+// не декодируется: возвращается количество байтов до его начала.
+static inline size_t decode_checked_window(const unsigned char *p, size_t width,
+                                           unsigned char **op, int little_endian) {
+    unsigned char *o = *op;
+    size_t i = 0;
+
+    while (i < width) {
+        unsigned int c = p[i];
+        if (c <= 0x7F) {
+            o += put_utf16(o, c, little_endian);
+            i += 1;
+        } else if (c <= 0xDF) {
+            if (i + 2 > width) break;
+            o += put_utf16(o, ((c & 0x1F) << 6) | (p[i + 1] & 0x3F), little_endian);
+            i += 2;
+        } else if (c <= 0xEF) {
+            if (i + 3 > width) break;
+            o += put_utf16(o, ((c & 0x0F) << 12) | ((p[i + 1] & 0x3F) << 6) | (p[i + 2] & 0x3F),
+                           little_endian);
+            i += 3;
+        } else {
+            if (i + 4 > width) break;
+            o += put_utf16(o, ((c & 0x07) << 18) | ((p[i + 1] & 0x3F) << 12) |
+                              ((p[i + 2] & 0x3F) << 6) | (p[i + 3] & 0x3F),
+                           little_endian);
+            i += 4;
+        }
+    }
+
+    *op = o;
+    return i;
+}
+
+// Векторное окно UTF-8: проверяет и перекодирует окно фиксированной ширины, начинающееся
+// с границы символа. Возвращает количество обработанных байтов или 0, если в окне есть
+// ошибка и его нужно разобрать медленным путём.
+typedef size_t (*utf8_window_fn)(const unsigned char *p, unsigned char **op, int little_endian);
+
+#ifdef CONVERT_X86
+// Беззнаковое сравнение байтов x >= c
+TARGET_SSE2 static inline __m128i ge_u8_sse2(__m128i x, unsigned char c) {
+    return _mm_cmpeq_epi8(_mm_max_epu8(x, _mm_set1_epi8((char)c)), x);
+}
+
+// Нарушения UTF-8 в 16 байтах b = p[0..15] по байтам p[-3]..p[15]: байты продолжения не там,
+// где их требуют начальные байты, запрещённые байты, избыточные записи, суррогаты и значения
+// больше U+10FFFF. Если окно начинается с границы символа (at_boundary), требования байтов
+// до окна не учитываются: там могла остаться уже найденная ошибка. Иначе байты до окна
+// должны быть проверены как корректные. В *cont_out - маска байтов продолжения.
+TARGET_SSE2 static inline unsigned int utf8_violations_sse2(__m128i b, const unsigned char *p, int at_boundary,
+                                                            unsigned int *cont_out) {
+    unsigned int keep1 = at_boundary ? ~1u : ~0u;
+    unsigned int keep2 = at_boundary ? ~3u : ~0u;
+    unsigned int keep3 = at_boundary ? ~7u : ~0u;
+    __m128i p1 = _mm_loadu_si128((const __m128i *)(p - 1));
+    __m128i p2 = _mm_loadu_si128((const __m128i *)(p - 2));
+    __m128i p3 = _mm_loadu_si128((const __m128i *)(p - 3));
+
+    // Байты продолжения 0x80..0xBF - ровно те, что меньше -64 как знаковые
+    unsigned int cont = _mm_movemask_epi8(_mm_cmplt_epi8(b, _mm_set1_epi8((char)0xC0)));
+
+    // Где продолжение обязано быть по начальным байтам
+    unsigned int required = (_mm_movemask_epi8(ge_u8_sse2(p1, 0xC0)) & keep1) |
+                            (_mm_movemask_epi8(ge_u8_sse2(p2, 0xE0)) & keep2) |
+                            (_mm_movemask_epi8(ge_u8_sse2(p3, 0xF0)) & keep3);
+
+    // Запрещённые байты: 0xC0, 0xC1, 0xF5..0xFF
+    __m128i bad = _mm_or_si128(ge_u8_sse2(b, 0xF5),
+                               _mm_cmpeq_epi8(_mm_and_si128(b, _mm_set1_epi8((char)0xFE)),
+                                              _mm_set1_epi8((char)0xC0)));
+
+    // Избыточные записи, суррогаты и значения больше U+10FFFF по второму байту
+    __m128i ge_a0 = ge_u8_sse2(b, 0xA0);
+    __m128i ge_90 = ge_u8_sse2(b, 0x90);
+    __m128i range = _mm_or_si128(
+        _mm_or_si128(_mm_andnot_si128(ge_a0, _mm_cmpeq_epi8(p1, _mm_set1_epi8((char)0xE0))),
+                     _mm_and_si128(ge_a0, _mm_cmpeq_epi8(p1, _mm_set1_epi8((char)0xED)))),
+        _mm_or_si128(_mm_andnot_si128(ge_90, _mm_cmpeq_epi8(p1, _mm_set1_epi8((char)0xF0))),
+                     _mm_and_si128(ge_90, _mm_cmpeq_epi8(p1, _mm_set1_epi8((char)0xF4)))));
+
+    *cont_out = cont;
+    return (cont ^ required) | _mm_movemask_epi8(bad) | (_mm_movemask_epi8(range) & keep1);
+}
+
+// Окно в 16 байтов. Читает байты p[-3]..p[16].
+TARGET_SSE2 static inline size_t utf8_window_sse2(const unsigned char *p, unsigned char **op, int little_endian) {
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    __m128i zero = _mm_setzero_si128();
+
+    if (_mm_movemask_epi8(b) == 0) {
+        // Только ASCII: расширяем байты до 16-битных кодовых единиц
+        __m128i lo = little_endian ? _mm_unpacklo_epi8(b, zero) : _mm_unpacklo_epi8(zero, b);
+        __m128i hi = little_endian ? _mm_unpackhi_epi8(b, zero) : _mm_unpackhi_epi8(zero, b);
+        _mm_storeu_si128((__m128i *)*op, lo);
+        _mm_storeu_si128((__m128i *)(*op + 16), hi);
+        *op += 32;
+        return 16;
+    }
+
+    unsigned int cont;
+    if (utf8_violations_sse2(b, p, 1, &cont)) {
+        return 0;
+    }
+
+    if (_mm_movemask_epi8(ge_u8_sse2(b, 0xE0)) != 0) {
+        return decode_checked_window(p, 16, op, little_endian);
+    }
+
+    // Только одно- и двухбайтовые символы: значения считаются для всех позиций сразу,
+    // затем сохраняются позиции, не являющиеся байтами продолжения
+    __m128i n = _mm_loadu_si128((const __m128i *)(p + 1));
+    __m128i lead = ge_u8_sse2(b, 0xC0);
+    __m128i mask5 = _mm_set1_epi16(0x1F);
+    __m128i mask6 = _mm_set1_epi16(0x3F);
+
+    __m128i b_lo = _mm_unpacklo_epi8(b, zero), b_hi = _mm_unpackhi_epi8(b, zero);
+    __m128i n_lo = _mm_unpacklo_epi8(n, zero), n_hi = _mm_unpackhi_epi8(n, zero);
+    __m128i l_lo = _mm_unpacklo_epi8(lead, lead), l_hi = _mm_unpackhi_epi8(lead, lead);
+
+    __m128i two_lo = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b_lo, mask5), 6), _mm_and_si128(n_lo, mask6));
+    __m128i two_hi = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b_hi, mask5), 6), _mm_and_si128(n_hi, mask6));
+    __m128i v_lo = _mm_or_si128(_mm_and_si128(l_lo, two_lo), _mm_andnot_si128(l_lo, b_lo));
+    __m128i v_hi = _mm_or_si128(_mm_and_si128(l_hi, two_hi), _mm_andnot_si128(l_hi, b_hi));
+    if (!little_endian) {
+        v_lo = _mm_or_si128(_mm_slli_epi16(v_lo, 8), _mm_srli_epi16(v_lo, 8));
+        v_hi = _mm_or_si128(_mm_slli_epi16(v_hi, 8), _mm_srli_epi16(v_hi, 8));
+    }
+
+    unsigned short units[16];
+    _mm_storeu_si128((__m128i *)units, v_lo);
+    _mm_storeu_si128((__m128i *)(units + 8), v_hi);
+
+    unsigned int keep = ~cont & 0xFFFFu;
+    size_t used = 16;
+    if (p[15] >= 0xC0) {
+        keep &= 0x7FFFu;  // Продолжение последнего символа - в следующем окне
+        used = 15;
+    }
+
+    unsigned char *o = *op;
+    while (keep) {
+        memcpy(o, &units[__builtin_ctz(keep)], 2);
+        o += 2;
+        keep &= keep - 1;
+    }
+    *op = o;
+    return used;
+}
+
+// Беззнаковое сравнение байтов x >= c
+TARGET_AVX2 static inline __m256i ge_u8_avx2(__m256i x, unsigned char c) {
+    return _mm256_cmpeq_epi8(_mm256_max_epu8(x, _mm256_set1_epi8((char)c)), x);
+}
+
+// Перестановка байтов в 16-битных значениях (для BE)
+TARGET_AVX2 static inline __m256i swap16_avx2(__m256i v) {
+    return _mm256_or_si256(_mm256_slli_epi16(v, 8), _mm256_srli_epi16(v, 8));
+}
+
+// То же, что utf8_violations_sse2, для 32 байтов
+TARGET_AVX2 static inline unsigned int utf8_violations_avx2(__m256i b, const unsigned char *p, int at_boundary,
+                                                            unsigned int *cont_out) {
+    unsigned int keep1 = at_boundary ? ~1u : ~0u;
+    unsigned int keep2 = at_boundary ? ~3u : ~0u;
+    unsigned int keep3 = at_boundary ? ~7u : ~0u;
+    __m256i p1 = _mm256_loadu_si256((const __m256i *)(p - 1));
+    __m256i p2 = _mm256_loadu_si256((const __m256i *)(p - 2));
+    __m256i p3 = _mm256_loadu_si256((const __m256i *)(p - 3));
+
+    unsigned int cont = _mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_set1_epi8((char)0xC0), b));
+    unsigned int required = ((unsigned int)_mm256_movemask_epi8(ge_u8_avx2(p1, 0xC0)) & keep1) |
+                            ((unsigned int)_mm256_movemask_epi8(ge_u8_avx2(p2, 0xE0)) & keep2) |
+                            ((unsigned int)_mm256_movemask_epi8(ge_u8_avx2(p3, 0xF0)) & keep3);
+
+    __m256i bad = _mm256_or_si256(ge_u8_avx2(b, 0xF5),
+                                  _mm256_cmpeq_epi8(_mm256_and_si256(b, _mm256_set1_epi8((char)0xFE)),
+                                                    _mm256_set1_epi8((char)0xC0)));
+
+    __m256i ge_a0 = ge_u8_avx2(b, 0xA0);
+    __m256i ge_90 = ge_u8_avx2(b, 0x90);
+    __m256i range = _mm256_or_si256(
+        _mm256_or_si256(_mm256_andnot_si256(ge_a0, _mm256_cmpeq_epi8(p1, _mm256_set1_epi8((char)0xE0))),
+                        _mm256_and_si256(ge_a0, _mm256_cmpeq_epi8(p1, _mm256_set1_epi8((char)0xED)))),
+        _mm256_or_si256(_mm256_andnot_si256(ge_90, _mm256_cmpeq_epi8(p1, _mm256_set1_epi8((char)0xF0))),
+                        _mm256_and_si256(ge_90, _mm256_cmpeq_epi8(p1, _mm256_set1_epi8((char)0xF4)))));
+
+    *cont_out = cont;
+    return (cont ^ required) | (unsigned int)_mm256_movemask_epi8(bad) |
+           ((unsigned int)_mm256_movemask_epi8(range) & keep1);
+}
+
+// То же, что utf8_window_sse2, для окна в 32 байта. Читает байты p[-3]..p[32].
+TARGET_AVX2 static inline size_t utf8_window_avx2(const unsigned char *p, unsigned char **op, int little_endian) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+
+    if (_mm256_movemask_epi8(b) == 0) {
+        // Только ASCII: расширяем байты до 16-битных кодовых единиц
+        __m256i lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b));
+        __m256i hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1));
+        if (!little_endian) {
+            lo = swap16_avx2(lo);
+            hi = swap16_avx2(hi);
+        }
+        _mm256_storeu_si256((__m256i *)*op, lo);
+        _mm256_storeu_si256((__m256i *)(*op + 32), hi);
+        *op += 64;
+        return 32;
+    }
+
+    unsigned int cont;
+    if (utf8_violations_avx2(b, p, 1, &cont)) {
+        return 0;
+    }
+
+    if (_mm256_movemask_epi8(ge_u8_avx2(b, 0xE0)) != 0) {
+        return decode_checked_window(p, 32, op, little_endian);
+    }
+
+    __m256i n = _mm256_loadu_si256((const __m256i *)(p + 1));
+    __m256i lead = ge_u8_avx2(b, 0xC0);
+    __m256i mask5 = _mm256_set1_epi16(0x1F);
+    __m256i mask6 = _mm256_set1_epi16(0x3F);
+
+    __m256i b_lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b));
+    __m256i b_hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1));
+    __m256i n_lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(n));
+    __m256i n_hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(n, 1));
+    __m256i l_lo = _mm256_cvtepi8_epi16(_mm256_castsi256_si128(lead));
+    __m256i l_hi = _mm256_cvtepi8_epi16(_mm256_extracti128_si256(lead, 1));
+
+    __m256i two_lo = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(b_lo, mask5), 6),
+                                     _mm256_and_si256(n_lo, mask6));
+    __m256i two_hi = _mm256_or_si256(_mm256_slli_epi16(_mm256_and_si256(b_hi, mask5), 6),
+                                     _mm256_and_si256(n_hi, mask6));
+    __m256i v_lo = _mm256_blendv_epi8(b_lo, two_lo, l_lo);
+    __m256i v_hi = _mm256_blendv_epi8(b_hi, two_hi, l_hi);
+    if (!little_endian) {
+        v_lo = swap16_avx2(v_lo);
+        v_hi = swap16_avx2(v_hi);
+    }
+
+    unsigned short units[32];
+    _mm256_storeu_si256((__m256i *)units, v_lo);
+    _mm256_storeu_si256((__m256i *)(units + 16), v_hi);
+
+    unsigned int keep = ~cont;
+    size_t used = 32;
+    if (p[31] >= 0xC0) {
+        keep &= 0x7FFFFFFFu;
+        used = 31;
+    }
+
+    unsigned char *o = *op;
+    while (keep) {
+        memcpy(o, &units[__builtin_ctz(keep)], 2);
+        o += 2;
+        keep &= keep - 1;
+    }
+    *op = o;
+    return used;
+}
+
+// Перестановка байтов в 16-битных значениях (для BE)
+TARGET_AVX512 static inline __m512i swap16_avx512(__m512i v) {
+    return _mm512_or_si512(_mm512_slli_epi16(v, 8), _mm512_srli_epi16(v, 8));
+}
+
+// То же, что utf8_violations_sse2, для 64 байтов на масках AVX-512
+TARGET_AVX512 static inline __mmask64 utf8_violations_avx512(__m512i b, const unsigned char *p, int at_boundary,
+                                                             __mmask64 *cont_out) {
+    __mmask64 keep1 = at_boundary ? ~1ull : ~0ull;
+    __mmask64 keep2 = at_boundary ? ~3ull : ~0ull;
+    __mmask64 keep3 = at_boundary ? ~7ull : ~0ull;
+    __m512i p1 = _mm512_loadu_si512(p - 1);
+    __m512i p2 = _mm512_loadu_si512(p - 2);
+    __m512i p3 = _mm512_loadu_si512(p - 3);
+
+    __mmask64 cont = _mm512_movepi8_mask(b) & ~_mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xC0));
+    __mmask64 required = (_mm512_cmpge_epu8_mask(p1, _mm512_set1_epi8((char)0xC0)) & keep1) |
+                         (_mm512_cmpge_epu8_mask(p2, _mm512_set1_epi8((char)0xE0)) & keep2) |
+                         (_mm512_cmpge_epu8_mask(p3, _mm512_set1_epi8((char)0xF0)) & keep3);
+
+    __mmask64 bad = _mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xF5)) |
+                    _mm512_cmpeq_epi8_mask(_mm512_and_si512(b, _mm512_set1_epi8((char)0xFE)),
+                                           _mm512_set1_epi8((char)0xC0));
+
+    __mmask64 ge_a0 = _mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xA0));
+    __mmask64 ge_90 = _mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0x90));
+    __mmask64 range = (~ge_a0 & _mm512_cmpeq_epi8_mask(p1, _mm512_set1_epi8((char)0xE0))) |
+                      (ge_a0 & _mm512_cmpeq_epi8_mask(p1, _mm512_set1_epi8((char)0xED))) |
+                      (~ge_90 & _mm512_cmpeq_epi8_mask(p1, _mm512_set1_epi8((char)0xF0))) |
+                      (ge_90 & _mm512_cmpeq_epi8_mask(p1, _mm512_set1_epi8((char)0xF4)));
+
+    *cont_out = cont;
+    return (cont ^ required) | bad | (range & keep1);
+}
+
+// То же, что utf8_window_sse2, для окна в 64 байта на масках AVX-512. Читает байты p[-3]..p[64].
+TARGET_AVX512 static inline size_t utf8_window_avx512(const unsigned char *p, unsigned char **op,
+                                                       int little_endian) {
+    __m512i b = _mm512_loadu_si512(p);
+    __mmask64 high = _mm512_movepi8_mask(b);
+
+    if (high == 0) {
+        // Только ASCII: расширяем байты до 16-битных кодовых единиц
+        __m512i lo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(b));
+        __m512i hi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b, 1));
+        if (!little_endian) {
+            lo = swap16_avx512(lo);
+            hi = swap16_avx512(hi);
+        }
+        _mm512_storeu_si512(*op, lo);
+        _mm512_storeu_si512(*op + 64, hi);
+        *op += 128;
+        return 64;
+    }
+
+    __mmask64 lead = _mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xC0));
+    __mmask64 cont;
+    if (utf8_violations_avx512(b, p, 1, &cont)) {
+        return 0;
+    }
+
+    if (_mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xE0)) != 0) {
+        return decode_checked_window(p, 64, op, little_endian);
+    }
+
+    __m512i n = _mm512_loadu_si512(p + 1);
+    __m512i mask5 = _mm512_set1_epi16(0x1F);
+    __m512i mask6 = _mm512_set1_epi16(0x3F);
+
+    __m512i b_lo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(b));
+    __m512i b_hi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b, 1));
+    __m512i n_lo = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(n));
+    __m512i n_hi = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(n, 1));
+
+    __m512i two_lo = _mm512_or_si512(_mm512_slli_epi16(_mm512_and_si512(b_lo, mask5), 6),
+                                     _mm512_and_si512(n_lo, mask6));
+    __m512i two_hi = _mm512_or_si512(_mm512_slli_epi16(_mm512_and_si512(b_hi, mask5), 6),
+                                     _mm512_and_si512(n_hi, mask6));
+    __m512i v_lo = _mm512_mask_blend_epi16((__mmask32)lead, b_lo, two_lo);
+    __m512i v_hi = _mm512_mask_blend_epi16((__mmask32)(lead >> 32), b_hi, two_hi);
+    if (!little_endian) {
+        v_lo = swap16_avx512(v_lo);
+        v_hi = swap16_avx512(v_hi);
+    }
+
+    unsigned short units[64];
+    _mm512_storeu_si512(units, v_lo);
+    _mm512_storeu_si512(units + 32, v_hi);
+
+    unsigned long long keep = ~cont;
+    size_t used = 64;
+    if (p[63] >= 0xC0) {
+        keep &= ~(1ull << 63);
+        used = 63;
+    }
+
+    unsigned char *o = *op;
+    while (keep) {
+        memcpy(o, &units[__builtin_ctzll(keep)], 2);
+        o += 2;
+        keep &= keep - 1;
+    }
+    *op = o;
+    return used;
+}
+#endif
+
+static const unsigned char two_utf8_mask[8] = {0xE0, 0xC0, 0xE0, 0xC0, 0xE0, 0xC0, 0xE0, 0xC0};
+static const unsigned char two_utf8_bits[8] = {0xC0, 0x80, 0xC0, 0x80, 0xC0, 0x80, 0xC0, 0x80};
+static const unsigned char two_utf8_lead[8] = {0x1E, 0x00, 0x1E, 0x00, 0x1E, 0x00, 0x1E, 0x00};
+static const unsigned char two_utf8_add[8] = {0x7F, 0x00, 0x7F, 0x00, 0x7F, 0x00, 0x7F, 0x00};
+static const unsigned char two_utf8_high[8] = {0x80, 0x00, 0x80, 0x00, 0x80, 0x00, 0x80, 0x00};
+
+#define ASCII_UTF8_MASK 0x8080808080808080ULL
+
+// Продолжение серии ASCII или двухбайтовых символов UTF-8 по 8 байтов за раз.
+// Двухбайтовые символы принимаются только выровненными парами байтов: начальный
+// 0xC2..0xDF, за ним байт продолжения. Возвращает позицию, где серия кончилась.
+static inline size_t utf8_short_runs(const unsigned char *in, size_t len, size_t i, int little_endian,
+                                     unsigned char **op, unsigned char *end) {
+    uint64_t two_mask = load_word(two_utf8_mask);
+    uint64_t two_bits = load_word(two_utf8_bits);
+    uint64_t two_lead = load_word(two_utf8_lead);
+    uint64_t two_add = load_word(two_utf8_add);
+    uint64_t two_high = load_word(two_utf8_high);
+    unsigned char *o = *op;
+
+    while (i + 8 <= len && end - o >= 16) {
+        uint64_t w = load_word(in + i);
+        if ((w & ASCII_UTF8_MASK) == 0) {
+            for (size_t k = 0; k < 8; k++) {
+                o += put_utf16(o, in[i + k], little_endian);
+            }
+        } else if ((w & two_mask) == two_bits && (((w & two_lead) + two_add) & two_high) == two_high) {
+            // Бит 0x80 суммы в позиции начального байта есть, только если байт не 0xC0 и не 0xC1
+            for (size_t k = 0; k < 8; k += 2) {
+                o += put_utf16(o, ((in[i + k] & 0x1F) << 6) | (in[i + k + 1] & 0x3F), little_endian);
+            }
+        } else {
+            break;
+        }
+        i += 8;
+    }
+
+    *op = o;
+    return i;
+}
+
+// Блочное перекодирование UTF-8 -> UTF-16 (шаблон вариантов utf8_to_utf16_block).
+// Без векторного окна (window == NULL) серии ASCII и двухбайтовых символов проверяются по словам.
+static ALWAYS_INLINE size_t utf8_to_utf16_generic(const unsigned char *in, size_t len, int little_endian,
+                                                  unsigned char *out, size_t out_cap, size_t *out_len,
+                                                  long offset, int final, convert_errors *errors,
+                                                  utf8_window_fn window, size_t width) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    size_t slow_until = 3;  // Векторному окну нужны три предыдущих байта
+    size_t spare = replacement_size(errors, CONVERT_ENC_UTF16);  // Место под замену ошибки
+
+    while (i < len) {
+        if (window && i >= slow_until && i + width < len && (size_t)(end - o) >= 2 * width) {
+            size_t used = window(in + i, &o, little_endian);
+            if (used) {
+                i += used;
+                continue;
+            }
+            // Окно с ошибкой разбирается медленным путём для точной диагностики
+            slow_until = i + width;
+        }
+        unsigned int codepoint;
+        size_t n = decode_utf8(in + i, len - i, &codepoint);
+        if (n == 0) {
+            if (!final || (size_t)(end - o) < spare) {
+                break;  // Окончание символа придёт в следующем блоке или нет места для замены
+            }
+            add_error(errors, CONVERT_ERR_TRUNCATED_UTF8, offset + (long)i, in + i, len - i, in[i]);
+            o += put_replacement(errors, CONVERT_ENC_UTF16, little_endian, o);
+            i = len;
+            break;
+        }
+
+        if (codepoint == INVALID_CODEPOINT) {
+            if ((size_t)(end - o) < spare) {
+                break;  // Выходной буфер заполнен
+            }
+            add_error(errors, CONVERT_ERR_INVALID_UTF8, offset + (long)i, in + i, n, in[i]);
+            o += put_replacement(errors, CONVERT_ENC_UTF16, little_endian, o);
+        } else {
+            if (end - o < (codepoint > 0xFFFF ? 4 : 2)) {
+                break;  // Выходной буфер заполнен
+            }
+            o += put_utf16(o, codepoint, little_endian);
+            if (!window && codepoint <= 0x7FF) {
+                i = utf8_short_runs(in, len, i + n, little_endian, &o, end);
+                continue;
+            }
+        }
+        i += n;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// Проверка окна UTF-8 без перекодирования: 1 - нарушений нет. Читает байты p[-3]..p[width-1].
+// Окна идут подряд без выравнивания на символы, at_boundary - см. utf8_violations_sse2.
+// Если counts != NULL, к нему добавляются символы и кодовые единицы UTF-16 корректного окна:
+// символ - каждый байт, кроме продолжений, и вторая единица - каждый байт 0xF0..0xF4.
+typedef int (*utf8_valid_fn)(const unsigned char *p, int at_boundary, convert_counts *counts);
+
+// Маски высоких и низких частей суррогатных пар в окне UTF-16 (бит на кодовую единицу).
+// Если short_units != NULL, в него записывается число единиц не больше U+007F плюс
+// число единиц не больше U+07FF: на столько длина в UTF-8 меньше трёх байтов на единицу.
+typedef void (*utf16_surrogates_fn)(const unsigned char *p, int little_endian, uint64_t *high, uint64_t *low,
+                                    size_t *short_units);
+
+#ifdef CONVERT_X86
+// Окно в 16 байтов. Окно и три байта перед ним только из ASCII проверять не нужно.
+TARGET_SSE2 static inline int utf8_valid_sse2(const unsigned char *p, int at_boundary, convert_counts *counts) {
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    if (_mm_movemask_epi8(_mm_or_si128(b, _mm_loadu_si128((const __m128i *)(p - 3)))) == 0) {
+        if (counts) {
+            counts->codepoints += 16;
+            counts->units += 16;
+        }
+        return 1;
+    }
+    unsigned int cont;
+    if (utf8_violations_sse2(b, p, at_boundary, &cont) != 0) {
+        return 0;
+    }
+    if (counts) {
+        size_t chars = 16 - __builtin_popcount(cont);
+        counts->codepoints += chars;
+        counts->units += chars + __builtin_popcount(_mm_movemask_epi8(ge_u8_sse2(b, 0xF0)));
+    }
+    return 1;
+}
+
+TARGET_AVX2 static inline int utf8_valid_avx2(const unsigned char *p, int at_boundary, convert_counts *counts) {
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+    if (_mm256_movemask_epi8(_mm256_or_si256(b, _mm256_loadu_si256((const __m256i *)(p - 3)))) == 0) {
+        if (counts) {
+            counts->codepoints += 32;
+            counts->units += 32;
+        }
+        return 1;
+    }
+    unsigned int cont;
+    if (utf8_violations_avx2(b, p, at_boundary, &cont) != 0) {
+        return 0;
+    }
+    if (counts) {
+        size_t chars = 32 - __builtin_popcount(cont);
+        counts->codepoints += chars;
+        counts->units += chars + __builtin_popcount(_mm256_movemask_epi8(ge_u8_avx2(b, 0xF0)));
+    }
+    return 1;
+}
+
+TARGET_AVX512 static inline int utf8_valid_avx512(const unsigned char *p, int at_boundary, convert_counts *counts) {
+    __m512i b = _mm512_loadu_si512(p);
+    if (_mm512_movepi8_mask(_mm512_or_si512(b, _mm512_loadu_si512(p - 3))) == 0) {
+        if (counts) {
+            counts->codepoints += 64;
+            counts->units += 64;
+        }
+        return 1;
+    }
+    __mmask64 cont;
+    if (utf8_violations_avx512(b, p, at_boundary, &cont) != 0) {
+        return 0;
+    }
+    if (counts) {
+        size_t chars = 64 - __builtin_popcountll(cont);
+        counts->codepoints += chars;
+        counts->units += chars + __builtin_popcountll(_mm512_cmpge_epu8_mask(b, _mm512_set1_epi8((char)0xF0)));
+    }
+    return 1;
+}
+
+// Окно в 32 байта (16 кодовых единиц). Старший байт кодовой единицы сравнивается
+// с 0xD8 и 0xDC по маске 0xFC; при BE он идёт в памяти первым.
+TARGET_SSE2 static inline void utf16_surrogates_sse2(const unsigned char *p, int little_endian,
+                                                     uint64_t *high, uint64_t *low, size_t *short_units) {
+    __m128i mask = _mm_set1_epi16(little_endian ? (short)0xFC00 : 0x00FC);
+    __m128i high_bits = _mm_set1_epi16(little_endian ? (short)0xD800 : 0x00D8);
+    __m128i low_bits = _mm_set1_epi16(little_endian ? (short)0xDC00 : 0x00DC);
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    __m128i y = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i a = _mm_and_si128(x, mask);
+    __m128i b = _mm_and_si128(y, mask);
+    *high = (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(a, high_bits),
+                                                            _mm_cmpeq_epi16(b, high_bits)));
+    *low = (unsigned int)_mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(a, low_bits),
+                                                           _mm_cmpeq_epi16(b, low_bits)));
+    if (short_units) {
+        __m128i zero = _mm_setzero_si128();
+        __m128i ascii = _mm_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+        __m128i two = _mm_set1_epi16(little_endian ? (short)0xF800 : 0x00F8);
+        unsigned int ascii_bits = _mm_movemask_epi8(_mm_packs_epi16(
+            _mm_cmpeq_epi16(_mm_and_si128(x, ascii), zero), _mm_cmpeq_epi16(_mm_and_si128(y, ascii), zero)));
+        unsigned int two_bits = _mm_movemask_epi8(_mm_packs_epi16(
+            _mm_cmpeq_epi16(_mm_and_si128(x, two), zero), _mm_cmpeq_epi16(_mm_and_si128(y, two), zero)));
+        *short_units = __builtin_popcount(ascii_bits) + __builtin_popcount(two_bits);
+    }
+}
+
+// Окно в 64 байта (32 кодовые единицы)
+TARGET_AVX2 static inline void utf16_surrogates_avx2(const unsigned char *p, int little_endian,
+                                                     uint64_t *high, uint64_t *low, size_t *short_units) {
+    __m256i mask = _mm256_set1_epi16(little_endian ? (short)0xFC00 : 0x00FC);
+    __m256i high_bits = _mm256_set1_epi16(little_endian ? (short)0xD800 : 0x00D8);
+    __m256i low_bits = _mm256_set1_epi16(little_endian ? (short)0xDC00 : 0x00DC);
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    __m256i y = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i a = _mm256_and_si256(x, mask);
+    __m256i b = _mm256_and_si256(y, mask);
+    // Упаковка идёт внутри 128-битных половин, восстанавливаем порядок
+    __m256i h = _mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpeq_epi16(a, high_bits),
+                                                            _mm256_cmpeq_epi16(b, high_bits)), 0xD8);
+    __m256i l = _mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpeq_epi16(a, low_bits),
+                                                            _mm256_cmpeq_epi16(b, low_bits)), 0xD8);
+    *high = (unsigned int)_mm256_movemask_epi8(h);
+    *low = (unsigned int)_mm256_movemask_epi8(l);
+    if (short_units) {
+        // Для подсчёта порядок единиц не важен
+        __m256i zero = _mm256_setzero_si256();
+        __m256i ascii = _mm256_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+        __m256i two = _mm256_set1_epi16(little_endian ? (short)0xF800 : 0x00F8);
+        unsigned int ascii_bits = _mm256_movemask_epi8(_mm256_packs_epi16(
+            _mm256_cmpeq_epi16(_mm256_and_si256(x, ascii), zero), _mm256_cmpeq_epi16(_mm256_and_si256(y, ascii), zero)));
+        unsigned int two_bits = _mm256_movemask_epi8(_mm256_packs_epi16(
+            _mm256_cmpeq_epi16(_mm256_and_si256(x, two), zero), _mm256_cmpeq_epi16(_mm256_and_si256(y, two), zero)));
+        *short_units = __builtin_popcount(ascii_bits) + __builtin_popcount(two_bits);
+    }
+}
+
+// Окно в 128 байтов (64 кодовые единицы)
+TARGET_AVX512 static inline void utf16_surrogates_avx512(const unsigned char *p, int little_endian,
+                                                         uint64_t *high, uint64_t *low, size_t *short_units) {
+    __m512i mask = _mm512_set1_epi16(little_endian ? (short)0xFC00 : 0x00FC);
+    __m512i high_bits = _mm512_set1_epi16(little_endian ? (short)0xD800 : 0x00D8);
+    __m512i low_bits = _mm512_set1_epi16(little_endian ? (short)0xDC00 : 0x00DC);
+    __m512i x = _mm512_loadu_si512(p);
+    __m512i y = _mm512_loadu_si512(p + 64);
+    __m512i a = _mm512_and_si512(x, mask);
+    __m512i b = _mm512_and_si512(y, mask);
+    *high = _mm512_cmpeq_epi16_mask(a, high_bits) | (uint64_t)_mm512_cmpeq_epi16_mask(b, high_bits) << 32;
+    *low = _mm512_cmpeq_epi16_mask(a, low_bits) | (uint64_t)_mm512_cmpeq_epi16_mask(b, low_bits) << 32;
+    if (short_units) {
+        __m512i ascii = _mm512_set1_epi16(little_endian ? (short)0xFF80 : (short)0x80FF);
+        __m512i two = _mm512_set1_epi16(little_endian ? (short)0xF800 : 0x00F8);
+        uint64_t ascii_bits = _mm512_testn_epi16_mask(x, ascii) | (uint64_t)_mm512_testn_epi16_mask(y, ascii) << 32;
+        uint64_t two_bits = _mm512_testn_epi16_mask(x, two) | (uint64_t)_mm512_testn_epi16_mask(y, two) << 32;
+        *short_units = __builtin_popcountll(ascii_bits) + __builtin_popcountll(two_bits);
+    }
+}
+#endif
+
+// Граница символа не дальше pos, если байты до pos уже проверены: символ, начатый
+// в последних трёх байтах и не помещающийся до pos, проверяется заново целиком
+static inline size_t utf8_boundary_before(const unsigned char *in, size_t pos) {
+    for (size_t k = 1; k <= 3 && k <= pos; k++) {
+        unsigned int c = in[pos - k];
+        if (c < 0x80) {
+            return pos;
+        }
+        if (c >= 0xC0) {
+            size_t need = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : 2;
+            return need > k ? pos - k : pos;
+        }
+    }
+    return pos;
+}
+
+// Поправка подсчёта за байты [from, to), уже учтённые векторными окнами
+static inline void utf8_uncount(const unsigned char *in, size_t from, size_t to, convert_counts *counts) {
+    for (size_t k = from; k < to; k++) {
+        counts->codepoints -= (in[k] & 0xC0) != 0x80;
+        counts->units -= ((in[k] & 0xC0) != 0x80) + (in[k] >= 0xF0);
+    }
+}
+
+// Проверка UTF-8 без перекодирования (шаблон вариантов utf8_validate_block и utf8_count_block).
+// Векторные окна идут подряд; окно с нарушением и следующие width байтов разбираются
+// медленным путём от границы символа для точной диагностики. Если counts != NULL,
+// считаются символы и кодовые единицы UTF-16, которые даст перекодирование.
+static ALWAYS_INLINE size_t utf8_validate_generic(const unsigned char *in, size_t len, long offset, int final,
+                                                  convert_errors *errors, convert_counts *counts,
+                                                  utf8_valid_fn valid, size_t width) {
+    size_t i = 0;
+    size_t slow_until = 3;  // Векторному окну нужны три предыдущих байта
+
+    while (i < len) {
+        if (valid && i >= slow_until && i + width <= len) {
+            size_t v = i;
+            if (valid(in + v, 1, counts)) {
+                v += width;
+                while (v + width <= len && valid(in + v, 0, counts)) {
+                    v += width;
+                }
+                i = utf8_boundary_before(in, v);
+                if (counts) {
+                    utf8_uncount(in, i, v, counts);
+                }
+            }
+            slow_until = v + width;
+            if (i >= len) {
+                break;
+            }
+        } else if (!valid) {
+            // Серии ASCII пропускаются по 8 байтов
+            while (i + 8 <= len && (load_word(in + i) & ASCII_UTF8_MASK) == 0) {
+                i += 8;
+                if (counts) {
+                    counts->codepoints += 8;
+                    counts->units += 8;
+                }
+            }
+            if (i >= len) {
+                break;
+            }
+        }
+
+        unsigned int codepoint;
+        size_t n = decode_utf8(in + i, len - i, &codepoint);
+        if (n == 0) {
+            if (!final) {
+                break;  // Окончание символа придёт в следующем блоке
+            }
+            add_error(errors, CONVERT_ERR_TRUNCATED_UTF8, offset + (long)i, in + i, len - i, in[i]);
+            i = len;
+            break;
+        }
+        if (codepoint == INVALID_CODEPOINT) {
+            add_error(errors, CONVERT_ERR_INVALID_UTF8, offset + (long)i, in + i, n, in[i]);
+        } else if (counts) {
+            counts->codepoints++;
+            counts->units += codepoint > 0xFFFF ? 2 : 1;
+        }
+        i += n;
+    }
+    return i;
+}
+
+// Проверка UTF-16 без перекодирования (шаблон вариантов utf16_validate_block и
+// utf16_count_block). В векторном окне каждая высокая часть пары должна быть сразу перед
+// низкой; высокая часть в конце окна переносится в следующее. Окно с ошибкой разбирается
+// медленным путём. Если counts != NULL, считаются символы и байты UTF-8 результата:
+// по три байта на единицу без единиц до U+007F и до U+07FF и без одного на каждую часть пары.
+static ALWAYS_INLINE size_t utf16_validate_generic(const unsigned char *in, size_t len, int little_endian,
+                                                   long offset, int final, convert_errors *errors,
+                                                   convert_counts *counts, utf16_surrogates_fn surrogates,
+                                                   size_t width) {
+    size_t units = width / 2;
+    uint64_t all = units == 64 ? ~0ull : (1ull << units) - 1;
+    size_t i = 0;
+    size_t slow_until = 0;
+
+    while (i + 1 < len) {
+        if (surrogates && i >= slow_until && i + width <= len) {
+            uint64_t high, low;
+            size_t short_units;
+            surrogates(in + i, little_endian, &high, &low, counts ? &short_units : NULL);
+            if (low == ((high << 1) & all)) {
+                size_t carry = (high >> (units - 1)) & 1;
+                if (counts) {
+                    counts->codepoints += units - __builtin_popcountll(high);
+                    counts->units += 3 * units - short_units - __builtin_popcountll(high | low) - 2 * carry;
+                }
+                i += carry ? width - 2 : width;
+                continue;
+            }
+            slow_until = i + width;
+        }
+
+        unsigned int wc = load_utf16(in + i, little_endian);
+        if (wc < 0xD800 || wc > 0xDFFF) {
+            if (counts) {
+                counts->codepoints++;
+                counts->units += wc <= 0x7F ? 1 : wc <= 0x7FF ? 2 : 3;
+            }
+            i += 2;
+        } else if (wc <= 0xDBFF) {
+            // Высокая часть суррогатной пары
+            if (i + 3 >= len) {
+                if (!final) {
+                    break;  // Нижняя часть придёт в следующем блоке
+                }
+                add_error(errors, CONVERT_ERR_INCOMPLETE_PAIR, offset + (long)i, in + i, 2, wc);
+                i += 2;
+                continue;
+            }
+            unsigned int low_wc = load_utf16(in + i + 2, little_endian);
+            if (low_wc < 0xDC00 || low_wc > 0xDFFF) {
+                add_error(errors, CONVERT_ERR_INVALID_LOW_SURROGATE, offset + (long)i + 2, in + i + 2, 2, low_wc);
+                i += 2;
+                continue;
+            }
+            if (counts) {
+                counts->codepoints++;
+                counts->units += 4;
+            }
+            i += 4;
+        } else {
+            // Нижняя часть суррогатной пары без высокой
+            add_error(errors, CONVERT_ERR_INVALID_HIGH_SURROGATE, offset + (long)i, in + i, 2, wc);
+            i += 2;
+        }
+    }
+
+    if (final && i + 1 == len) {
+        // Нечётное количество байтов во входном файле
+        add_error(errors, CONVERT_ERR_ODD_LENGTH, offset + (long)i, in + i, 1, in[i]);
+        i = len;
+    }
+    return i;
+}
+
+// Однобайтовые кодовые страницы. Байты 0x00..0x7F во всех совпадают с ASCII,
+// таблицы задают кодовые точки верхней половины.
+
+// Windows-1251
+static const uint16_t cp1251_high[128] = {
+    0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,  // 0x80
+    0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,  // 0x88
+    0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,  // 0x90
+    0x0000, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,  // 0x98
+    0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,  // 0xA0
+    0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,  // 0xA8
+    0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,  // 0xB0
+    0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,  // 0xB8
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,  // 0xC0
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,  // 0xC8
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,  // 0xD0
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,  // 0xD8
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,  // 0xE0
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,  // 0xE8
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,  // 0xF0
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,  // 0xF8
+};
+
+// KOI8-R
+static const uint16_t koi8r_high[128] = {
+    0x2500, 0x2502, 0x250C, 0x2510, 0x2514, 0x2518, 0x251C, 0x2524,  // 0x80
+    0x252C, 0x2534, 0x253C, 0x2580, 0x2584, 0x2588, 0x258C, 0x2590,  // 0x88
+    0x2591, 0x2592, 0x2593, 0x2320, 0x25A0, 0x2219, 0x221A, 0x2248,  // 0x90
+    0x2264, 0x2265, 0x00A0, 0x2321, 0x00B0, 0x00B2, 0x00B7, 0x00F7,  // 0x98
+    0x2550, 0x2551, 0x2552, 0x0451, 0x2553, 0x2554, 0x2555, 0x2556,  // 0xA0
+    0x2557, 0x2558, 0x2559, 0x255A, 0x255B, 0x255C, 0x255D, 0x255E,  // 0xA8
+    0x255F, 0x2560, 0x2561, 0x0401, 0x2562, 0x2563, 0x2564, 0x2565,  // 0xB0
+    0x2566, 0x2567, 0x2568, 0x2569, 0x256A, 0x256B, 0x256C, 0x00A9,  // 0xB8
+    0x044E, 0x0430, 0x0431, 0x0446, 0x0434, 0x0435, 0x0444, 0x0433,  // 0xC0
+    0x0445, 0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E,  // 0xC8
+    0x043F, 0x044F, 0x0440, 0x0441, 0x0442, 0x0443, 0x0436, 0x0432,  // 0xD0
+    0x044C, 0x044B, 0x0437, 0x0448, 0x044D, 0x0449, 0x0447, 0x044A,  // 0xD8
+    0x042E, 0x0410, 0x0411, 0x0426, 0x0414, 0x0415, 0x0424, 0x0413,  // 0xE0
+    0x0425, 0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E,  // 0xE8
+    0x041F, 0x042F, 0x0420, 0x0421, 0x0422, 0x0423, 0x0416, 0x0412,  // 0xF0
+    0x042C, 0x042B, 0x0417, 0x0428, 0x042D, 0x0429, 0x0427, 0x042A,  // 0xF8
+};
+
+// CP866 (DOS)
+static const uint16_t cp866_high[128] = {
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,  // 0x80
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,  // 0x88
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,  // 0x90
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,  // 0x98
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,  // 0xA0
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,  // 0xA8
+    0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,  // 0xB0
+    0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,  // 0xB8
+    0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F,  // 0xC0
+    0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,  // 0xC8
+    0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B,  // 0xD0
+    0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,  // 0xD8
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,  // 0xE0
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,  // 0xE8
+    0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040E, 0x045E,  // 0xF0
+    0x00B0, 0x2219, 0x00B7, 0x221A, 0x2116, 0x00A4, 0x25A0, 0x00A0,  // 0xF8
+};
+
+// ISO-8859-1
+static const uint16_t iso8859_1_high[128] = {
+    0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x0085, 0x0086, 0x0087,  // 0x80
+    0x0088, 0x0089, 0x008A, 0x008B, 0x008C, 0x008D, 0x008E, 0x008F,  // 0x88
+    0x0090, 0x0091, 0x0092, 0x0093, 0x0094, 0x0095, 0x0096, 0x0097,  // 0x90
+    0x0098, 0x0099, 0x009A, 0x009B, 0x009C, 0x009D, 0x009E, 0x009F,  // 0x98
+    0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,  // 0xA0
+    0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,  // 0xA8
+    0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,  // 0xB0
+    0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,  // 0xB8
+    0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,  // 0xC0
+    0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,  // 0xC8
+    0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,  // 0xD0
+    0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,  // 0xD8
+    0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,  // 0xE0
+    0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,  // 0xE8
+    0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,  // 0xF0
+    0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF,  // 0xF8
+};
+
+// ISO-8859-5
+static const uint16_t iso8859_5_high[128] = {
+    0x0080, 0x0081, 0x0082, 0x0083, 0x0084, 0x0085, 0x0086, 0x0087,  // 0x80
+    0x0088, 0x0089, 0x008A, 0x008B, 0x008C, 0x008D, 0x008E, 0x008F,  // 0x88
+    0x0090, 0x0091, 0x0092, 0x0093, 0x0094, 0x0095, 0x0096, 0x0097,  // 0x90
+    0x0098, 0x0099, 0x009A, 0x009B, 0x009C, 0x009D, 0x009E, 0x009F,  // 0x98
+    0x00A0, 0x0401, 0x0402, 0x0403, 0x0404, 0x0405, 0x0406, 0x0407,  // 0xA0
+    0x0408, 0x0409, 0x040A, 0x040B, 0x040C, 0x00AD, 0x040E, 0x040F,  // 0xA8
+    0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,  // 0xB0
+    0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,  // 0xB8
+    0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,  // 0xC0
+    0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,  // 0xC8
+    0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,  // 0xD0
+    0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,  // 0xD8
+    0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,  // 0xE0
+    0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F,  // 0xE8
+    0x2116, 0x0451, 0x0452, 0x0453, 0x0454, 0x0455, 0x0456, 0x0457,  // 0xF0
+    0x0458, 0x0459, 0x045A, 0x045B, 0x045C, 0x00A7, 0x045E, 0x045F,  // 0xF8
+};
+
+// Число блоков обратной таблицы на кодовую страницу (блок 0 не используется)
+#define CODEPAGE_PAGES 8
+
+// Однобайтовая кодовая страница
+typedef struct {
+    const uint16_t *high;  // Кодовые точки байтов 0x80..0xFF, 0 - байт не определён
+    // Линейные участки для векторного пути: кодовая точка = байт + delta, в пределах
+    // U+0080..U+07FF. Неиспользуемый участок нулевой, под него подходит только байт 0.
+    struct {
+        unsigned char first, last;
+        uint16_t delta;
+    } range[2];
+    // Таблицы, которые строятся при загрузке по high
+    unsigned char utf8[256][4];   // Байты UTF-8 для каждого байта кодовой страницы
+    unsigned char utf8_len[256];  // Длина UTF-8, 0 - байт не определён
+    unsigned char page[256];      // Блок обратной таблицы по старшему байту кодовой точки, 0 - нет
+    unsigned char from_ucs[CODEPAGE_PAGES][256];  // Байт по младшему байту кодовой точки, 0 - нет
+} codepage;
+
+// В порядке CONVERT_ENC_CP1251..CONVERT_ENC_ISO8859_5
+static codepage codepages[] = {
+    {.high = cp1251_high, .range = {{0xC0, 0xFF, 0x350}}},  // А..я
+    {.high = koi8r_high},                                  // Буквы не по алфавиту, только таблица
+    {.high = cp866_high, .range = {{0x80, 0xAF, 0x390}, {0xE0, 0xEF, 0x360}}},  // А..п, р..я
+    {.high = iso8859_1_high, .range = {{0x80, 0xFF, 0}}},
+    {.high = iso8859_5_high, .range = {{0xAE, 0xEF, 0x360}, {0xF1, 0xFC, 0x360}}},  // Ў..я, ё..ќ
+};
+
+#define CODEPAGE_COUNT (sizeof(codepages) / sizeof(codepages[0]))
+
+// Построение таблиц UTF-8 и обратных таблиц при загрузке, до запуска потоков
+__attribute__((constructor)) static void build_codepages(void) {
+    for (size_t k = 0; k < CODEPAGE_COUNT; k++) {
+        codepage *cp = &codepages[k];
+        size_t pages = 0;
+        for (unsigned int b = 0; b < 256; b++) {
+            unsigned int c = b < 0x80 ? b : cp->high[b - 0x80];
+            unsigned char *u = cp->utf8[b];
+            if (b >= 0x80 && c == 0) {
+                cp->utf8_len[b] = 0;
+                continue;
+            }
+            if (c <= 0x7F) {
+                u[0] = c;
+                cp->utf8_len[b] = 1;
+            } else if (c <= 0x7FF) {
+                u[0] = 0xC0 | (c >> 6);
+                u[1] = 0x80 | (c & 0x3F);
+                cp->utf8_len[b] = 2;
+            } else {
+                u[0] = 0xE0 | (c >> 12);
+                u[1] = 0x80 | ((c >> 6) & 0x3F);
+                u[2] = 0x80 | (c & 0x3F);
+                cp->utf8_len[b] = 3;
+            }
+            if (b >= 0x80) {
+                if (!cp->page[c >> 8]) {
+                    cp->page[c >> 8] = ++pages;  // Блоков не больше CODEPAGE_PAGES - 1
+                }
+                cp->from_ucs[cp->page[c >> 8]][c & 0xFF] = b;
+            }
+        }
+    }
+}
+
+// Байт кодовой страницы для кодовой точки или -1, если символа в ней нет
+static inline int sbcs_encode(const codepage *cp, unsigned int codepoint) {
+    if (codepoint <= 0x7F) {
+        return codepoint;
+    }
+    if (codepoint > 0xFFFF || !cp->page[codepoint >> 8]) {
+        return -1;
+    }
+    int byte = cp->from_ucs[cp->page[codepoint >> 8]][codepoint & 0xFF];
+    return byte ? byte : -1;
+}
+
+// Байт результата для символа: символ, которого нет в кодовой странице, заменяется на '?'
+static inline unsigned char sbcs_put(const codepage *cp, unsigned int codepoint, convert_errors *errors,
+                                     long offset, const unsigned char *bytes, size_t length) {
+    int byte = sbcs_encode(cp, codepoint);
+    if (byte < 0) {
+        add_error(errors, CONVERT_ERR_UNMAPPABLE, offset, bytes, length, codepoint);
+        return '?';
+    }
+    return byte;
+}
+
+// Векторное окно однобайтовой кодовой страницы: перекодирует окно фиксированной ширины.
+// ASCII и символы линейных участков перекодируются векторно, немногие остальные (для
+// UTF-16) исправляются по таблице. Возвращает количество обработанных байтов входа
+// или 0, если окно нужно разобрать по таблице; *op сдвигается на записанный результат.
+typedef size_t (*sbcs_window_fn)(const codepage *cp, const unsigned char *p, unsigned char **op, int little_endian);
+
+// Исправление по таблице символов окна -> UTF-16 на позициях bad. 0 - среди них есть
+// неопределённый байт, окно разбирается медленным путём ради диагностики.
+static inline int sbcs_patch_utf16(const codepage *cp, const unsigned char *p, unsigned char *o, uint64_t bad,
+                                   int little_endian) {
+    for (; bad; bad &= bad - 1) {
+        size_t k = __builtin_ctzll(bad);
+        unsigned int codepoint = cp->high[p[k] - 0x80];
+        if (codepoint == 0) {
+            return 0;
+        }
+        put_utf16(o + 2 * k, codepoint, little_endian);
+    }
+    return 1;
+}
+
+// Исправление по таблице символов окна UTF-16 -> байты на позициях bad. 0 - среди них
+// есть суррогат или символ, которого нет в кодовой странице.
+static inline int sbcs_patch_bytes(const codepage *cp, const unsigned char *p, unsigned char *o, uint64_t bad,
+                                   int little_endian) {
+    for (; bad; bad &= bad - 1) {
+        size_t k = __builtin_ctzll(bad);
+        int byte = sbcs_encode(cp, load_utf16(p + 2 * k, little_endian));
+        if (byte < 0) {
+            return 0;
+        }
+        o[k] = byte;
+    }
+    return 1;
+}
+
+#ifdef CONVERT_X86
+// Признак 16-битных значений из участка [first, first + span]
+TARGET_SSE2 static inline __m128i in_range_epu16_sse2(__m128i u, unsigned int first, unsigned int span) {
+    __m128i x = _mm_sub_epi16(u, _mm_set1_epi16((short)first));
+    return _mm_cmpeq_epi16(_mm_subs_epu16(x, _mm_set1_epi16((short)span)), _mm_setzero_si128());
+}
+
+// Кодовые точки 8 байтов, расширенных до 16 бит; *mapped - признак байтов из линейных участков
+TARGET_SSE2 static inline __m128i sbcs_map_sse2(const codepage *cp, __m128i u, __m128i *mapped) {
+    __m128i in0 = in_range_epu16_sse2(u, cp->range[0].first, cp->range[0].last - cp->range[0].first);
+    __m128i in1 = in_range_epu16_sse2(u, cp->range[1].first, cp->range[1].last - cp->range[1].first);
+    __m128i delta = _mm_or_si128(_mm_and_si128(in0, _mm_set1_epi16((short)cp->range[0].delta)),
+                                 _mm_and_si128(in1, _mm_set1_epi16((short)cp->range[1].delta)));
+    *mapped = _mm_or_si128(in0, in1);
+    return _mm_add_epi16(u, delta);
+}
+
+// Байты кодовой страницы для 8 кодовых единиц UTF-16; *good - признак ASCII и символов из участков
+TARGET_SSE2 static inline __m128i sbcs_unmap_sse2(const codepage *cp, __m128i u, __m128i *good) {
+    __m128i in0 = in_range_epu16_sse2(u, cp->range[0].first + cp->range[0].delta,
+                                      cp->range[0].last - cp->range[0].first);
+    __m128i in1 = in_range_epu16_sse2(u, cp->range[1].first + cp->range[1].delta,
+                                      cp->range[1].last - cp->range[1].first);
+    __m128i ascii = _mm_cmpeq_epi16(_mm_and_si128(u, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128());
+    __m128i delta = _mm_or_si128(_mm_and_si128(in0, _mm_set1_epi16((short)cp->range[0].delta)),
+                                 _mm_and_si128(in1, _mm_set1_epi16((short)cp->range[1].delta)));
+    *good = _mm_or_si128(ascii, _mm_or_si128(in0, in1));
+    return _mm_sub_epi16(u, delta);
+}
+
+// Перестановка байтов в 16-битных значениях (для UTF-16BE)
+TARGET_SSE2 static inline __m128i swap_bytes_sse2(__m128i u) {
+    return _mm_or_si128(_mm_slli_epi16(u, 8), _mm_srli_epi16(u, 8));
+}
+
+// Пары байтов UTF-8 для кодовых точек U+0080..U+07FF: 0xC0 | c >> 6, затем 0x80 | c & 0x3F
+TARGET_SSE2 static inline __m128i utf8_pairs_sse2(__m128i c) {
+    __m128i trail = _mm_slli_epi16(_mm_and_si128(c, _mm_set1_epi16(0x3F)), 8);
+    return _mm_or_si128(_mm_or_si128(_mm_srli_epi16(c, 6), trail), _mm_set1_epi16((short)0x80C0));
+}
+
+// Окно в 16 байтов -> UTF-16
+TARGET_SSE2 static inline size_t sbcs_utf16_sse2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                 int little_endian) {
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    __m128i in_lo, in_hi;
+    __m128i lo = sbcs_map_sse2(cp, _mm_unpacklo_epi8(b, _mm_setzero_si128()), &in_lo);
+    __m128i hi = sbcs_map_sse2(cp, _mm_unpackhi_epi8(b, _mm_setzero_si128()), &in_hi);
+    unsigned int bad = _mm_movemask_epi8(b) & ~_mm_movemask_epi8(_mm_packs_epi16(in_lo, in_hi));
+    if (!little_endian) {
+        lo = swap_bytes_sse2(lo);
+        hi = swap_bytes_sse2(hi);
+    }
+    _mm_storeu_si128((__m128i *)*op, lo);
+    _mm_storeu_si128((__m128i *)(*op + 16), hi);
+    if (bad && !sbcs_patch_utf16(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 32;
+    return 16;
+}
+
+// Окно в 16 байтов -> UTF-8: только ASCII или только символы из участков
+TARGET_SSE2 static inline size_t sbcs_utf8_sse2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                int little_endian) {
+    (void)little_endian;
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    int high = _mm_movemask_epi8(b);
+    if (high == 0) {
+        _mm_storeu_si128((__m128i *)*op, b);
+        *op += 16;
+        return 16;
+    }
+    if (high != 0xFFFF) {
+        return 0;
+    }
+    __m128i in_lo, in_hi;
+    __m128i lo = sbcs_map_sse2(cp, _mm_unpacklo_epi8(b, _mm_setzero_si128()), &in_lo);
+    __m128i hi = sbcs_map_sse2(cp, _mm_unpackhi_epi8(b, _mm_setzero_si128()), &in_hi);
+    if (_mm_movemask_epi8(_mm_and_si128(in_lo, in_hi)) != 0xFFFF) {
+        return 0;
+    }
+    _mm_storeu_si128((__m128i *)*op, utf8_pairs_sse2(lo));
+    _mm_storeu_si128((__m128i *)(*op + 16), utf8_pairs_sse2(hi));
+    *op += 32;
+    return 16;
+}
+
+// Окно UTF-16 в 32 байта (16 кодовых единиц) -> 16 байтов
+TARGET_SSE2 static inline size_t utf16_sbcs_sse2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                 int little_endian) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    if (!little_endian) {
+        a = swap_bytes_sse2(a);
+        b = swap_bytes_sse2(b);
+    }
+    __m128i good_a, good_b;
+    a = sbcs_unmap_sse2(cp, a, &good_a);
+    b = sbcs_unmap_sse2(cp, b, &good_b);
+    unsigned int bad = ~_mm_movemask_epi8(_mm_packs_epi16(good_a, good_b)) & 0xFFFF;
+    _mm_storeu_si128((__m128i *)*op, _mm_packus_epi16(a, b));
+    if (bad && !sbcs_patch_bytes(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 16;
+    return 32;
+}
+
+TARGET_AVX2 static inline __m256i in_range_epu16_avx2(__m256i u, unsigned int first, unsigned int span) {
+    __m256i x = _mm256_sub_epi16(u, _mm256_set1_epi16((short)first));
+    return _mm256_cmpeq_epi16(_mm256_subs_epu16(x, _mm256_set1_epi16((short)span)), _mm256_setzero_si256());
+}
+
+TARGET_AVX2 static inline __m256i sbcs_map_avx2(const codepage *cp, __m256i u, __m256i *mapped) {
+    __m256i in0 = in_range_epu16_avx2(u, cp->range[0].first, cp->range[0].last - cp->range[0].first);
+    __m256i in1 = in_range_epu16_avx2(u, cp->range[1].first, cp->range[1].last - cp->range[1].first);
+    __m256i delta = _mm256_or_si256(_mm256_and_si256(in0, _mm256_set1_epi16((short)cp->range[0].delta)),
+                                    _mm256_and_si256(in1, _mm256_set1_epi16((short)cp->range[1].delta)));
+    *mapped = _mm256_or_si256(in0, in1);
+    return _mm256_add_epi16(u, delta);
+}
+
+TARGET_AVX2 static inline __m256i sbcs_unmap_avx2(const codepage *cp, __m256i u, __m256i *good) {
+    __m256i in0 = in_range_epu16_avx2(u, cp->range[0].first + cp->range[0].delta,
+                                      cp->range[0].last - cp->range[0].first);
+    __m256i in1 = in_range_epu16_avx2(u, cp->range[1].first + cp->range[1].delta,
+                                      cp->range[1].last - cp->range[1].first);
+    __m256i ascii = _mm256_cmpeq_epi16(_mm256_and_si256(u, _mm256_set1_epi16((short)0xFF80)),
+                                       _mm256_setzero_si256());
+    __m256i delta = _mm256_or_si256(_mm256_and_si256(in0, _mm256_set1_epi16((short)cp->range[0].delta)),
+                                    _mm256_and_si256(in1, _mm256_set1_epi16((short)cp->range[1].delta)));
+    *good = _mm256_or_si256(ascii, _mm256_or_si256(in0, in1));
+    return _mm256_sub_epi16(u, delta);
+}
+
+TARGET_AVX2 static inline __m256i swap_bytes_avx2(__m256i u) {
+    return _mm256_or_si256(_mm256_slli_epi16(u, 8), _mm256_srli_epi16(u, 8));
+}
+
+TARGET_AVX2 static inline __m256i utf8_pairs_avx2(__m256i c) {
+    __m256i trail = _mm256_slli_epi16(_mm256_and_si256(c, _mm256_set1_epi16(0x3F)), 8);
+    return _mm256_or_si256(_mm256_or_si256(_mm256_srli_epi16(c, 6), trail), _mm256_set1_epi16((short)0x80C0));
+}
+
+// Окно в 32 байта -> UTF-16
+TARGET_AVX2 static inline size_t sbcs_utf16_avx2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                 int little_endian) {
+    __m256i u_lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p));
+    __m256i u_hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(p + 16)));
+    __m256i in_lo, in_hi;
+    __m256i lo = sbcs_map_avx2(cp, u_lo, &in_lo);
+    __m256i hi = sbcs_map_avx2(cp, u_hi, &in_hi);
+    // Упаковка идёт внутри 128-битных половин, восстанавливаем порядок
+    __m256i mapped = _mm256_permute4x64_epi64(_mm256_packs_epi16(in_lo, in_hi), 0xD8);
+    unsigned int bad = (unsigned int)_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p)) &
+                       ~(unsigned int)_mm256_movemask_epi8(mapped);
+    if (!little_endian) {
+        lo = swap_bytes_avx2(lo);
+        hi = swap_bytes_avx2(hi);
+    }
+    _mm256_storeu_si256((__m256i *)*op, lo);
+    _mm256_storeu_si256((__m256i *)(*op + 32), hi);
+    if (bad && !sbcs_patch_utf16(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 64;
+    return 32;
+}
+
+// Окно в 32 байта -> UTF-8: только ASCII или только символы из участков
+TARGET_AVX2 static inline size_t sbcs_utf8_avx2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                int little_endian) {
+    (void)little_endian;
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+    unsigned int high = (unsigned int)_mm256_movemask_epi8(b);
+    if (high == 0) {
+        _mm256_storeu_si256((__m256i *)*op, b);
+        *op += 32;
+        return 32;
+    }
+    if (high != 0xFFFFFFFFu) {
+        return 0;
+    }
+    __m256i in_lo, in_hi;
+    __m256i lo = sbcs_map_avx2(cp, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(b)), &in_lo);
+    __m256i hi = sbcs_map_avx2(cp, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(b, 1)), &in_hi);
+    if ((unsigned int)_mm256_movemask_epi8(_mm256_and_si256(in_lo, in_hi)) != 0xFFFFFFFFu) {
+        return 0;
+    }
+    _mm256_storeu_si256((__m256i *)*op, utf8_pairs_avx2(lo));
+    _mm256_storeu_si256((__m256i *)(*op + 32), utf8_pairs_avx2(hi));
+    *op += 64;
+    return 32;
+}
+
+// Окно UTF-16 в 64 байта (32 кодовые единицы) -> 32 байта
+TARGET_AVX2 static inline size_t utf16_sbcs_avx2(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                 int little_endian) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    if (!little_endian) {
+        a = swap_bytes_avx2(a);
+        b = swap_bytes_avx2(b);
+    }
+    __m256i good_a, good_b;
+    a = sbcs_unmap_avx2(cp, a, &good_a);
+    b = sbcs_unmap_avx2(cp, b, &good_b);
+    // Упаковка идёт внутри 128-битных половин, восстанавливаем порядок
+    __m256i good = _mm256_permute4x64_epi64(_mm256_packs_epi16(good_a, good_b), 0xD8);
+    unsigned int bad = ~(unsigned int)_mm256_movemask_epi8(good);
+    _mm256_storeu_si256((__m256i *)*op, _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8));
+    if (bad && !sbcs_patch_bytes(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 32;
+    return 64;
+}
+
+// Признак 16-битных значений из участка [first, first + span]
+TARGET_AVX512 static inline __mmask32 in_range_epu16_avx512(__m512i u, unsigned int first, unsigned int span) {
+    return _mm512_cmple_epu16_mask(_mm512_sub_epi16(u, _mm512_set1_epi16((short)first)),
+                                   _mm512_set1_epi16((short)span));
+}
+
+TARGET_AVX512 static inline __m512i sbcs_map_avx512(const codepage *cp, __m512i u, __mmask32 *mapped) {
+    __mmask32 in0 = in_range_epu16_avx512(u, cp->range[0].first, cp->range[0].last - cp->range[0].first);
+    __mmask32 in1 = in_range_epu16_avx512(u, cp->range[1].first, cp->range[1].last - cp->range[1].first);
+    *mapped = in0 | in1;
+    u = _mm512_mask_add_epi16(u, in0, u, _mm512_set1_epi16((short)cp->range[0].delta));
+    return _mm512_mask_add_epi16(u, in1, u, _mm512_set1_epi16((short)cp->range[1].delta));
+}
+
+TARGET_AVX512 static inline __m512i sbcs_unmap_avx512(const codepage *cp, __m512i u, __mmask32 *good) {
+    __mmask32 in0 = in_range_epu16_avx512(u, cp->range[0].first + cp->range[0].delta,
+                                          cp->range[0].last - cp->range[0].first);
+    __mmask32 in1 = in_range_epu16_avx512(u, cp->range[1].first + cp->range[1].delta,
+                                          cp->range[1].last - cp->range[1].first);
+    *good = _mm512_cmple_epu16_mask(u, _mm512_set1_epi16(0x7F)) | in0 | in1;
+    u = _mm512_mask_sub_epi16(u, in0, u, _mm512_set1_epi16((short)cp->range[0].delta));
+    return _mm512_mask_sub_epi16(u, in1, u, _mm512_set1_epi16((short)cp->range[1].delta));
+}
+
+TARGET_AVX512 static inline __m512i swap_bytes_avx512(__m512i u) {
+    return _mm512_or_si512(_mm512_slli_epi16(u, 8), _mm512_srli_epi16(u, 8));
+}
+
+TARGET_AVX512 static inline __m512i utf8_pairs_avx512(__m512i c) {
+    __m512i trail = _mm512_slli_epi16(_mm512_and_si512(c, _mm512_set1_epi16(0x3F)), 8);
+    return _mm512_or_si512(_mm512_or_si512(_mm512_srli_epi16(c, 6), trail), _mm512_set1_epi16((short)0x80C0));
+}
+
+// Окно в 64 байта -> UTF-16
+TARGET_AVX512 static inline size_t sbcs_utf16_avx512(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                     int little_endian) {
+    __m512i u_lo = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)p));
+    __m512i u_hi = _mm512_cvtepu8_epi16(_mm256_loadu_si256((const __m256i *)(p + 32)));
+    __mmask32 in_lo, in_hi;
+    __m512i lo = sbcs_map_avx512(cp, u_lo, &in_lo);
+    __m512i hi = sbcs_map_avx512(cp, u_hi, &in_hi);
+    __m512i ascii_max = _mm512_set1_epi16(0x7F);
+    uint64_t bad = (uint64_t)(_mm512_cmpgt_epu16_mask(u_lo, ascii_max) & ~in_lo) |
+                   (uint64_t)(_mm512_cmpgt_epu16_mask(u_hi, ascii_max) & ~in_hi) << 32;
+    if (!little_endian) {
+        lo = swap_bytes_avx512(lo);
+        hi = swap_bytes_avx512(hi);
+    }
+    _mm512_storeu_si512(*op, lo);
+    _mm512_storeu_si512(*op + 64, hi);
+    if (bad && !sbcs_patch_utf16(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 128;
+    return 64;
+}
+
+// Окно в 64 байта -> UTF-8: только ASCII или только символы из участков
+TARGET_AVX512 static inline size_t sbcs_utf8_avx512(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                    int little_endian) {
+    (void)little_endian;
+    __m512i b = _mm512_loadu_si512(p);
+    __mmask64 high = _mm512_movepi8_mask(b);
+    if (high == 0) {
+        _mm512_storeu_si512(*op, b);
+        *op += 64;
+        return 64;
+    }
+    if (high != ~(__mmask64)0) {
+        return 0;
+    }
+    __mmask32 in_lo, in_hi;
+    __m512i lo = sbcs_map_avx512(cp, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(b)), &in_lo);
+    __m512i hi = sbcs_map_avx512(cp, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(b, 1)), &in_hi);
+    if ((in_lo & in_hi) != 0xFFFFFFFFu) {
+        return 0;
+    }
+    _mm512_storeu_si512(*op, utf8_pairs_avx512(lo));
+    _mm512_storeu_si512(*op + 64, utf8_pairs_avx512(hi));
+    *op += 128;
+    return 64;
+}
+
+// Окно UTF-16 в 128 байтов (64 кодовые единицы) -> 64 байта
+TARGET_AVX512 static inline size_t utf16_sbcs_avx512(const codepage *cp, const unsigned char *p, unsigned char **op,
+                                                     int little_endian) {
+    __m512i a = _mm512_loadu_si512(p);
+    __m512i b = _mm512_loadu_si512(p + 64);
+    if (!little_endian) {
+        a = swap_bytes_avx512(a);
+        b = swap_bytes_avx512(b);
+    }
+    __mmask32 good_a, good_b;
+    a = sbcs_unmap_avx512(cp, a, &good_a);
+    b = sbcs_unmap_avx512(cp, b, &good_b);
+    uint64_t bad = ~((uint64_t)good_a | (uint64_t)good_b << 32);
+    _mm256_storeu_si256((__m256i *)*op, _mm512_cvtepi16_epi8(a));
+    _mm256_storeu_si256((__m256i *)(*op + 32), _mm512_cvtepi16_epi8(b));
+    if (bad && !sbcs_patch_bytes(cp, p, *op, bad, little_endian)) {
+        return 0;
+    }
+    *op += 64;
+    return 128;
+}
+#endif
+
+// Однобайтовая кодовая страница -> UTF-8 (шаблон вариантов). Без векторного окна
+// серии ASCII копируются по 8 байтов, остальные байты - по таблице.
+static ALWAYS_INLINE size_t sbcs_to_utf8_generic(const codepage *cp, const unsigned char *in, size_t len,
+                                                 unsigned char *out, size_t out_cap, size_t *out_len,
+                                                 long offset, convert_errors *errors,
+                                                 sbcs_window_fn window, size_t width) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    size_t slow_until = 0;  // Окно не из одних ASCII или символов участков идёт по таблице
+
+    while (i < len) {
+        if (window && i >= slow_until && i + width <= len && (size_t)(end - o) >= 2 * width) {
+            size_t used = window(cp, in + i, &o, 1);
+            if (used) {
+                i += used;
+                continue;
+            }
+            slow_until = i + width;
+        } else if (!window && i + 8 <= len && end - o >= 8 && (load_word(in + i) & ASCII_UTF8_MASK) == 0) {
+            memcpy(o, in + i, 8);
+            o += 8;
+            i += 8;
+            continue;
+        }
+
+        unsigned int c = in[i];
+        size_t n = cp->utf8_len[c];
+        if (n == 0) {
+            if ((size_t)(end - o) < replacement_size(errors, CONVERT_ENC_UTF8)) {
+                break;  // Выходной буфер заполнен
+            }
+            add_error(errors, CONVERT_ERR_UNDEFINED_BYTE, offset + (long)i, in + i, 1, c);
+            o += put_replacement(errors, CONVERT_ENC_UTF8, 0, o);
+            i++;
+            continue;
+        }
+        if (end - o >= 4) {
+            memcpy(o, cp->utf8[c], 4);  // Лишние байты затрёт следующий символ
+        } else if ((size_t)(end - o) >= n) {
+            memcpy(o, cp->utf8[c], n);
+        } else {
+            break;  // Выходной буфер заполнен
+        }
+        o += n;
+        i++;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// Однобайтовая кодовая страница -> UTF-16 (шаблон вариантов)
+static ALWAYS_INLINE size_t sbcs_to_utf16_generic(const codepage *cp, const unsigned char *in, size_t len,
+                                                  int little_endian, unsigned char *out, size_t out_cap,
+                                                  size_t *out_len, long offset, convert_errors *errors,
+                                                  sbcs_window_fn window, size_t width) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    size_t slow_until = 0;
+
+    while (i < len) {
+        if (window && i >= slow_until && i + width <= len && (size_t)(end - o) >= 2 * width) {
+            size_t used = window(cp, in + i, &o, little_endian);
+            if (used) {
+                i += used;
+                continue;
+            }
+            slow_until = i + width;
+        } else if (!window && i + 8 <= len && end - o >= 16 && (load_word(in + i) & ASCII_UTF8_MASK) == 0) {
+            for (size_t k = 0; k < 8; k++) {
+                o += put_utf16(o, in[i + k], little_endian);
+            }
+            i += 8;
+            continue;
+        }
+
+        unsigned int c = in[i];
+        unsigned int codepoint = c < 0x80 ? c : cp->high[c - 0x80];
+        if (codepoint == 0 && c != 0) {
+            if ((size_t)(end - o) < replacement_size(errors, CONVERT_ENC_UTF16)) {
+                break;  // Выходной буфер заполнен
+            }
+            add_error(errors, CONVERT_ERR_UNDEFINED_BYTE, offset + (long)i, in + i, 1, c);
+            o += put_replacement(errors, CONVERT_ENC_UTF16, little_endian, o);
+            i++;
+            continue;
+        }
+        if (end - o < 2) {
+            break;  // Выходной буфер заполнен
+        }
+        o += put_utf16(o, codepoint, little_endian);
+        i++;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// UTF-16 -> однобайтовая кодовая страница (шаблон вариантов). Ошибки UTF-16 те же,
+// что у utf16_to_utf8_block; символ, которого нет в кодовой странице, заменяется на '?'.
+static ALWAYS_INLINE size_t utf16_to_sbcs_generic(const codepage *cp, const unsigned char *in, size_t len,
+                                                  int little_endian, unsigned char *out, size_t out_cap,
+                                                  size_t *out_len, long offset, int final, convert_errors *errors,
+                                                  sbcs_window_fn window, size_t width) {
+    uint64_t ascii_mask = load_word(little_endian ? ascii_utf16le_mask : ascii_utf16be_mask);
+    size_t low_byte = little_endian ? 0 : 1;
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    size_t slow_until = 0;
+    int full = 0;  // Выходной буфер заполнен
+
+    while (i + 1 < len) {
+        if (o == end) {
+            full = 1;
+            break;
+        }
+        if (window && i >= slow_until && i + width <= len && (size_t)(end - o) >= width / 2) {
+            size_t used = window(cp, in + i, &o, little_endian);
+            if (used) {
+                i += used;
+                continue;
+            }
+            slow_until = i + width;
+        } else if (!window && i + 8 <= len && end - o >= 4 && (load_word(in + i) & ascii_mask) == 0) {
+            o[0] = in[i + low_byte];
+            o[1] = in[i + 2 + low_byte];
+            o[2] = in[i + 4 + low_byte];
+            o[3] = in[i + 6 + low_byte];
+            o += 4;
+            i += 8;
+            continue;
+        }
+
+        unsigned int wc = load_utf16(in + i, little_endian);
+        if (wc >= 0xD800 && wc <= 0xDBFF) {
+            // Высокая часть суррогатной пары
+            if (i + 3 >= len) {
+                if (!final) {
+                    break;  // Нижняя часть придёт в следующем блоке
+                }
+                add_error(errors, CONVERT_ERR_INCOMPLETE_PAIR, offset + (long)i, in + i, 2, wc);
+                o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+                i += 2;
+                continue;
+            }
+            unsigned int low_wc = load_utf16(in + i + 2, little_endian);
+            if (low_wc < 0xDC00 || low_wc > 0xDFFF) {
+                add_error(errors, CONVERT_ERR_INVALID_LOW_SURROGATE, offset + (long)i + 2, in + i + 2, 2, low_wc);
+                o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+                i += 2;
+                continue;
+            }
+            unsigned int codepoint = 0x10000 + ((wc - 0xD800) << 10) + (low_wc - 0xDC00);
+            *o++ = sbcs_put(cp, codepoint, errors, offset + (long)i, in + i, 4);
+            i += 4;
+        } else if (wc >= 0xDC00 && wc <= 0xDFFF) {
+            // Нижняя часть суррогатной пары без высокой
+            add_error(errors, CONVERT_ERR_INVALID_HIGH_SURROGATE, offset + (long)i, in + i, 2, wc);
+            o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+            i += 2;
+        } else {
+            *o++ = sbcs_put(cp, wc, errors, offset + (long)i, in + i, 2);
+            i += 2;
+        }
+    }
+
+    if (final && !full && i + 1 == len && (size_t)(end - o) >= replacement_size(errors, CONVERT_ENC_CP1251)) {
+        // Нечётное количество байтов во входном файле
+        add_error(errors, CONVERT_ERR_ODD_LENGTH, offset + (long)i, in + i, 1, in[i]);
+        o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+        i = len;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// UTF-8 -> однобайтовая кодовая страница. Результат не длиннее входа, поэтому векторных
+// вариантов нет: серии ASCII копируются по 8 байтов, остальное декодируется посимвольно.
+static size_t utf8_to_sbcs(const codepage *cp, const unsigned char *in, size_t len,
+                           unsigned char *out, size_t out_cap, size_t *out_len,
+                           long offset, int final, convert_errors *errors) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+
+    while (i < len) {
+        if (i + 8 <= len && end - o >= 8 && (load_word(in + i) & ASCII_UTF8_MASK) == 0) {
+            memcpy(o, in + i, 8);
+            o += 8;
+            i += 8;
+            continue;
+        }
+        unsigned int codepoint;
+        size_t n = decode_utf8(in + i, len - i, &codepoint);
+        if (n == 0) {
+            if (!final || (errors->replace && o == end)) {
+                break;  // Окончание символа придёт в следующем блоке или нет места для замены
+            }
+            add_error(errors, CONVERT_ERR_TRUNCATED_UTF8, offset + (long)i, in + i, len - i, in[i]);
+            o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+            i = len;
+            break;
+        }
+        if (o == end && (errors->replace || codepoint != INVALID_CODEPOINT)) {
+            break;  // Выходной буфер заполнен
+        }
+        if (codepoint == INVALID_CODEPOINT) {
+            add_error(errors, CONVERT_ERR_INVALID_UTF8, offset + (long)i, in + i, n, in[i]);
+            o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+        } else {
+            *o++ = sbcs_put(cp, codepoint, errors, offset + (long)i, in + i, n);
+        }
+        i += n;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// Перекодирование между двумя однобайтовыми кодовыми страницами
+static size_t sbcs_to_sbcs(const codepage *from, const codepage *to, const unsigned char *in, size_t len,
+                           unsigned char *out, size_t out_cap, size_t *out_len,
+                           long offset, convert_errors *errors) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+
+    for (; i < len && o < end; i++) {
+        unsigned int c = in[i];
+        if (c < 0x80) {
+            *o++ = c;
+        } else if (from->high[c - 0x80] == 0) {
+            add_error(errors, CONVERT_ERR_UNDEFINED_BYTE, offset + (long)i, in + i, 1, c);
+            o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+        } else {
+            *o++ = sbcs_put(to, from->high[c - 0x80], errors, offset + (long)i, in + i, 1);
+        }
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// UTF-32 и перестановка байтов UTF-16. Все прямые ядра принимают порядок байтов входа
+// и результата отдельно.
+
+// Чтение кодовой единицы UTF-32 с учётом порядка байтов
+static inline unsigned int load_utf32(const unsigned char *p, int little_endian) {
+    return little_endian ? (unsigned int)p[0] | (unsigned int)p[1] << 8 | (unsigned int)p[2] << 16 | (unsigned int)p[3] << 24
+                         : (unsigned int)p[3] | (unsigned int)p[2] << 8 | (unsigned int)p[1] << 16 | (unsigned int)p[0] << 24;
+}
+
+// Запись кодовой точки в UTF-32
+static inline void put_utf32(unsigned char *p, unsigned int codepoint, int little_endian) {
+    for (size_t k = 0; k < 4; k++) {
+        p[little_endian ? k : 3 - k] = (codepoint >> (8 * k)) & 0xFF;
+    }
+}
+
+// Кодовая единица UTF-32 - кодовая точка Unicode (не суррогат и не больше U+10FFFF)
+static inline int utf32_valid(unsigned int codepoint) {
+    return codepoint <= 0x10FFFF && (codepoint < 0xD800 || codepoint > 0xDFFF);
+}
+
+// Запись кодовой точки в UTF-8, возвращает количество записанных байтов
+static inline size_t put_utf8(unsigned char *p, unsigned int codepoint) {
+    if (codepoint <= 0x7F) {
+        p[0] = codepoint;
+        return 1;
+    }
+    if (codepoint <= 0x7FF) {
+        p[0] = 0xC0 | (codepoint >> 6);
+        p[1] = 0x80 | (codepoint & 0x3F);
+        return 2;
+    }
+    if (codepoint <= 0xFFFF) {
+        p[0] = 0xE0 | (codepoint >> 12);
+        p[1] = 0x80 | ((codepoint >> 6) & 0x3F);
+        p[2] = 0x80 | (codepoint & 0x3F);
+        return 3;
+    }
+    p[0] = 0xF0 | (codepoint >> 18);
+    p[1] = 0x80 | ((codepoint >> 12) & 0x3F);
+    p[2] = 0x80 | ((codepoint >> 6) & 0x3F);
+    p[3] = 0x80 | (codepoint & 0x3F);
+    return 4;
+}
+
+// Очередной символ UTF-16 с проверкой суррогатных пар (ошибки те же, что у utf16_to_utf8_block).
+// Возвращает длину обработанного участка в байтах; 0 - высокая часть пары на конце входа
+// при final == 0. Для некорректного участка *codepoint = INVALID_CODEPOINT.
+static inline size_t decode_utf16(const unsigned char *in, size_t len, size_t i, int little_endian, int final,
+                                  long offset, convert_errors *errors, unsigned int *codepoint) {
+    unsigned int wc = load_utf16(in + i, little_endian);
+    *codepoint = wc;
+    if (wc < 0xD800 || wc > 0xDFFF) {
+        return 2;
+    }
+    *codepoint = INVALID_CODEPOINT;
+    if (wc >= 0xDC00) {
+        add_error(errors, CONVERT_ERR_INVALID_HIGH_SURROGATE, offset + (long)i, in + i, 2, wc);
+        return 2;
+    }
+    if (i + 3 >= len) {
+        if (!final) {
+            return 0;
+        }
+        add_error(errors, CONVERT_ERR_INCOMPLETE_PAIR, offset + (long)i, in + i, 2, wc);
+        return 2;
+    }
+    unsigned int low_wc = load_utf16(in + i + 2, little_endian);
+    if (low_wc < 0xDC00 || low_wc > 0xDFFF) {
+        // Пропускаем только высокую часть, следующая единица обрабатывается заново
+        add_error(errors, CONVERT_ERR_INVALID_LOW_SURROGATE, offset + (long)i + 2, in + i + 2, 2, low_wc);
+        return 2;
+    }
+    *codepoint = 0x10000 + ((wc - 0xD800) << 10) + (low_wc - 0xDC00);
+    return 4;
+}
+
+// Векторное окно прямого перекодирования: перекодирует окно фиксированной ширины, если
+// в нём нет ни суррогатов, ни символов, требующих медленного пути. Возвращает количество
+// обработанных байтов входа или 0; *op сдвигается на записанный результат.
+typedef size_t (*transcode_window_fn)(const unsigned char *p, unsigned char **op, int in_le, int out_le);
+
+#ifdef CONVERT_X86
+// Перестановка байтов в 32-битных значениях (для UTF-32BE)
+TARGET_SSE2 static inline __m128i swap_bytes32_sse2(__m128i x) {
+    x = swap_bytes_sse2(x);
+    return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x, 0xB1), 0xB1);
+}
+
+// Признак 32-битных значений больше bound (без знака)
+TARGET_SSE2 static inline __m128i gt_epu32_sse2(__m128i x, unsigned int bound) {
+    __m128i bias = _mm_set1_epi32((int)0x80000000u);
+    return _mm_cmpgt_epi32(_mm_xor_si128(x, bias), _mm_set1_epi32((int)(bound ^ 0x80000000u)));
+}
+
+// Признак суррогатов среди 32-битных и 16-битных значений
+TARGET_SSE2 static inline __m128i surrogates32_sse2(__m128i x) {
+    return _mm_cmpeq_epi32(_mm_and_si128(x, _mm_set1_epi32((int)0xFFFFF800u)), _mm_set1_epi32(0xD800));
+}
+
+TARGET_SSE2 static inline __m128i surrogates16_sse2(__m128i x) {
+    return _mm_cmpeq_epi16(_mm_and_si128(x, _mm_set1_epi16((short)0xF800)), _mm_set1_epi16((short)0xD800));
+}
+
+// Окно UTF-32 в 64 байта (16 кодовых единиц) из одних ASCII -> 16 байтов UTF-8
+TARGET_SSE2 static inline size_t utf32_utf8_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)out_le;
+    __m128i v[4];
+    __m128i all = _mm_setzero_si128();
+    for (int k = 0; k < 4; k++) {
+        v[k] = _mm_loadu_si128((const __m128i *)(p + 16 * k));
+        if (!in_le) {
+            v[k] = swap_bytes32_sse2(v[k]);
+        }
+        all = _mm_or_si128(all, v[k]);
+    }
+    if (_mm_movemask_epi8(gt_epu32_sse2(all, 0x7F))) {
+        return 0;
+    }
+    // Значения меньше 0x80 упаковка с насыщением не меняет
+    __m128i packed = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+    _mm_storeu_si128((__m128i *)*op, packed);
+    *op += 16;
+    return 64;
+}
+
+// Окно UTF-8 в 16 байтов из одних ASCII -> 64 байта UTF-32
+TARGET_SSE2 static inline size_t utf8_utf32_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)in_le;
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    if (_mm_movemask_epi8(b)) {
+        return 0;
+    }
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(b, zero);
+    __m128i hi = _mm_unpackhi_epi8(b, zero);
+    __m128i v[4] = {_mm_unpacklo_epi16(lo, zero), _mm_unpackhi_epi16(lo, zero),
+                    _mm_unpacklo_epi16(hi, zero), _mm_unpackhi_epi16(hi, zero)};
+    for (int k = 0; k < 4; k++) {
+        _mm_storeu_si128((__m128i *)(*op + 16 * k), out_le ? v[k] : swap_bytes32_sse2(v[k]));
+    }
+    *op += 64;
+    return 16;
+}
+
+// Окно UTF-8 в 16 байтов из одних ASCII -> копия
+TARGET_SSE2 static inline size_t utf8_utf8_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)in_le;
+    (void)out_le;
+    __m128i b = _mm_loadu_si128((const __m128i *)p);
+    if (_mm_movemask_epi8(b)) {
+        return 0;
+    }
+    _mm_storeu_si128((__m128i *)*op, b);
+    *op += 16;
+    return 16;
+}
+
+// Окно UTF-32 в 32 байта (8 кодовых единиц) из базовой плоскости без суррогатов -> 16 байтов UTF-16
+TARGET_SSE2 static inline size_t utf32_utf16_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    if (!in_le) {
+        a = swap_bytes32_sse2(a);
+        b = swap_bytes32_sse2(b);
+    }
+    __m128i bad = _mm_or_si128(_mm_or_si128(gt_epu32_sse2(a, 0xFFFF), surrogates32_sse2(a)),
+                               _mm_or_si128(gt_epu32_sse2(b, 0xFFFF), surrogates32_sse2(b)));
+    if (_mm_movemask_epi8(bad)) {
+        return 0;
+    }
+    // Младшие 16 бит со знаком: упаковка с насыщением их не меняет
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    __m128i packed = _mm_packs_epi32(a, b);
+    _mm_storeu_si128((__m128i *)*op, out_le ? packed : swap_bytes_sse2(packed));
+    *op += 16;
+    return 32;
+}
+
+// Окно UTF-16 в 16 байтов (8 кодовых единиц) без суррогатов -> 32 байта UTF-32
+TARGET_SSE2 static inline size_t utf16_utf32_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m128i x = _mm_loadu_si128((const __m128i *)p);
+    if (!in_le) {
+        x = swap_bytes_sse2(x);
+    }
+    if (_mm_movemask_epi8(surrogates16_sse2(x))) {
+        return 0;
+    }
+    __m128i lo = _mm_unpacklo_epi16(x, _mm_setzero_si128());
+    __m128i hi = _mm_unpackhi_epi16(x, _mm_setzero_si128());
+    _mm_storeu_si128((__m128i *)*op, out_le ? lo : swap_bytes32_sse2(lo));
+    _mm_storeu_si128((__m128i *)(*op + 16), out_le ? hi : swap_bytes32_sse2(hi));
+    *op += 32;
+    return 16;
+}
+
+// Окно UTF-16 в 32 байта без суррогатов -> UTF-16 с порядком байтов out_le
+TARGET_SSE2 static inline size_t utf16_utf16_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i sa = swap_bytes_sse2(a);
+    __m128i sb = swap_bytes_sse2(b);
+    // Суррогаты ищутся в порядке байтов входа
+    __m128i bad = in_le ? _mm_or_si128(surrogates16_sse2(a), surrogates16_sse2(b))
+                        : _mm_or_si128(surrogates16_sse2(sa), surrogates16_sse2(sb));
+    if (_mm_movemask_epi8(bad)) {
+        return 0;
+    }
+    _mm_storeu_si128((__m128i *)*op, in_le == out_le ? a : sa);
+    _mm_storeu_si128((__m128i *)(*op + 16), in_le == out_le ? b : sb);
+    *op += 32;
+    return 32;
+}
+
+// Окно UTF-32 в 32 байта из корректных кодовых точек -> UTF-32 с порядком байтов out_le
+TARGET_SSE2 static inline size_t utf32_utf32_sse2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i sa = swap_bytes32_sse2(a);
+    __m128i sb = swap_bytes32_sse2(b);
+    __m128i ha = in_le ? a : sa;
+    __m128i hb = in_le ? b : sb;
+    __m128i bad = _mm_or_si128(_mm_or_si128(gt_epu32_sse2(ha, 0x10FFFF), surrogates32_sse2(ha)),
+                               _mm_or_si128(gt_epu32_sse2(hb, 0x10FFFF), surrogates32_sse2(hb)));
+    if (_mm_movemask_epi8(bad)) {
+        return 0;
+    }
+    _mm_storeu_si128((__m128i *)*op, in_le == out_le ? a : sa);
+    _mm_storeu_si128((__m128i *)(*op + 16), in_le == out_le ? b : sb);
+    *op += 32;
+    return 32;
+}
+
+TARGET_AVX2 static inline __m256i swap_bytes32_avx2(__m256i x) {
+    const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    return _mm256_shuffle_epi8(x, order);
+}
+
+// Признак 32-битных значений больше bound (без знака)
+TARGET_AVX2 static inline __m256i gt_epu32_avx2(__m256i x, unsigned int bound) {
+    __m256i limit = _mm256_set1_epi32((int)bound);
+    return _mm256_xor_si256(_mm256_cmpeq_epi32(_mm256_max_epu32(x, limit), limit), _mm256_set1_epi32(-1));
+}
+
+TARGET_AVX2 static inline __m256i surrogates32_avx2(__m256i x) {
+    return _mm256_cmpeq_epi32(_mm256_and_si256(x, _mm256_set1_epi32((int)0xFFFFF800u)), _mm256_set1_epi32(0xD800));
+}
+
+TARGET_AVX2 static inline __m256i surrogates16_avx2(__m256i x) {
+    return _mm256_cmpeq_epi16(_mm256_and_si256(x, _mm256_set1_epi16((short)0xF800)), _mm256_set1_epi16((short)0xD800));
+}
+
+// Окно UTF-32 в 128 байтов (32 кодовые единицы) из одних ASCII -> 32 байта UTF-8
+TARGET_AVX2 static inline size_t utf32_utf8_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)out_le;
+    __m256i v[4];
+    __m256i all = _mm256_setzero_si256();
+    for (int k = 0; k < 4; k++) {
+        v[k] = _mm256_loadu_si256((const __m256i *)(p + 32 * k));
+        if (!in_le) {
+            v[k] = swap_bytes32_avx2(v[k]);
+        }
+        all = _mm256_or_si256(all, v[k]);
+    }
+    if (!_mm256_testz_si256(all, _mm256_set1_epi32(~0x7F))) {
+        return 0;
+    }
+    // Упаковка идёт внутри 128-битных половин: четвёрки байтов расставляются по местам
+    __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(v[0], v[1]), _mm256_packs_epi32(v[2], v[3]));
+    packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256((__m256i *)*op, packed);
+    *op += 32;
+    return 128;
+}
+
+// Окно UTF-8 в 32 байта из одних ASCII -> 128 байтов UTF-32
+TARGET_AVX2 static inline size_t utf8_utf32_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)in_le;
+    if (_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)p))) {
+        return 0;
+    }
+    for (int k = 0; k < 4; k++) {
+        __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(p + 8 * k)));
+        _mm256_storeu_si256((__m256i *)(*op + 32 * k), out_le ? v : swap_bytes32_avx2(v));
+    }
+    *op += 128;
+    return 32;
+}
+
+// Окно UTF-8 в 32 байта из одних ASCII -> копия
+TARGET_AVX2 static inline size_t utf8_utf8_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    (void)in_le;
+    (void)out_le;
+    __m256i b = _mm256_loadu_si256((const __m256i *)p);
+    if (_mm256_movemask_epi8(b)) {
+        return 0;
+    }
+    _mm256_storeu_si256((__m256i *)*op, b);
+    *op += 32;
+    return 32;
+}
+
+// Окно UTF-32 в 64 байта (16 кодовых единиц) из базовой плоскости без суррогатов -> 32 байта UTF-16
+TARGET_AVX2 static inline size_t utf32_utf16_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    if (!in_le) {
+        a = swap_bytes32_avx2(a);
+        b = swap_bytes32_avx2(b);
+    }
+    __m256i bad = _mm256_or_si256(_mm256_or_si256(gt_epu32_avx2(a, 0xFFFF), surrogates32_avx2(a)),
+                                  _mm256_or_si256(gt_epu32_avx2(b, 0xFFFF), surrogates32_avx2(b)));
+    if (!_mm256_testz_si256(bad, bad)) {
+        return 0;
+    }
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xD8);
+    _mm256_storeu_si256((__m256i *)*op, out_le ? packed : swap_bytes_avx2(packed));
+    *op += 32;
+    return 64;
+}
+
+// Окно UTF-16 в 32 байта (16 кодовых единиц) без суррогатов -> 64 байта UTF-32
+TARGET_AVX2 static inline size_t utf16_utf32_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)p);
+    if (!in_le) {
+        x = swap_bytes_avx2(x);
+    }
+    __m256i bad = surrogates16_avx2(x);
+    if (!_mm256_testz_si256(bad, bad)) {
+        return 0;
+    }
+    __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(x));
+    __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1));
+    _mm256_storeu_si256((__m256i *)*op, out_le ? lo : swap_bytes32_avx2(lo));
+    _mm256_storeu_si256((__m256i *)(*op + 32), out_le ? hi : swap_bytes32_avx2(hi));
+    *op += 64;
+    return 32;
+}
+
+// Окно UTF-16 в 64 байта без суррогатов -> UTF-16 с порядком байтов out_le
+TARGET_AVX2 static inline size_t utf16_utf16_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i sa = swap_bytes_avx2(a);
+    __m256i sb = swap_bytes_avx2(b);
+    __m256i bad = in_le ? _mm256_or_si256(surrogates16_avx2(a), surrogates16_avx2(b))
+                        : _mm256_or_si256(surrogates16_avx2(sa), surrogates16_avx2(sb));
+    if (!_mm256_testz_si256(bad, bad)) {
+        return 0;
+    }
+    _mm256_storeu_si256((__m256i *)*op, in_le == out_le ? a : sa);
+    _mm256_storeu_si256((__m256i *)(*op + 32), in_le == out_le ? b : sb);
+    *op += 64;
+    return 64;
+}
+
+// Окно UTF-32 в 64 байта из корректных кодовых точек -> UTF-32 с порядком байтов out_le
+TARGET_AVX2 static inline size_t utf32_utf32_avx2(const unsigned char *p, unsigned char **op, int in_le, int out_le) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)p);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(p + 32));
+    __m256i sa = swap_bytes32_avx2(a);
+    __m256i sb = swap_bytes32_avx2(b);
+    __m256i ha = in_le ? a : sa;
+    __m256i hb = in_le ? b : sb;
+    __m256i bad = _mm256_or_si256(_mm256_or_si256(gt_epu32_avx2(ha, 0x10FFFF), surrogates32_avx2(ha)),
+                                  _mm256_or_si256(gt_epu32_avx2(hb, 0x10FFFF), surrogates32_avx2(hb)));
+    if (!_mm256_testz_si256(bad, bad)) {
+        return 0;
+    }
+    _mm256_storeu_si256((__m256i *)*op, in_le == out_le ? a : sa);
+    _mm256_storeu_si256((__m256i *)(*op + 32), in_le == out_le ? b : sb);
+    *op += 64;
+    return 64;
+}
+#endif
+
+// Аргументы прямого перекодирования с отдельными порядками байтов входа и результата
+#define TRANSCODE_PARAMS const unsigned char *in, size_t len, int in_le, unsigned char *out, size_t out_cap, \
+                         size_t *out_len, int out_le, long offset, int final, convert_errors *errors
+#define TRANSCODE_ARGS in, len, in_le, out, out_cap, out_len, out_le, offset, final, errors
+
+// Размер кодовой единицы UTF-8, UTF-16 или UTF-32 в байтах
+#define UTF_UNIT(encoding) ((encoding) == CONVERT_ENC_UTF32 ? 4 : (encoding) == CONVERT_ENC_UTF16 ? 2 : 1)
+
+// Длина кодовой точки в кодировке результата
+static inline size_t utf_length(int encoding, unsigned int codepoint) {
+    if (encoding == CONVERT_ENC_UTF32) {
+        return 4;
+    }
+    if (encoding == CONVERT_ENC_UTF16) {
+        return codepoint > 0xFFFF ? 4 : 2;
+    }
+    return codepoint <= 0x7F ? 1 : codepoint <= 0x7FF ? 2 : codepoint <= 0xFFFF ? 3 : 4;
+}
+
+// Прямое перекодирование между UTF-8, UTF-16 и UTF-32 (шаблон вариантов; from и to - константы,
+// лишние ветви убирает компилятор). Векторное окно пробуется, пока помещается во вход и выход;
+// окно, не прошедшее проверку, и следующие за ним width байтов разбираются медленным путём.
+static ALWAYS_INLINE size_t transcode_generic(TRANSCODE_PARAMS, int from, int to,
+                                              transcode_window_fn window, size_t width) {
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t unit = UTF_UNIT(from);
+    size_t window_out = width / unit * UTF_UNIT(to);  // Окно UTF-8 бывает только из ASCII
+    size_t i = 0;
+    size_t slow_until = 0;
+    size_t spare = replacement_size(errors, to);  // Место под замену ошибки
+    int full = 0;  // Выходной буфер заполнен
+
+    while (i + unit <= len) {
+        if (window && i >= slow_until && i + width <= len && (size_t)(end - o) >= window_out) {
+            size_t used = window(in + i, &o, in_le, out_le);
+            if (used) {
+                i += used;
+                continue;
+            }
+            slow_until = i + width;
+        }
+        if ((size_t)(end - o) < spare) {
+            full = 1;
+            break;
+        }
+
+        unsigned int codepoint;
+        size_t n;
+        if (from == CONVERT_ENC_UTF32) {
+            codepoint = load_utf32(in + i, in_le);
+            n = 4;
+            if (!utf32_valid(codepoint)) {
+                add_error(errors, CONVERT_ERR_INVALID_UTF32, offset + (long)i, in + i, 4, codepoint);
+                codepoint = INVALID_CODEPOINT;
+            }
+        } else if (from == CONVERT_ENC_UTF16) {
+            n = decode_utf16(in, len, i, in_le, final, offset, errors, &codepoint);
+            if (n == 0) {
+                break;  // Нижняя часть пары придёт в следующем блоке
+            }
+        } else {
+            n = decode_utf8(in + i, len - i, &codepoint);
+            if (n == 0) {
+                if (!final) {
+                    break;  // Окончание символа придёт в следующем блоке
+                }
+                add_error(errors, CONVERT_ERR_TRUNCATED_UTF8, offset + (long)i, in + i, len - i, in[i]);
+                o += put_replacement(errors, to, out_le, o);
+                i = len;
+                break;
+            }
+            if (codepoint == INVALID_CODEPOINT) {
+                add_error(errors, CONVERT_ERR_INVALID_UTF8, offset + (long)i, in + i, n, in[i]);
+            }
+        }
+
+        if (codepoint == INVALID_CODEPOINT) {
+            o += put_replacement(errors, to, out_le, o);
+        } else {
+            if ((size_t)(end - o) < utf_length(to, codepoint)) {
+                full = 1;
+                break;
+            }
+            if (to == CONVERT_ENC_UTF32) {
+                put_utf32(o, codepoint, out_le);
+                o += 4;
+            } else if (to == CONVERT_ENC_UTF16) {
+                o += put_utf16(o, codepoint, out_le);
+            } else {
+                o += put_utf8(o, codepoint);
+            }
+        }
+        i += n;
+    }
+
+    if (final && !full && i < len && unit > 1 && (size_t)(end - o) >= spare) {
+        // Незаконченная кодовая единица в конце входа
+        if (from == CONVERT_ENC_UTF32) {
+            add_error(errors, CONVERT_ERR_TRUNCATED_UTF32, offset + (long)i, in + i, len - i, in[i]);
+        } else {
+            add_error(errors, CONVERT_ERR_ODD_LENGTH, offset + (long)i, in + i, 1, in[i]);
+        }
+        o += put_replacement(errors, to, out_le, o);
+        i = len;
+    }
+
+    *out_len = o - out;
+    return i;
+}
+
+// Однобайтовая кодовая страница -> UTF-32 (по таблице)
+static size_t sbcs_to_utf32(const codepage *cp, TRANSCODE_PARAMS) {
+    (void)in_le;
+    (void)final;
+    unsigned char *o = out;
+    size_t i = 0;
+    for (; i < len && out_cap - (size_t)(o - out) >= 4; i++) {
+        unsigned int c = in[i];
+        unsigned int codepoint = c < 0x80 ? c : cp->high[c - 0x80];
+        if (codepoint == 0 && c != 0) {
+            add_error(errors, CONVERT_ERR_UNDEFINED_BYTE, offset + (long)i, in + i, 1, c);
+            o += put_replacement(errors, CONVERT_ENC_UTF32, out_le, o);
+            continue;
+        }
+        put_utf32(o, codepoint, out_le);
+        o += 4;
+    }
+    *out_len = o - out;
+    return i;
+}
+
+// UTF-32 -> однобайтовая кодовая страница
+static size_t utf32_to_sbcs(const codepage *cp, TRANSCODE_PARAMS) {
+    (void)out_le;
+    unsigned char *o = out;
+    unsigned char *end = out + out_cap;
+    size_t i = 0;
+    int full = 0;
+    for (; i + 4 <= len; i += 4) {
+        unsigned int codepoint = load_utf32(in + i, in_le);
+        if (o == end && (errors->replace || utf32_valid(codepoint))) {
+            full = 1;
+            break;
+        }
+        if (!utf32_valid(codepoint)) {
+            add_error(errors, CONVERT_ERR_INVALID_UTF32, offset + (long)i, in + i, 4, codepoint);
+            o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+            continue;
+        }
+        *o++ = sbcs_put(cp, codepoint, errors, offset + (long)i, in + i, 4);
+    }
+    if (final && !full && i < len && (size_t)(end - o) >= replacement_size(errors, CONVERT_ENC_CP1251)) {
+        add_error(errors, CONVERT_ERR_TRUNCATED_UTF32, offset + (long)i, in + i, len - i, in[i]);
+        o += put_replacement(errors, CONVERT_ENC_CP1251, 0, o);
+        i = len;
+    }
+    *out_len = o - out;
+    return i;
+}
+
+// Аргументы блочной функции перекодирования
+#define BLOCK_PARAMS const unsigned char *in, size_t len, int little_endian, unsigned char *out, \
+                     size_t out_cap, size_t *out_len, long offset, int final, convert_errors *errors
+#define BLOCK_ARGS in, len, little_endian, out, out_cap, out_len, offset, final, errors
+#define VALIDATE_PARAMS const unsigned char *in, size_t len, int little_endian, long offset, int final, \
+                        convert_errors *errors
+#define COUNT_PARAMS VALIDATE_PARAMS, convert_counts *counts
+
+// Блочная функция однобайтовой кодовой страницы
+typedef size_t (*sbcs_block_fn)(const codepage *cp, BLOCK_PARAMS);
+
+// Блочная функция прямого перекодирования между UTF-8, UTF-16 и UTF-32
+typedef size_t (*transcode_block_fn)(TRANSCODE_PARAMS);
+
+// Варианты блочного перекодирования под наборы инструкций
+static size_t utf16_to_utf8_scalar(BLOCK_PARAMS) {
+    return utf16_to_utf8_generic(BLOCK_ARGS, NULL, 0);
+}
+
+static size_t utf8_to_utf16_scalar(BLOCK_PARAMS) {
+    return utf8_to_utf16_generic(BLOCK_ARGS, NULL, 0);
+}
+
+static size_t utf16_validate_scalar(VALIDATE_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, NULL, NULL, 0);
+}
+
+static size_t utf8_validate_scalar(VALIDATE_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, NULL, NULL, 0);
+}
+
+static size_t utf16_count_scalar(COUNT_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, counts, NULL, 0);
+}
+
+static size_t utf8_count_scalar(COUNT_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, counts, NULL, 0);
+}
+
+static size_t sbcs_to_utf8_scalar(const codepage *cp, BLOCK_PARAMS) {
+    (void)little_endian;
+    (void)final;
+    return sbcs_to_utf8_generic(cp, in, len, out, out_cap, out_len, offset, errors, NULL, 0);
+}
+
+static size_t sbcs_to_utf16_scalar(const codepage *cp, BLOCK_PARAMS) {
+    (void)final;
+    return sbcs_to_utf16_generic(cp, in, len, little_endian, out, out_cap, out_len, offset, errors,
+                                 NULL, 0);
+}
+
+static size_t utf16_to_sbcs_scalar(const codepage *cp, BLOCK_PARAMS) {
+    return utf16_to_sbcs_generic(cp, BLOCK_ARGS, NULL, 0);
+}
+
+static size_t utf32_to_utf8_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF8, NULL, 0);
+}
+
+static size_t utf8_to_utf32_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF32, NULL, 0);
+}
+
+static size_t utf32_to_utf16_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF16, NULL, 0);
+}
+
+static size_t utf16_to_utf32_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF32, NULL, 0);
+}
+
+static size_t utf16_to_utf16_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF16, NULL, 0);
+}
+
+static size_t utf32_to_utf32_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF32, NULL, 0);
+}
+
+static size_t utf8_to_utf8_scalar(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF8, NULL, 0);
+}
+
+#ifdef CONVERT_X86
+TARGET_SSE2 static size_t utf16_to_utf8_sse2(BLOCK_PARAMS) {
+    return utf16_to_utf8_generic(BLOCK_ARGS, utf16_ascii_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf8_to_utf16_sse2(BLOCK_PARAMS) {
+    return utf8_to_utf16_generic(BLOCK_ARGS, utf8_window_sse2, 16);
+}
+
+TARGET_SSE2 static size_t utf16_validate_sse2(VALIDATE_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, NULL, utf16_surrogates_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf8_validate_sse2(VALIDATE_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, NULL, utf8_valid_sse2, 16);
+}
+
+TARGET_SSE2 static size_t utf16_count_sse2(COUNT_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, counts, utf16_surrogates_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf8_count_sse2(COUNT_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, counts, utf8_valid_sse2, 16);
+}
+
+TARGET_SSE2 static size_t sbcs_to_utf8_sse2(const codepage *cp, BLOCK_PARAMS) {
+    (void)little_endian;
+    (void)final;
+    return sbcs_to_utf8_generic(cp, in, len, out, out_cap, out_len, offset, errors, sbcs_utf8_sse2, 16);
+}
+
+TARGET_SSE2 static size_t sbcs_to_utf16_sse2(const codepage *cp, BLOCK_PARAMS) {
+    (void)final;
+    return sbcs_to_utf16_generic(cp, in, len, little_endian, out, out_cap, out_len, offset, errors,
+                                 sbcs_utf16_sse2, 16);
+}
+
+TARGET_SSE2 static size_t utf16_to_sbcs_sse2(const codepage *cp, BLOCK_PARAMS) {
+    return utf16_to_sbcs_generic(cp, BLOCK_ARGS, utf16_sbcs_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf32_to_utf8_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF8, utf32_utf8_sse2, 64);
+}
+
+TARGET_SSE2 static size_t utf8_to_utf32_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF32, utf8_utf32_sse2, 16);
+}
+
+TARGET_SSE2 static size_t utf32_to_utf16_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF16, utf32_utf16_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf16_to_utf32_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF32, utf16_utf32_sse2, 16);
+}
+
+TARGET_SSE2 static size_t utf16_to_utf16_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF16, utf16_utf16_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf32_to_utf32_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF32, utf32_utf32_sse2, 32);
+}
+
+TARGET_SSE2 static size_t utf8_to_utf8_sse2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF8, utf8_utf8_sse2, 16);
+}
+
+TARGET_AVX2 static size_t utf16_to_utf8_avx2(BLOCK_PARAMS) {
+    return utf16_to_utf8_generic(BLOCK_ARGS, utf16_ascii_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf8_to_utf16_avx2(BLOCK_PARAMS) {
+    return utf8_to_utf16_generic(BLOCK_ARGS, utf8_window_avx2, 32);
+}
+
+TARGET_AVX2 static size_t utf16_validate_avx2(VALIDATE_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, NULL, utf16_surrogates_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf8_validate_avx2(VALIDATE_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, NULL, utf8_valid_avx2, 32);
+}
+
+TARGET_AVX2 static size_t utf16_count_avx2(COUNT_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, counts, utf16_surrogates_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf8_count_avx2(COUNT_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, counts, utf8_valid_avx2, 32);
+}
+
+TARGET_AVX2 static size_t sbcs_to_utf8_avx2(const codepage *cp, BLOCK_PARAMS) {
+    (void)little_endian;
+    (void)final;
+    return sbcs_to_utf8_generic(cp, in, len, out, out_cap, out_len, offset, errors, sbcs_utf8_avx2, 32);
+}
+
+TARGET_AVX2 static size_t sbcs_to_utf16_avx2(const codepage *cp, BLOCK_PARAMS) {
+    (void)final;
+    return sbcs_to_utf16_generic(cp, in, len, little_endian, out, out_cap, out_len, offset, errors,
+                                 sbcs_utf16_avx2, 32);
+}
+
+TARGET_AVX2 static size_t utf16_to_sbcs_avx2(const codepage *cp, BLOCK_PARAMS) {
+    return utf16_to_sbcs_generic(cp, BLOCK_ARGS, utf16_sbcs_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf32_to_utf8_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF8, utf32_utf8_avx2, 128);
+}
+
+TARGET_AVX2 static size_t utf8_to_utf32_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF32, utf8_utf32_avx2, 32);
+}
+
+TARGET_AVX2 static size_t utf32_to_utf16_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF16, utf32_utf16_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf16_to_utf32_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF32, utf16_utf32_avx2, 32);
+}
+
+TARGET_AVX2 static size_t utf16_to_utf16_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF16, utf16_utf16_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf32_to_utf32_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF32, utf32_utf32_avx2, 64);
+}
+
+TARGET_AVX2 static size_t utf8_to_utf8_avx2(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF8, utf8_utf8_avx2, 32);
+}
+
+TARGET_AVX512 static size_t utf16_to_utf8_avx512(BLOCK_PARAMS) {
+    return utf16_to_utf8_generic(BLOCK_ARGS, utf16_ascii_avx512, 128);
+}
+
+TARGET_AVX512 static size_t utf8_to_utf16_avx512(BLOCK_PARAMS) {
+    return utf8_to_utf16_generic(BLOCK_ARGS, utf8_window_avx512, 64);
+}
+
+TARGET_AVX512 static size_t utf16_validate_avx512(VALIDATE_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, NULL, utf16_surrogates_avx512, 128);
+}
+
+TARGET_AVX512 static size_t utf8_validate_avx512(VALIDATE_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, NULL, utf8_valid_avx512, 64);
+}
+
+TARGET_AVX512 static size_t utf16_count_avx512(COUNT_PARAMS) {
+    return utf16_validate_generic(in, len, little_endian, offset, final, errors, counts, utf16_surrogates_avx512, 128);
+}
+
+TARGET_AVX512 static size_t utf8_count_avx512(COUNT_PARAMS) {
+    (void)little_endian;
+    return utf8_validate_generic(in, len, offset, final, errors, counts, utf8_valid_avx512, 64);
+}
+
+TARGET_AVX512 static size_t sbcs_to_utf8_avx512(const codepage *cp, BLOCK_PARAMS) {
+    (void)little_endian;
+    (void)final;
+    return sbcs_to_utf8_generic(cp, in, len, out, out_cap, out_len, offset, errors, sbcs_utf8_avx512, 64);
+}
+
+TARGET_AVX512 static size_t sbcs_to_utf16_avx512(const codepage *cp, BLOCK_PARAMS) {
+    (void)final;
+    return sbcs_to_utf16_generic(cp, in, len, little_endian, out, out_cap, out_len, offset, errors,
+                                 sbcs_utf16_avx512, 64);
+}
+
+TARGET_AVX512 static size_t utf16_to_sbcs_avx512(const codepage *cp, BLOCK_PARAMS) {
+    return utf16_to_sbcs_generic(cp, BLOCK_ARGS, utf16_sbcs_avx512, 128);
+}
+
+// Для UTF-32 и перестановки байтов достаточно окон AVX2: ядра упираются в память
+TARGET_AVX512 static size_t utf32_to_utf8_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF8, utf32_utf8_avx2, 128);
+}
+
+TARGET_AVX512 static size_t utf8_to_utf32_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF32, utf8_utf32_avx2, 32);
+}
+
+TARGET_AVX512 static size_t utf32_to_utf16_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF16, utf32_utf16_avx2, 64);
+}
+
+TARGET_AVX512 static size_t utf16_to_utf32_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF32, utf16_utf32_avx2, 32);
+}
+
+TARGET_AVX512 static size_t utf16_to_utf16_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF16, CONVERT_ENC_UTF16, utf16_utf16_avx2, 64);
+}
+
+TARGET_AVX512 static size_t utf32_to_utf32_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF32, CONVERT_ENC_UTF32, utf32_utf32_avx2, 64);
+}
+
+TARGET_AVX512 static size_t utf8_to_utf8_avx512(TRANSCODE_PARAMS) {
+    return transcode_generic(TRANSCODE_ARGS, CONVERT_ENC_UTF8, CONVERT_ENC_UTF8, utf8_utf8_avx2, 32);
+}
+
+static int sse2_supported(void) {
+    return __builtin_cpu_supports("sse2");
+}
+
+static int avx2_supported(void) {
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt");
+}
+
+static int avx512_supported(void) {
+    return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+           __builtin_cpu_supports("popcnt");
+}
+#endif
+
+static int scalar_supported(void) {
+    return 1;
+}
+
+// Реализация перекодирования под набор инструкций
+typedef struct {
+    const char *name;
+    int (*supported)(void);
+    convert_block_fn utf16_to_utf8;
+    convert_block_fn utf8_to_utf16;
+    convert_validate_fn utf16_validate;
+    convert_validate_fn utf8_validate;
+    convert_count_fn utf16_count;
+    convert_count_fn utf8_count;
+    sbcs_block_fn sbcs_to_utf8;
+    sbcs_block_fn sbcs_to_utf16;
+    sbcs_block_fn utf16_to_sbcs;
+    transcode_block_fn utf32_to_utf8;
+    transcode_block_fn utf8_to_utf32;
+    transcode_block_fn utf32_to_utf16;
+    transcode_block_fn utf16_to_utf32;
+    transcode_block_fn utf16_to_utf16;
+    transcode_block_fn utf32_to_utf32;
+    transcode_block_fn utf8_to_utf8;
+} convert_impl;
+
+// Реализации в порядке предпочтения: последняя поддерживаемая - лучшая
+static const convert_impl impls[] = {
+    {"scalar", scalar_supported, utf16_to_utf8_scalar, utf8_to_utf16_scalar,
+     utf16_validate_scalar, utf8_validate_scalar, utf16_count_scalar, utf8_count_scalar,
+     sbcs_to_utf8_scalar, sbcs_to_utf16_scalar, utf16_to_sbcs_scalar,
+     utf32_to_utf8_scalar, utf8_to_utf32_scalar, utf32_to_utf16_scalar, utf16_to_utf32_scalar,
+     utf16_to_utf16_scalar, utf32_to_utf32_scalar, utf8_to_utf8_scalar},
+#ifdef CONVERT_X86
+    {"sse2", sse2_supported, utf16_to_utf8_sse2, utf8_to_utf16_sse2,
+     utf16_validate_sse2, utf8_validate_sse2, utf16_count_sse2, utf8_count_sse2,
+     sbcs_to_utf8_sse2, sbcs_to_utf16_sse2, utf16_to_sbcs_sse2,
+     utf32_to_utf8_sse2, utf8_to_utf32_sse2, utf32_to_utf16_sse2, utf16_to_utf32_sse2,
+     utf16_to_utf16_sse2, utf32_to_utf32_sse2, utf8_to_utf8_sse2},
+    {"avx2", avx2_supported, utf16_to_utf8_avx2, utf8_to_utf16_avx2,
+     utf16_validate_avx2, utf8_validate_avx2, utf16_count_avx2, utf8_count_avx2,
+     sbcs_to_utf8_avx2, sbcs_to_utf16_avx2, utf16_to_sbcs_avx2,
+     utf32_to_utf8_avx2, utf8_to_utf32_avx2, utf32_to_utf16_avx2, utf16_to_utf32_avx2,
+     utf16_to_utf16_avx2, utf32_to_utf32_avx2, utf8_to_utf8_avx2},
+    {"avx512", avx512_supported, utf16_to_utf8_avx512, utf8_to_utf16_avx512,
+     utf16_validate_avx512, utf8_validate_avx512, utf16_count_avx512, utf8_count_avx512,
+     sbcs_to_utf8_avx512, sbcs_to_utf16_avx512, utf16_to_sbcs_avx512,
+     utf32_to_utf8_avx512, utf8_to_utf32_avx512, utf32_to_utf16_avx512, utf16_to_utf32_avx512,
+     utf16_to_utf16_avx512, utf32_to_utf32_avx512, utf8_to_utf8_avx512},
+#endif
+};
+
+#define IMPL_COUNT (sizeof(impls) / sizeof(impls[0]))
+
+static const convert_impl *current_impl = &impls[0];
+
+// Выбор лучшей реализации: при загрузке программы или библиотеки, до запуска потоков
+__attribute__((constructor)) static void detect_impl(void) {
+#ifdef CONVERT_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t k = 0; k < IMPL_COUNT; k++) {
+        if (impls[k].supported()) {
+            current_impl = &impls[k];
+        }
+    }
+}
+
+size_t convert_impl_count(void) {
+    return IMPL_COUNT;
+}
+
+const char *convert_impl_name(size_t index) {
+    return index < IMPL_COUNT ? impls[index].name : NULL;
+}
+
+int convert_impl_supported(size_t index) {
+    return index < IMPL_COUNT && impls[index].supported();
+}
+
+const char *convert_current_impl(void) {
+    return current_impl->name;
+}
+
+// Выбор реализации по имени: NULL или "auto" - лучшая из поддерживаемых
+int convert_select_impl(const char *name) {
+    if (name == NULL || strcmp(name, "auto") == 0) {
+        detect_impl();
+        return 0;
+    }
+    for (size_t k = 0; k < IMPL_COUNT; k++) {
+        if (strcmp(impls[k].name, name) == 0) {
+            if (!impls[k].supported()) {
+                return -1;
+            }
+            current_impl = &impls[k];
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Блочное перекодирование UTF-16 -> UTF-8 выбранной реализацией
+size_t utf16_to_utf8_block(BLOCK_PARAMS) {
+    return current_impl->utf16_to_utf8(BLOCK_ARGS);
+}
+
+// Блочное перекодирование UTF-8 -> UTF-16 выбранной реализацией
+size_t utf8_to_utf16_block(BLOCK_PARAMS) {
+    return current_impl->utf8_to_utf16(BLOCK_ARGS);
+}
+
+// Проверка UTF-16 без перекодирования выбранной реализацией
+size_t utf16_validate_block(VALIDATE_PARAMS) {
+    return current_impl->utf16_validate(in, len, little_endian, offset, final, errors);
+}
+
+// Проверка UTF-8 без перекодирования выбранной реализацией
+size_t utf8_validate_block(VALIDATE_PARAMS) {
+    return current_impl->utf8_validate(in, len, little_endian, offset, final, errors);
+}
+
+size_t utf16_count_block(COUNT_PARAMS) {
+    return current_impl->utf16_count(in, len, little_endian, offset, final, errors, counts);
+}
+
+size_t utf8_count_block(COUNT_PARAMS) {
+    return current_impl->utf8_count(in, len, little_endian, offset, final, errors, counts);
+}
+
+// Имена кодировок для -f и -t; little_endian -1 - порядок байтов не указан
+static const struct {
+    const char *name;
+    int encoding;
+    int little_endian;
+} encoding_names[] = {
+    {"utf-8", CONVERT_ENC_UTF8, -1},
+    {"utf8", CONVERT_ENC_UTF8, -1},
+    {"utf-16", CONVERT_ENC_UTF16, -1},
+    {"utf16", CONVERT_ENC_UTF16, -1},
+    {"utf-16le", CONVERT_ENC_UTF16, 1},
+    {"utf16le", CONVERT_ENC_UTF16, 1},
+    {"utf-16be", CONVERT_ENC_UTF16, 0},
+    {"utf16be", CONVERT_ENC_UTF16, 0},
+    {"utf-32", CONVERT_ENC_UTF32, -1},
+    {"utf32", CONVERT_ENC_UTF32, -1},
+    {"utf-32le", CONVERT_ENC_UTF32, 1},
+    {"utf32le", CONVERT_ENC_UTF32, 1},
+    {"utf-32be", CONVERT_ENC_UTF32, 0},
+    {"utf32be", CONVERT_ENC_UTF32, 0},
+    {"cp1251", CONVERT_ENC_CP1251, -1},
+    {"windows-1251", CONVERT_ENC_CP1251, -1},
+    {"koi8-r", CONVERT_ENC_KOI8R, -1},
+    {"koi8r", CONVERT_ENC_KOI8R, -1},
+    {"cp866", CONVERT_ENC_CP866, -1},
+    {"ibm866", CONVERT_ENC_CP866, -1},
+    {"iso-8859-1", CONVERT_ENC_ISO8859_1, -1},
+    {"latin1", CONVERT_ENC_ISO8859_1, -1},
+    {"iso-8859-5", CONVERT_ENC_ISO8859_5, -1},
+    {"auto", CONVERT_ENC_AUTO, -1},
+};
+
+// Кодировка по имени без учёта регистра
+int convert_encoding(const char *name, int *little_endian) {
+    for (size_t k = 0; k < sizeof(encoding_names) / sizeof(encoding_names[0]); k++) {
+        if (strcasecmp(encoding_names[k].name, name) == 0) {
+            if (encoding_names[k].little_endian >= 0) {
+                *little_endian = encoding_names[k].little_endian;
+            }
+            return encoding_names[k].encoding;
+        }
+    }
+    return -1;
+}
+
+const char *convert_encoding_name(int encoding) {
+    static const char *const names[] = {"UTF-8", "UTF-16", "UTF-32", "CP1251", "KOI8-R", "CP866",
+                                        "ISO-8859-1", "ISO-8859-5"};
+    return encoding >= 0 && encoding < CONVERT_ENC_COUNT ? names[encoding] : NULL;
+}
+
+unsigned int convert_sbcs_char(int encoding, unsigned char byte) {
+    return byte < 0x80 ? byte : codepages[encoding - CONVERT_ENC_CP1251].high[byte - 0x80];
+}
+
+// Кодовая единица UTF-32 для статистики convert_detect
+static int utf32_sample_valid(const unsigned char *buf, size_t len, int little_endian) {
+    for (size_t k = 0; k + 4 <= len; k += 4) {
+        if (!utf32_valid(load_utf32(buf + k, little_endian))) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Начало буфера - корректный UTF-16 (оборванная на конце пара ошибкой не считается)
+static int utf16_sample_valid(const unsigned char *buf, size_t len, int little_endian) {
+    convert_errors errors = {NULL, 0, 0, NULL, NULL, 0};
+    utf16_validate_block(buf, len, little_endian, 0, 0, &errors);
+    return errors.count == 0;
+}
+
+// Определение кодировки по началу входа
+int convert_detect(const unsigned char *buf, size_t len, int *little_endian) {
+    if (utf32_bom(buf, len, little_endian)) {
+        return CONVERT_ENC_UTF32;  // FF FE 00 00 проверяется раньше BOM UTF-16LE
+    }
+    if (utf16_bom(buf, len, little_endian)) {
+        return CONVERT_ENC_UTF16;
+    }
+    if (utf8_bom(buf, len)) {
+        return CONVERT_ENC_UTF8;
+    }
+
+    // Нулевые байты по позициям внутри четвёрок: у UTF-32 старший байт нулевой всегда.
+    // Управляющие байты (кроме табуляции и перевода строки) по чётности позиций: у UTF-16
+    // с латиницей, кириллицей, греческим и т. п. старший байт кодовой единицы меньше 0x20.
+    size_t zeros[4] = {0, 0, 0, 0};
+    size_t control[2] = {0, 0};
+    for (size_t k = 0; k < len; k++) {
+        zeros[k & 3] += buf[k] == 0;
+        control[k & 1] += buf[k] < 0x20 && buf[k] != '\t' && buf[k] != '\n' && buf[k] != '\r';
+    }
+    size_t units32 = len / 4;
+    if (units32 && zeros[3] >= units32 && zeros[0] < units32 / 2 && utf32_sample_valid(buf, len, 1)) {
+        *little_endian = 1;
+        return CONVERT_ENC_UTF32;
+    }
+    if (units32 && zeros[0] >= units32 && zeros[3] < units32 / 2 && utf32_sample_valid(buf, len, 0)) {
+        *little_endian = 0;
+        return CONVERT_ENC_UTF32;
+    }
+    size_t units16 = len / 2;
+    for (int le = 1; le >= 0; le--) {
+        // Старший байт UTF-16LE - на нечётных позициях
+        if (units16 && control[le] * 2 >= units16 && control[!le] * 2 < control[le] &&
+            utf16_sample_valid(buf, len, le)) {
+            *little_endian = le;
+            return CONVERT_ENC_UTF16;
+        }
+    }
+
+    convert_errors errors = {NULL, 0, 0, NULL, NULL, 0};
+    utf8_validate_block(buf, len, 1, 0, 0, &errors);
+    if (errors.count == 0) {
+        return CONVERT_ENC_UTF8;  // В том числе чистый ASCII
+    }
+
+    // Однобайтовая кодовая страница: побеждает та, в которой больше всего старших байтов -
+    // строчные буквы кириллицы (их в тексте большинство)
+    size_t counts[128] = {0};
+    size_t high = 0;
+    size_t latin = 0;
+    for (size_t k = 0; k < len; k++) {
+        if (buf[k] >= 0x80) {
+            counts[buf[k] - 0x80]++;
+            high++;
+        }
+        latin += (buf[k] | 0x20) >= 'a' && (buf[k] | 0x20) <= 'z';
+    }
+    int best = CONVERT_ENC_ISO8859_1;
+    size_t best_score = 0;
+    static const int candidates[] = {CONVERT_ENC_CP1251, CONVERT_ENC_KOI8R, CONVERT_ENC_CP866, CONVERT_ENC_ISO8859_5};
+    for (size_t c = 0; c < sizeof(candidates) / sizeof(candidates[0]); c++) {
+        const codepage *cp = &codepages[candidates[c] - CONVERT_ENC_CP1251];
+        size_t score = 0;
+        for (size_t b = 0; b < 128; b++) {
+            unsigned int codepoint = cp->high[b];
+            if ((codepoint >= 0x0430 && codepoint <= 0x044F) || codepoint == 0x0451) {
+                score += counts[b];
+            }
+        }
+        if (score > best_score) {
+            best = candidates[c];
+            best_score = score;
+        }
+    }
+
+    // UTF-16 с иероглифами: большинство кодовых единиц, кроме ASCII, - из блоков CJK и хангыля,
+    // а у старших байтов заметно меньше разных значений, чем у младших. Суррогаты в счёт не
+    // идут: пары строчных букв KOI8-R (0xC0-0xDF) выглядят как они. Без BOM такой UTF-16
+    // принимается, только если в нём есть символы ASCII (пробелы, переводы строк, цифры) -
+    // кодовые единицы с нулевым старшим байтом на своих позициях, - и если текст не читается
+    // как кириллица однобайтовой кодовой страницы: у неё почти все старшие байты - строчные
+    // буквы, у иероглифов - около половины.
+    int cyrillic = high && best_score * 4 >= high * 3;
+    uint64_t seen[2][4] = {{0}};
+    size_t distinct[2] = {0, 0};
+    size_t cjk[2] = {0, 0};
+    size_t ascii[2] = {0, 0};
+    for (size_t k = 0; k + 1 < len && !cyrillic; k++) {
+        uint64_t *set = seen[k & 1];
+        uint64_t bit = 1ULL << (buf[k] & 63);
+        if (!(set[buf[k] >> 6] & bit)) {
+            set[buf[k] >> 6] |= bit;
+            distinct[k & 1]++;
+        }
+        if (!(k & 1)) {
+            for (int le = 0; le < 2; le++) {
+                unsigned int wc = load_utf16(buf + k, le);
+                cjk[le] += (wc >= 0x3000 && wc <= 0x9FFF) || (wc >= 0xAC00 && wc <= 0xD7FF) || (wc >= 0xFF00 && wc <= 0xFFEF);
+                ascii[le] += (wc >= 0x20 && wc < 0x7F) || wc == '\t' || wc == '\n' || wc == '\r';
+            }
+        }
+    }
+    for (int le = 1; le >= 0 && !cyrillic; le--) {
+        int cjk_text = units16 >= 4 && cjk[le] * 4 >= (units16 - ascii[le]) * 3 && cjk[!le] < cjk[le];
+        int few_high = units16 >= 64 && distinct[le] * 2 <= distinct[!le];
+        if ((cjk_text || few_high) && ascii[le] > ascii[!le] && utf16_sample_valid(buf, len, le)) {
+            *little_endian = le;
+            return CONVERT_ENC_UTF16;
+        }
+    }
+
+    if (high < latin) {
+        return CONVERT_ENC_ISO8859_1;  // Латиница с отдельными символами с диакритикой
+    }
+    // Старшие байты, среди которых строчные буквы кириллицы не преобладают, - тоже Latin-1
+    return best_score * 2 >= high ? best : CONVERT_ENC_ISO8859_1;
+}
+
+// Блочное перекодирование между любыми двумя кодировками выбранной реализацией
+size_t convert_block(int from, int to, const unsigned char *in, size_t len, int in_le,
+                     unsigned char *out, size_t out_cap, size_t *out_len, int out_le,
+                     long offset, int final, convert_errors *errors) {
+    if (from == CONVERT_ENC_UTF16 && to == CONVERT_ENC_UTF8) {
+        return utf16_to_utf8_block(in, len, in_le, out, out_cap, out_len, offset, final, errors);
+    }
+    if (from == CONVERT_ENC_UTF8 && to == CONVERT_ENC_UTF16) {
+        return utf8_to_utf16_block(in, len, out_le, out, out_cap, out_len, offset, final, errors);
+    }
+    if (from == CONVERT_ENC_UTF32 && to == CONVERT_ENC_UTF8) {
+        return current_impl->utf32_to_utf8(TRANSCODE_ARGS);
+    }
+    if (from == CONVERT_ENC_UTF8 && to == CONVERT_ENC_UTF32) {
+        return current_impl->utf8_to_utf32(TRANSCODE_ARGS);
+    }
+    if (from == CONVERT_ENC_UTF32 && to == CONVERT_ENC_UTF16) {
+        return current_impl->utf32_to_utf16(TRANSCODE_ARGS);
+    }
+    if (from == CONVERT_ENC_UTF16 && to == CONVERT_ENC_UTF32) {
+        return current_impl->utf16_to_utf32(TRANSCODE_ARGS);
+    }
+    if (from == to && from == CONVERT_ENC_UTF16) {
+        return current_impl->utf16_to_utf16(TRANSCODE_ARGS);
+    }
+    if (from == to && from == CONVERT_ENC_UTF32) {
+        return current_impl->utf32_to_utf32(TRANSCODE_ARGS);
+    }
+    if (from == to && from == CONVERT_ENC_UTF8) {
+        // Проверка с копированием корректных последовательностей (вход, определённый как UTF-8)
+        return current_impl->utf8_to_utf8(TRANSCODE_ARGS);
+    }
+    if (from >= CONVERT_ENC_CP1251) {
+        const codepage *cp = &codepages[from - CONVERT_ENC_CP1251];
+        if (to == CONVERT_ENC_UTF8) {
+            return current_impl->sbcs_to_utf8(cp, in, len, out_le, out, out_cap, out_len, offset, final, errors);
+        }
+        if (to == CONVERT_ENC_UTF16) {
+            return current_impl->sbcs_to_utf16(cp, in, len, out_le, out, out_cap, out_len, offset, final, errors);
+        }
+        if (to == CONVERT_ENC_UTF32) {
+            return sbcs_to_utf32(cp, TRANSCODE_ARGS);
+        }
+        return sbcs_to_sbcs(cp, &codepages[to - CONVERT_ENC_CP1251], in, len, out, out_cap, out_len, offset, errors);
+    }
+    const codepage *cp = &codepages[to - CONVERT_ENC_CP1251];
+    if (from == CONVERT_ENC_UTF16) {
+        return current_impl->utf16_to_sbcs(cp, in, len, in_le, out, out_cap, out_len, offset, final, errors);
+    }
+    if (from == CONVERT_ENC_UTF32) {
+        return utf32_to_sbcs(cp, TRANSCODE_ARGS);
+    }
+    return utf8_to_sbcs(cp, in, len, out, out_cap, out_len, offset, final, errors);
+}
+
+// Длина UTF-8 для буфера UTF-16
+size_t utf8_length_from_utf16(const unsigned char *in, size_t len, int little_endian) {
+    convert_errors errors = {NULL, 0, 0, NULL, NULL, 0};
+    convert_counts counts = {0, 0};
+    utf16_count_block(in, len, little_endian, 0, 1, &errors, &counts);
+    return counts.units;
+}
+
+// Длина UTF-16 в кодовых единицах для буфера UTF-8
+size_t utf16_length_from_utf8(const unsigned char *in, size_t len) {
+    convert_errors errors = {NULL, 0, 0, NULL, NULL, 0};
+    convert_counts counts = {0, 0};
+    utf8_count_block(in, len, 1, 0, 1, &errors, &counts);
+    return counts.units;
+}
+
+// Ближайшая граница не меньше pos, не разрывающая суррогатную пару UTF-16
+size_t utf16_boundary(const unsigned char *data, size_t size, size_t pos, int little_endian) {
+    pos &= ~(size_t)1;
+    while (pos >= 2 && pos < size) {
+        unsigned int wc = load_utf16(data + pos - 2, little_endian);
+        if (wc < 0xD800 || wc > 0xDBFF) {
+            break;
+        }
+        pos += 2;  // Не отделяем высокую часть пары от следующей кодовой единицы
+    }
+    return pos < size ? pos : size;
+}
+
+// Ближайшая граница не меньше pos, не разрывающая многобайтовую последовательность UTF-8
+size_t utf8_boundary(const unsigned char *data, size_t size, size_t pos, int little_endian) {
+    (void)little_endian;
+    while (pos < size && (data[pos] & 0xC0) == 0x80) {
+        pos++;
+    }
+    return pos < size ? pos : size;
+}
+
+// Порядок байтов текущей машины
+static int host_little_endian(void) {
+    const uint16_t one = 1;
+    return *(const unsigned char *)&one == 1;
+}
+
+// Перекодирование UTF-16 (кодовые единицы в порядке байтов машины) -> UTF-8
+convert_result convert_utf16_to_utf8(const uint16_t *in, size_t in_len, uint8_t *out, size_t out_len,
+                                     int final, convert_errors *errors) {
+    convert_errors ignored = {NULL, 0, 0, NULL, NULL, 0};
+    if (!errors) {
+        errors = &ignored;
+    }
+    size_t errors_before = errors->count;
+
+    size_t produced;
+    size_t used = utf16_to_utf8_block((const unsigned char *)in, in_len * 2, host_little_endian(),
+                                      out, out_len, &produced, 0, final, errors);
+
+    convert_result result = {used / 2, produced, errors->count - errors_before};
+    return result;
+}
+
+// Перекодирование UTF-8 -> UTF-16 (кодовые единицы в порядке байтов машины)
+convert_result convert_utf8_to_utf16(const uint8_t *in, size_t in_len, uint16_t *out, size_t out_len,
+                                     int final, convert_errors *errors) {
+    convert_errors ignored = {NULL, 0, 0, NULL, NULL, 0};
+    if (!errors) {
+        errors = &ignored;
+    }
+    size_t errors_before = errors->count;
+
+    size_t produced;
+    size_t used = utf8_to_utf16_block(in, in_len, host_little_endian(), (unsigned char *)out, out_len * 2,
+                                      &produced, 0, final, errors);
+
+    convert_result result = {used, produced / 2, errors->count - errors_before};
+    return result;
+}
+
+// Функция для подготовки декодера
+void convert_decoder_init(convert_decoder *dec, int direction, int little_endian) {
+    if (direction == CONVERT_UTF16_TO_UTF8) {
+        convert_decoder_init_pair(dec, CONVERT_ENC_UTF16, CONVERT_ENC_UTF8, little_endian, little_endian);
+    } else {
+        convert_decoder_init_pair(dec, CONVERT_ENC_UTF8, CONVERT_ENC_UTF16, little_endian, little_endian);
+    }
+}
+
+// BOM бывает только у UTF-8, UTF-16 и UTF-32
+static int has_bom(int encoding) {
+    return encoding == CONVERT_ENC_UTF8 || encoding == CONVERT_ENC_UTF16 || encoding == CONVERT_ENC_UTF32;
+}
+
+void convert_decoder_init_pair(convert_decoder *dec, int from, int to, int in_le, int out_le) {
+    dec->from = from;
+    dec->to = to;
+    dec->little_endian = in_le;
+    dec->out_little_endian = out_le;
+    dec->bom_phase = has_bom(from);
+    dec->bom_found = 0;
+    dec->sample_len = 0;
+    dec->pending_len = 0;
+    dec->offset = 0;
+    dec->on_error = CONVERT_ON_ERROR_SKIP;
+    dec->aborted = 0;
+}
+
+// Длина BOM кодировки входа
+static size_t bom_max(int encoding) {
+    return encoding == CONVERT_ENC_UTF32 ? 4 : encoding == CONVERT_ENC_UTF16 ? 2 : 3;
+}
+
+// Проверка начала потока на BOM, когда накоплено достаточно байтов (или поток кончился)
+static void decoder_check_bom(convert_decoder *dec, int at_end) {
+    if (dec->pending_len < bom_max(dec->from) && !at_end) {
+        return;
+    }
+
+    size_t bom = dec->from == CONVERT_ENC_UTF32 ? (size_t)utf32_bom(dec->pending, dec->pending_len, &dec->little_endian)
+               : dec->from == CONVERT_ENC_UTF16 ? (size_t)utf16_bom(dec->pending, dec->pending_len, &dec->little_endian)
+               : (size_t)utf8_bom(dec->pending, dec->pending_len);
+    if (bom) {
+        memmove(dec->pending, dec->pending + bom, dec->pending_len - bom);
+        dec->pending_len -= bom;
+        dec->offset += bom;
+        dec->bom_found = (int)bom;
+    }
+    dec->bom_phase = 0;
+}
+
+// Участки входа, которые декодер при остановке проверяет за один вызов
+#define DECODER_WINDOW 4096
+
+// Перекодирование участка in (смещение offset) с учётом dec->on_error. При пропуске и замене
+// это просто convert_block: символ замены на месте ошибки пишет само перекодирование. При
+// остановке вход идёт окнами: окно без ошибок перекодируется за один вызов, а у окна с
+// ошибкой повторно перекодируется кусок до первой из них.
+static size_t decoder_convert(convert_decoder *dec, const unsigned char *in, size_t len, long offset,
+                              unsigned char *out, size_t out_cap, size_t *out_len, int final,
+                              convert_errors *errors) {
+    if (dec->on_error != CONVERT_ON_ERROR_ABORT) {
+        int replace = errors->replace;
+        errors->replace = dec->on_error == CONVERT_ON_ERROR_REPLACE;
+        size_t used = convert_block(dec->from, dec->to, in, len, dec->little_endian, out, out_cap, out_len,
+                                    dec->out_little_endian, offset, final, errors);
+        errors->replace = replace;
+        return used;
+    }
+
+    size_t pos = 0;
+    size_t o = 0;
+    while (pos < len && !dec->aborted) {
+        size_t n = len - pos < DECODER_WINDOW ? len - pos : DECODER_WINDOW;
+        int last = pos + n == len;
+        convert_error first;
+        convert_errors found = {&first, 1, 0, NULL, NULL, 0};
+        size_t produced;
+        size_t used = convert_block(dec->from, dec->to, in + pos, n, dec->little_endian, out + o, out_cap - o,
+                                    &produced, dec->out_little_endian, offset + (long)pos, final && last, &found);
+        if (found.count == 0) {
+            o += produced;
+            pos += used;
+            if (used < n && (last || used == 0)) {
+                break;  // Незаконченная последовательность в конце входа или нет места
+            }
+            continue;
+        }
+
+        // Кусок до ошибки; у нижней части пары ошибочна предшествующая ей высокая
+        size_t start = (size_t)(first.offset - offset);
+        if (first.kind == CONVERT_ERR_INVALID_LOW_SURROGATE) {
+            start -= 2;
+        }
+        convert_errors none = {NULL, 0, 0, NULL, NULL, 0};
+        size_t part = convert_block(dec->from, dec->to, in + pos, start - pos, dec->little_endian, out + o,
+                                    out_cap - o, &produced, dec->out_little_endian, offset + (long)pos, 1, &none);
+        o += produced;
+        if (part < start - pos) {
+            // Не хватило места: остаток будет подан повторно
+            *out_len = o;
+            return pos + part;
+        }
+        push_error(errors, &first);
+        dec->aborted = 1;
+        break;
+    }
+
+    *out_len = o;
+    return dec->aborted ? len : pos;
+}
+
+// Подача фрагмента, когда кодировка входа уже известна
+static size_t decoder_push(convert_decoder *dec, const unsigned char *in, size_t len,
+                           unsigned char *out, size_t out_cap, size_t *out_len, convert_errors *errors) {
+    size_t consumed = 0;
+    *out_len = 0;
+
+    if (dec->aborted) {
+        return len;
+    }
+    if (dec->bom_phase) {
+        // Байты BOM копятся в pending, пока их не хватит для проверки
+        while (dec->pending_len < bom_max(dec->from) && consumed < len) {
+            dec->pending[dec->pending_len++] = in[consumed++];
+        }
+        decoder_check_bom(dec, 0);
+        if (dec->bom_phase) {
+            return consumed;
+        }
+    }
+
+    if (dec->pending_len) {
+        // Достраиваем сохранённую последовательность байтами нового фрагмента
+        unsigned char tmp[16];
+        size_t take = len - consumed < sizeof(tmp) - dec->pending_len ? len - consumed : sizeof(tmp) - dec->pending_len;
+        memcpy(tmp, dec->pending, dec->pending_len);
+        memcpy(tmp + dec->pending_len, in + consumed, take);
+
+        size_t produced;
+        size_t used = decoder_convert(dec, tmp, dec->pending_len + take, dec->offset, out, out_cap, &produced,
+                                      0, errors);
+        *out_len += produced;
+        dec->offset += used;
+
+        if (used >= dec->pending_len) {
+            consumed += used - dec->pending_len;
+            dec->pending_len = 0;
+        } else {
+            // Остановились внутри сохранённых байтов: либо фрагмент кончился, либо нет места
+            memmove(dec->pending, dec->pending + used, dec->pending_len - used);
+            dec->pending_len -= used;
+            if (consumed + take == len && dec->pending_len + take < 4) {
+                memcpy(dec->pending + dec->pending_len, in + consumed, take);
+                dec->pending_len += take;
+                consumed = len;
+            }
+            return consumed;
+        }
+    }
+
+    size_t produced;
+    size_t used = decoder_convert(dec, in + consumed, len - consumed, dec->offset, out + *out_len,
+                                  out_cap - *out_len, &produced, 0, errors);
+    *out_len += produced;
+    dec->offset += used;
+    consumed += used;
+
+    // Незаконченная последовательность всегда короче 4 байтов; более длинный остаток
+    // означает, что не хватило места в выходном буфере
+    if (len - consumed < 4) {
+        memcpy(dec->pending, in + consumed, len - consumed);
+        dec->pending_len = len - consumed;
+        consumed = len;
+    }
+    return consumed;
+}
+
+// Определение кодировки входа по buf (BOM затем проверяется как обычно)
+static void decoder_detect(convert_decoder *dec, const unsigned char *buf, size_t len) {
+    dec->from = convert_detect(buf, len, &dec->little_endian);
+    dec->bom_phase = has_bom(dec->from);
+}
+
+// Определение кодировки по накопленному образцу и перекодирование образца
+static size_t decoder_flush_sample(convert_decoder *dec, unsigned char *out, size_t out_cap, convert_errors *errors) {
+    size_t produced;
+    decoder_detect(dec, dec->sample, dec->sample_len);
+    decoder_push(dec, dec->sample, dec->sample_len, out, out_cap, &produced, errors);
+    dec->sample_len = 0;
+    return produced;
+}
+
+// Подача очередного фрагмента
+size_t convert_decoder_push(convert_decoder *dec, const unsigned char *in, size_t len,
+                            unsigned char *out, size_t out_cap, size_t *out_len, convert_errors *errors) {
+    if (dec->from != CONVERT_ENC_AUTO) {
+        return decoder_push(dec, in, len, out, out_cap, out_len, errors);
+    }
+    if (dec->sample_len == 0 && len >= CONVERT_DETECT_SAMPLE) {
+        // Большой первый фрагмент: кодировка определяется по нему целиком
+        decoder_detect(dec, in, len);
+        return decoder_push(dec, in, len, out, out_cap, out_len, errors);
+    }
+
+    // Мелкие фрагменты копятся, пока не наберётся образец
+    size_t take = len < CONVERT_DETECT_SAMPLE - dec->sample_len ? len : CONVERT_DETECT_SAMPLE - dec->sample_len;
+    memcpy(dec->sample + dec->sample_len, in, take);
+    dec->sample_len += take;
+    *out_len = 0;
+    if (dec->sample_len < CONVERT_DETECT_SAMPLE) {
+        return len;
+    }
+    size_t produced = decoder_flush_sample(dec, out, out_cap, errors);
+    size_t used = decoder_push(dec, in + take, len - take, out + produced, out_cap - produced, out_len, errors);
+    *out_len += produced;
+    return take + used;
+}
+
+// Завершение потока
+void convert_decoder_finish(convert_decoder *dec, unsigned char *out, size_t out_cap, size_t *out_len,
+                            convert_errors *errors) {
+    size_t produced = 0;
+    if (dec->from == CONVERT_ENC_AUTO) {
+        // Вход короче образца (или пустой)
+        produced = decoder_flush_sample(dec, out, out_cap, errors);
+    }
+    if (dec->bom_phase) {
+        decoder_check_bom(dec, 1);
+    }
+
+    size_t used = decoder_convert(dec, dec->pending, dec->pending_len, dec->offset, out + produced,
+                                  out_cap - produced, out_len, 1, errors);
+    *out_len += produced;
+    dec->offset += used;
+    memmove(dec->pending, dec->pending + used, dec->pending_len - used);
+    dec->pending_len -= used;
+}
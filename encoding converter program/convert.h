@@ -2,6 +2,17 @@
 #define CONVERT_H
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Размер входного блока для блочного перекодирования
+#define CONVERT_BLOCK_SIZE (256 * 1024)
+
+// Максимальный размер UTF-8 для len байтов UTF-16 (3 байта на кодовую единицу)
+#define UTF8_MAX_FROM_UTF16(len) ((len) / 2 * 3)
+
+// Максимальный размер UTF-16 для len байтов UTF-8 (2 байта на каждый байт ASCII)
+#define UTF16_MAX_FROM_UTF8(len) ((len) * 2)
 
 // Функция для записи символов UTF-8 в файл
 void write_utf8(FILE *out, unsigned int codepoint);
@@ -18,4 +29,249 @@ void write_utf16(FILE *out, unsigned int codepoint, int little_endian);
 // Функция для чтения UTF-8 символов
 unsigned int read_utf8_char(FILE *in);
 
+// Виды ошибок во входных данных
+#define CONVERT_ERR_INVALID_UTF8 1            // Некорректная последовательность UTF-8
+#define CONVERT_ERR_TRUNCATED_UTF8 2          // Последовательность UTF-8 оборвана концом входа
+#define CONVERT_ERR_INVALID_LOW_SURROGATE 3   // После высокой части пары нет нижней
+#define CONVERT_ERR_INVALID_HIGH_SURROGATE 4  // Нижняя часть пары без высокой
+#define CONVERT_ERR_INCOMPLETE_PAIR 5         // Высокая часть пары в конце входа
+#define CONVERT_ERR_ODD_LENGTH 6              // Нечётное количество байтов UTF-16
+#define CONVERT_ERR_UNDEFINED_BYTE 7          // Байт, не определённый в однобайтовой кодировке входа
+#define CONVERT_ERR_UNMAPPABLE 8              // Символа нет в однобайтовой кодировке результата
+#define CONVERT_ERR_INVALID_UTF32 9           // Кодовая единица UTF-32 - суррогат или больше U+10FFFF
+#define CONVERT_ERR_TRUNCATED_UTF32 10        // Кодовая единица UTF-32 оборвана концом входа
+#define CONVERT_ERR_KINDS 11                  // Размер массива счётчиков, индексируемого видом ошибки
+
+// Ошибка во входных данных
+typedef struct {
+    long offset;             // Смещение некорректного участка от начала входа в байтах
+    int kind;                // Вид ошибки (CONVERT_ERR_*)
+    unsigned int value;      // Кодовая единица UTF-16 или UTF-32, первый байт участка или кодовая точка
+    unsigned char bytes[4];  // Байты некорректного участка
+    unsigned char length;    // Длина участка в байтах
+} convert_error;
+
+// Список ошибок: массив предоставляет вызывающий, функции перекодирования память не выделяют
+typedef struct {
+    convert_error *list;  // Массив для ошибок (может быть NULL)
+    size_t capacity;      // Ёмкость массива
+    size_t count;         // Всего найдено ошибок (может превышать capacity)
+    void (*report)(const convert_error *err, void *arg);  // Вызывается для каждой ошибки (может быть NULL)
+    void *arg;
+    int replace;          // 1 - на месте каждой ошибки перекодирование пишет U+FFFD (в кодовой странице '?')
+} convert_errors;
+
+// Результат перекодирования участка
+typedef struct {
+    size_t consumed;  // Обработано кодовых единиц входа
+    size_t produced;  // Записано кодовых единиц выхода
+    size_t errors;    // Найдено ошибок
+} convert_result;
+
+// Перекодирование участка памяти в буфер вызывающего. Кодовые единицы UTF-16 - в порядке
+// байтов машины. Перекодирование останавливается, когда следующий символ не помещается
+// в выходной буфер или (при final == 0) обрывается на конце входа; необработанный
+// остаток передаётся в следующий вызов. Смещения ошибок - в байтах от начала in.
+convert_result convert_utf16_to_utf8(const uint16_t *in, size_t in_len, uint8_t *out, size_t out_len,
+                                     int final, convert_errors *errors);
+convert_result convert_utf8_to_utf16(const uint8_t *in, size_t in_len, uint16_t *out, size_t out_len,
+                                     int final, convert_errors *errors);
+
+// Вывод диагностики об ошибке в том виде, в каком её печатают программы
+void convert_print_error(FILE *f, const convert_error *err);
+
+// Наибольшая длина текста диагностики об одной ошибке (с переводом строки и нулём)
+#define CONVERT_ERROR_TEXT_MAX 128
+
+// Текст диагностики в buf (как у snprintf); возвращает длину текста без нуля
+size_t convert_format_error(char *buf, size_t size, const convert_error *err);
+
+// Обработчик для convert_errors.report, печатающий ошибки в поток FILE *file
+void convert_report_to_file(const convert_error *err, void *file);
+
+// Блочная функция перекодирования (utf16_to_utf8_block, utf8_to_utf16_block)
+typedef size_t (*convert_block_fn)(const unsigned char *in, size_t len, int little_endian,
+                                   unsigned char *out, size_t out_cap, size_t *out_len,
+                                   long offset, int final, convert_errors *errors);
+
+// Функция проверки без перекодирования (utf16_validate_block, utf8_validate_block)
+typedef size_t (*convert_validate_fn)(const unsigned char *in, size_t len, int little_endian,
+                                      long offset, int final, convert_errors *errors);
+
+// Функция поиска границы символа (utf16_boundary, utf8_boundary)
+typedef size_t (*convert_boundary_fn)(const unsigned char *data, size_t size, size_t pos, int little_endian);
+
+// Функция для определения BOM UTF-16 в буфере: возвращает длину маркера или 0
+int utf16_bom(const unsigned char *buf, size_t len, int *little_endian);
+
+// Блочное перекодирование UTF-16 -> UTF-8 в байтовом представлении с заданным порядком байтов.
+// Возвращает количество обработанных байтов входа. Незаконченный хвост (нечётный байт,
+// старшая часть суррогатной пары) остаётся необработанным, если final == 0.
+// offset - смещение начала блока относительно начала файла (для диагностики).
+size_t utf16_to_utf8_block(const unsigned char *in, size_t len, int little_endian,
+                           unsigned char *out, size_t out_cap, size_t *out_len,
+                           long offset, int final, convert_errors *errors);
+
+// Функция для определения BOM UTF-8 в буфере: возвращает длину маркера или 0
+int utf8_bom(const unsigned char *buf, size_t len);
+
+// Блочное перекодирование UTF-8 -> UTF-16 с полной проверкой входа
+// (избыточные записи, суррогаты, значения больше U+10FFFF).
+// Соглашения те же, что у utf16_to_utf8_block.
+size_t utf8_to_utf16_block(const unsigned char *in, size_t len, int little_endian,
+                           unsigned char *out, size_t out_cap, size_t *out_len,
+                           long offset, int final, convert_errors *errors);
+
+// Проверка без перекодирования: находит те же ошибки, что и блочное перекодирование,
+// но ничего не пишет. Возвращает количество проверенных байтов входа; незаконченный
+// хвост остаётся непроверенным, если final == 0. little_endian для UTF-8 не используется.
+size_t utf16_validate_block(const unsigned char *in, size_t len, int little_endian,
+                            long offset, int final, convert_errors *errors);
+size_t utf8_validate_block(const unsigned char *in, size_t len, int little_endian,
+                           long offset, int final, convert_errors *errors);
+
+// Размер результата перекодирования
+typedef struct {
+    size_t codepoints;  // Символы (кодовые точки)
+    size_t units;       // Кодовые единицы: байты UTF-8 или 16-битные единицы UTF-16
+} convert_counts;
+
+// Функция подсчёта без перекодирования (utf16_count_block, utf8_count_block)
+typedef size_t (*convert_count_fn)(const unsigned char *in, size_t len, int little_endian,
+                                   long offset, int final, convert_errors *errors, convert_counts *counts);
+
+// Подсчёт без перекодирования: то же, что проверка, но к counts добавляется точный размер
+// результата блочного перекодирования того же участка (некорректные последовательности
+// в результат не попадают). utf16_count_block считает байты UTF-8, utf8_count_block -
+// кодовые единицы UTF-16.
+size_t utf16_count_block(const unsigned char *in, size_t len, int little_endian,
+                         long offset, int final, convert_errors *errors, convert_counts *counts);
+size_t utf8_count_block(const unsigned char *in, size_t len, int little_endian,
+                        long offset, int final, convert_errors *errors, convert_counts *counts);
+
+// Точный размер результата перекодирования буфера целиком (без BOM), чтобы выделить
+// выходной буфер один раз: байты UTF-8 для UTF-16 и кодовые единицы UTF-16 для UTF-8
+size_t utf8_length_from_utf16(const unsigned char *in, size_t len, int little_endian);
+size_t utf16_length_from_utf8(const unsigned char *in, size_t len);
+
+// Название вида ошибки для машиночитаемого вывода (invalid_utf8, odd_length, ...)
+const char *convert_error_name(int kind);
+
+// Границы, по которым буфер можно делить на независимо перекодируемые части
+size_t utf16_boundary(const unsigned char *data, size_t size, size_t pos, int little_endian);
+size_t utf8_boundary(const unsigned char *data, size_t size, size_t pos, int little_endian);
+
+// Реализации блочного перекодирования под наборы инструкций процессора (scalar, sse2,
+// avx2, avx512). При загрузке выбирается лучшая из поддерживаемых процессором.
+size_t convert_impl_count(void);
+const char *convert_impl_name(size_t index);   // NULL за пределами списка
+int convert_impl_supported(size_t index);
+const char *convert_current_impl(void);
+
+// Выбор реализации по имени (NULL или "auto" - лучшая из поддерживаемых). Вызывается до
+// запуска потоков перекодирования. Возвращает 0 или -1, если реализация неизвестна или
+// не поддерживается процессором.
+int convert_select_impl(const char *name);
+
+// Кодировки
+#define CONVERT_ENC_AUTO (-2)     // Определяется по началу входа (convert_detect)
+#define CONVERT_ENC_UTF8 0
+#define CONVERT_ENC_UTF16 1       // Порядок байтов задаётся отдельно
+#define CONVERT_ENC_UTF32 2       // Порядок байтов задаётся отдельно
+#define CONVERT_ENC_CP1251 3      // Однобайтовые кодовые страницы: Windows-1251
+#define CONVERT_ENC_KOI8R 4       // KOI8-R
+#define CONVERT_ENC_CP866 5       // CP866 (DOS)
+#define CONVERT_ENC_ISO8859_1 6   // ISO-8859-1 (Latin-1)
+#define CONVERT_ENC_ISO8859_5 7   // ISO-8859-5
+#define CONVERT_ENC_COUNT 8
+
+// Кодировка по имени (utf-8, utf-16le, utf-32be, cp1251, koi8-r, auto, ...) без учёта регистра;
+// -1 - неизвестное имя. Если имя задаёт порядок байтов, он записывается в *little_endian.
+int convert_encoding(const char *name, int *little_endian);
+
+// Определение кодировки по началу входа: BOM UTF-32, UTF-16 и UTF-8, затем статистика байтов
+// (нулевые байты на позициях кодовых единиц UTF-16 и UTF-32, корректность UTF-8, частоты
+// старших байтов однобайтовых кодовых страниц). Порядок байтов UTF-16 и UTF-32 записывается
+// в *little_endian. Без явных признаков возвращает CONVERT_ENC_UTF8.
+int convert_detect(const unsigned char *buf, size_t len, int *little_endian);
+
+// Функция для определения BOM UTF-32 в буфере: возвращает длину маркера (4) или 0
+int utf32_bom(const unsigned char *buf, size_t len, int *little_endian);
+
+// Запись BOM, который программы ставят в начало результата UTF-16 и UTF-32, в buf (до 4 байтов).
+// Возвращает длину маркера; для остальных кодировок - 0.
+size_t convert_write_bom(int encoding, int little_endian, unsigned char *buf);
+
+// Название кодировки для сообщений (UTF-8, CP1251, ...); NULL для неизвестной
+const char *convert_encoding_name(int encoding);
+
+// Кодовая точка байта однобайтовой кодовой страницы (CONVERT_ENC_CP1251..ISO8859_5);
+// 0 - байт в ней не определён
+unsigned int convert_sbcs_char(int encoding, unsigned char byte);
+
+// Блочное перекодирование из кодировки from в кодировку to (CONVERT_ENC_*, кроме AUTO).
+// Соглашения те же, что у utf16_to_utf8_block; in_le и out_le - порядок байтов UTF-16 и UTF-32
+// входа и результата. Пары из UTF-8, UTF-16 и UTF-32 (в том числе та же кодировка с другим
+// порядком байтов) перекодируются прямыми векторными ядрами с полной проверкой входа.
+// Однобайтовые кодовые страницы перекодируются по таблицам, частые диапазоны (буквы
+// кириллицы, Latin-1) - векторно. Байт, не определённый в кодовой странице входа, даёт
+// ошибку CONVERT_ERR_UNDEFINED_BYTE и в результат не попадает; символ, которого нет
+// в кодовой странице результата, даёт ошибку CONVERT_ERR_UNMAPPABLE и заменяется на '?'.
+size_t convert_block(int from, int to, const unsigned char *in, size_t len, int in_le,
+                     unsigned char *out, size_t out_cap, size_t *out_len, int out_le,
+                     long offset, int final, convert_errors *errors);
+
+// Направления перекодирования для потокового декодера
+#define CONVERT_UTF16_TO_UTF8 0
+#define CONVERT_UTF8_TO_UTF16 1
+
+// Сколько байтов входа накапливает декодер для определения кодировки (CONVERT_ENC_AUTO),
+// если первый фрагмент короче
+#define CONVERT_DETECT_SAMPLE 256
+
+// Размер выходного буфера, при котором convert_decoder_push обрабатывает весь фрагмент
+// (до 4 байтов UTF-32 на байт UTF-8 или однобайтовой кодировки, плюс накопленный образец)
+#define CONVERT_DECODER_OUT_MAX(len) (4 * ((len) + CONVERT_DETECT_SAMPLE) + 16)
+
+// Что декодер делает с некорректным входом (поле on_error)
+#define CONVERT_ON_ERROR_SKIP 0     // Пропускает (по умолчанию)
+#define CONVERT_ON_ERROR_REPLACE 1  // Заменяет на U+FFFD, в однобайтовой кодировке - на '?'
+#define CONVERT_ON_ERROR_ABORT 2    // Останавливается перед первой ошибкой (aborted = 1)
+
+// Состояние потокового перекодировщика: вход подаётся фрагментами произвольного размера,
+// незаконченная последовательность на конце фрагмента сохраняется до следующего
+typedef struct {
+    int from;                  // Кодировка входа (CONVERT_ENC_*; AUTO - до первого фрагмента)
+    int to;                    // Кодировка результата
+    int little_endian;         // Порядок байтов входа UTF-16 и UTF-32 (после BOM - по маркеру)
+    int out_little_endian;     // Порядок байтов результата UTF-16 и UTF-32
+    int bom_phase;             // 1 - начало потока ещё не проверено на BOM
+    int bom_found;             // Длина BOM в начале потока (он не перекодируется), 0 - BOM нет
+    unsigned char sample[CONVERT_DETECT_SAMPLE];  // Начало входа для определения кодировки
+    size_t sample_len;
+    unsigned char pending[8];  // Необработанные байты предыдущих фрагментов
+    size_t pending_len;
+    long offset;               // Смещение первого необработанного байта от начала потока
+    int on_error;              // CONVERT_ON_ERROR_*; задаётся после convert_decoder_init_pair
+    int aborted;               // 1 - перекодирование остановлено ошибкой, дальнейший вход отбрасывается
+} convert_decoder;
+
+// Функция для подготовки декодера; little_endian - порядок байтов UTF-16 при отсутствии BOM
+void convert_decoder_init(convert_decoder *dec, int direction, int little_endian);
+
+// То же для любой пары кодировок (CONVERT_ENC_*); BOM ищется только во входе UTF-8, UTF-16
+// и UTF-32. При from == CONVERT_ENC_AUTO кодировка входа определяется convert_detect по первому
+// фрагменту или по первым CONVERT_DETECT_SAMPLE байтам, если фрагменты мельче. in_le и out_le - порядок байтов входа (при отсутствии BOM) и результата.
+void convert_decoder_init_pair(convert_decoder *dec, int from, int to, int in_le, int out_le);
+
+// Подача очередного фрагмента. Возвращает количество принятых байтов: все, если
+// out_cap >= CONVERT_DECODER_OUT_MAX(len), иначе остаток нужно подать повторно.
+size_t convert_decoder_push(convert_decoder *dec, const unsigned char *in, size_t len,
+                            unsigned char *out, size_t out_cap, size_t *out_len, convert_errors *errors);
+
+// Завершение потока: обработка сохранённого хвоста и диагностика оборванной последовательности.
+// out_cap должен быть не меньше CONVERT_DECODER_OUT_MAX(0).
+void convert_decoder_finish(convert_decoder *dec, unsigned char *out, size_t out_cap, size_t *out_len,
+                            convert_errors *errors);
+
 #endif  // CONVERT_H
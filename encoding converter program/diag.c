@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include "diag.h"
+
+// Наибольшая длина строки об одной ошибке без начала prefix
+#define DIAG_LINE_MAX (CONVERT_ERROR_TEXT_MAX + 64)
+
+// Размер буфера, в котором строки собираются для одного fwrite
+#define DIAG_TEXT_SIZE (16 * 1024)
+
+int diag_mode(const char *name) {
+    if (strcmp(name, "summary") == 0) {
+        return DIAG_SUMMARY;
+    } else if (strcmp(name, "text") == 0) {
+        return DIAG_TEXT;
+    } else if (strcmp(name, "json") == 0) {
+        return DIAG_JSON;
+    }
+    return -1;
+}
+
+// Строка s в кавычках JSON в буфер dst (до 6 байтов на байт s и 3 на кавычки и ноль)
+static size_t json_quote(char *dst, const char *s) {
+    char *p = dst;
+    *p++ = '"';
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = c;
+        } else if (c < 0x20) {
+            p += sprintf(p, "\\u%04x", c);
+        } else {
+            *p++ = c;
+        }
+    }
+    *p++ = '"';
+    *p = '\0';
+    return p - dst;
+}
+
+int diag_init(diag_log *d, int mode, size_t max_errors, FILE *out, const char *name) {
+    memset(d, 0, sizeof(*d));
+    d->mode = mode;
+    d->max_errors = mode == DIAG_SUMMARY ? 0 : max_errors;
+    d->out = out;
+
+    // Начало строк: "имя: " для текста, {"file": "имя", для JSON
+    size_t len = name ? strlen(name) : 0;
+    d->prefix = malloc(6 * len + 16);
+    if (!d->prefix) {
+        return -1;
+    }
+    char *p = d->prefix;
+    if (mode == DIAG_JSON) {
+        *p++ = '{';
+        if (name) {
+            p += sprintf(p, "\"file\": ");
+            p += json_quote(p, name);
+            p += sprintf(p, ", ");
+        }
+    } else if (name) {
+        p += sprintf(p, "%s: ", name);
+    }
+    *p = '\0';
+
+    // Выводящему журналу хватает кольца постоянного размера, накопителю - до max_errors
+    d->ring_cap = d->max_errors < DIAG_RING ? d->max_errors : DIAG_RING;
+    if (d->ring_cap) {
+        d->ring = malloc(d->ring_cap * sizeof(*d->ring));
+        if (!d->ring) {
+            free(d->prefix);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Подробная строка об ошибке (без начала prefix)
+static size_t format_line(const diag_log *d, char *buf, const convert_error *err) {
+    if (d->mode != DIAG_JSON) {
+        return convert_format_error(buf, DIAG_LINE_MAX, err);
+    }
+    int n = sprintf(buf, "\"offset\": %ld, \"kind\": \"%s\", \"bytes\": [", err->offset,
+                    convert_error_name(err->kind));
+    for (size_t b = 0; b < err->length; b++) {
+        n += sprintf(buf + n, "%s%u", b ? ", " : "", err->bytes[b]);
+    }
+    n += sprintf(buf + n, "]}\n");
+    return (size_t)n;
+}
+
+// Вывод кольца одним блоком (fwrite сам не перемешивает блоки разных потоков)
+static void diag_flush(diag_log *d) {
+    if (!d->out || d->ring_len == 0) {
+        return;
+    }
+    size_t prefix_len = strlen(d->prefix);
+    size_t cap = DIAG_TEXT_SIZE + prefix_len + DIAG_LINE_MAX;
+    char *text = malloc(cap);
+    size_t len = 0;
+    for (size_t k = 0; k < d->ring_len; k++) {
+        if (!text) {
+            // Без буфера - построчно
+            char line[DIAG_LINE_MAX];
+            size_t n = format_line(d, line, &d->ring[k]);
+            fputs(d->prefix, d->out);
+            fwrite(line, 1, n, d->out);
+            continue;
+        }
+        if (len > DIAG_TEXT_SIZE) {
+            fwrite(text, 1, len, d->out);
+            len = 0;
+        }
+        memcpy(text + len, d->prefix, prefix_len);
+        len += prefix_len;
+        len += format_line(d, text + len, &d->ring[k]);
+    }
+    if (text) {
+        fwrite(text, 1, len, d->out);
+        free(text);
+    }
+    d->ring_len = 0;
+}
+
+// Запоминание ошибки для подробного вывода (счётчики уже учтены)
+static void diag_keep(diag_log *d, const convert_error *err) {
+    if (d->shown >= d->max_errors) {
+        return;
+    }
+    if (d->ring_len == d->ring_cap) {
+        if (d->out) {
+            diag_flush(d);
+        } else {
+            size_t cap = d->ring_cap * 2 < d->max_errors ? d->ring_cap * 2 : d->max_errors;
+            convert_error *ring = realloc(d->ring, cap * sizeof(*ring));
+            if (!ring) {
+                return;  // Ошибка останется только в счётчиках
+            }
+            d->ring = ring;
+            d->ring_cap = cap;
+        }
+    }
+    d->ring[d->ring_len++] = *err;
+    d->shown++;
+}
+
+void diag_report(const convert_error *err, void *arg) {
+    diag_log *d = arg;
+    d->total++;
+    d->by_kind[err->kind < CONVERT_ERR_KINDS ? err->kind : 0]++;
+    diag_keep(d, err);
+}
+
+void diag_merge(diag_log *dst, const diag_log *src) {
+    dst->total += src->total;
+    for (int k = 0; k < CONVERT_ERR_KINDS; k++) {
+        dst->by_kind[k] += src->by_kind[k];
+    }
+    for (size_t k = 0; k < src->ring_len; k++) {
+        diag_keep(dst, &src->ring[k]);
+    }
+}
+
+void diag_finish(diag_log *d) {
+    diag_flush(d);
+    if (!d->out || (d->mode != DIAG_JSON && (d->total == 0 || (d->mode == DIAG_TEXT && d->total == d->shown)))) {
+        return;
+    }
+
+    // Итог: число ошибок каждого вида
+    char kinds[CONVERT_ERR_KINDS * 40] = "";
+    size_t len = 0;
+    for (int k = 0; k < CONVERT_ERR_KINDS; k++) {
+        if (d->by_kind[k]) {
+            len += sprintf(kinds + len, d->mode == DIAG_JSON ? "%s\"%s\": %zu" : "%s%s: %zu", len ? ", " : "",
+                           convert_error_name(k), d->by_kind[k]);
+        }
+    }
+    if (d->mode == DIAG_JSON) {
+        fprintf(d->out, "%s\"errors\": %zu, \"shown\": %zu, \"by_kind\": {%s}}\n", d->prefix, d->total, d->shown,
+                kinds);
+    } else {
+        if (d->total > d->shown && d->mode == DIAG_TEXT) {
+            fprintf(d->out, "%s... %zu more error%s not shown\n", d->prefix, d->total - d->shown,
+                    d->total - d->shown == 1 ? "" : "s");
+        }
+        fprintf(d->out, "%s%zu error%s (%s)\n", d->prefix, d->total, d->total == 1 ? "" : "s", kinds);
+    }
+}
+
+void diag_free(diag_log *d) {
+    free(d->prefix);
+    free(d->ring);
+    d->prefix = NULL;
+    d->ring = NULL;
+}
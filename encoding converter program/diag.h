@@ -0,0 +1,54 @@
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <stdio.h>
+#include "convert.h"
+
+// Формат диагностики (--errors)
+#define DIAG_SUMMARY 0  // Только итог: число ошибок каждого вида
+#define DIAG_TEXT 1     // Строка на ошибку (как convert_print_error) и итог, если вывод был урезан
+#define DIAG_JSON 2     // Объект JSON на ошибку и итоговый объект
+
+// Сколько ошибок накапливается перед выводом одним блоком
+#define DIAG_RING 256
+
+// По умолчанию подробно выводятся первые DIAG_MAX_ERRORS ошибок (--max-errors)
+#define DIAG_MAX_ERRORS 100
+
+// Журнал ошибок входа. Ошибки считаются по видам все, а подробно выводятся первые
+// max_errors: они копятся в кольце и выводятся одним fwrite, когда оно заполнится,
+// и в diag_finish. Журнал без потока (out == NULL) только накапливает ошибки, чтобы
+// потом передать их другому журналу через diag_merge.
+typedef struct {
+    int mode;                           // DIAG_*
+    size_t max_errors;
+    FILE *out;
+    char *prefix;                       // Начало каждой строки (с именем файла, если оно задано)
+    size_t total;                       // Все ошибки
+    size_t shown;                       // Ошибки, выведенные или ожидающие вывода подробно
+    size_t by_kind[CONVERT_ERR_KINDS];  // Ошибки по видам (CONVERT_ERR_*)
+    convert_error *ring;                // Ошибки, ожидающие вывода
+    size_t ring_len;
+    size_t ring_cap;
+} diag_log;
+
+// Функция для определения формата по имени (summary, text, json); -1 - неизвестное имя
+int diag_mode(const char *name);
+
+// Функция для подготовки журнала; name - имя файла для строк диагностики или NULL.
+// Возвращает 0 или -1 при нехватке памяти.
+int diag_init(diag_log *d, int mode, size_t max_errors, FILE *out, const char *name);
+
+// Обработчик для convert_errors.report (arg - diag_log *)
+void diag_report(const convert_error *err, void *arg);
+
+// Добавление ошибок журнала-накопителя src в конец журнала dst
+void diag_merge(diag_log *dst, const diag_log *src);
+
+// Вывод накопленных ошибок и итога
+void diag_finish(diag_log *d);
+
+// Освобождение журнала (без вывода)
+void diag_free(diag_log *d);
+
+#endif  // DIAG_H
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "index.h"
+
+// Заголовок файла индекса; за ним числа по 8 байтов в порядке little-endian
+static const char index_magic[8] = "CVINDEX1";
+
+struct convert_index_builder {
+    convert_index ix;
+    size_t points_cap;
+    size_t lines_cap;
+    int started;                // Кодировка входа известна, начало текста записано
+    int on_error;               // Политика декодера (CONVERT_ON_ERROR_*)
+    long output_offset;
+    convert_index_point cur;    // Позиция конца обработанного результата
+    convert_error *errors;      // Ошибки, до которых результат ещё не дошёл
+    size_t errors_len;
+    size_t errors_head;
+    size_t errors_cap;
+    int failed;                 // Не хватило памяти
+};
+
+convert_index_builder *convert_index_builder_new(size_t interval, long output_offset) {
+    convert_index_builder *b = calloc(1, sizeof(*b));
+    if (b) {
+        b->ix.interval = interval ? interval : CONVERT_INDEX_INTERVAL;
+        b->output_offset = output_offset;
+    }
+    return b;
+}
+
+// Добавление элемента в массив, растущий вдвое
+static int grow(void **array, size_t *cap, size_t len, size_t size) {
+    if (len < *cap) {
+        return 0;
+    }
+    size_t n = *cap ? *cap * 2 : 256;
+    void *p = realloc(*array, n * size);
+    if (!p) {
+        return -1;
+    }
+    *array = p;
+    *cap = n;
+    return 0;
+}
+
+static void add_point(convert_index_builder *b) {
+    convert_index *ix = &b->ix;
+    if (ix->npoints && memcmp(&ix->points[ix->npoints - 1], &b->cur, sizeof(b->cur)) == 0) {
+        return;
+    }
+    if (grow((void **)&ix->points, &b->points_cap, ix->npoints, sizeof(*ix->points)) != 0) {
+        b->failed = 1;
+        return;
+    }
+    ix->points[ix->npoints++] = b->cur;
+}
+
+static void add_line(convert_index_builder *b, uint64_t output_offset) {
+    convert_index *ix = &b->ix;
+    if (grow((void **)&ix->lines, &b->lines_cap, ix->nlines, sizeof(*ix->lines)) != 0) {
+        b->failed = 1;
+        return;
+    }
+    ix->lines[ix->nlines++] = output_offset;
+}
+
+// Длина символа во входе (вход без ошибок, поэтому запись кратчайшая)
+static unsigned int input_length(int encoding, unsigned int codepoint) {
+    switch (encoding) {
+        case CONVERT_ENC_UTF8:
+            return codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+        case CONVERT_ENC_UTF16:
+            return codepoint < 0x10000 ? 2 : 4;
+        case CONVERT_ENC_UTF32:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+// Символ результата в p (не дальше end): его кодовая точка и длина; 0 - текст оборван
+static size_t decode_output(const convert_index *ix, const unsigned char *p, const unsigned char *end,
+                            unsigned int *codepoint) {
+    size_t avail = end - p;
+    int le = ix->out_little_endian;
+    if (avail == 0) {
+        return 0;
+    }
+    switch (ix->to) {
+        case CONVERT_ENC_UTF8: {
+            unsigned int c = p[0];
+            size_t n = c < 0x80 ? 1 : c < 0xE0 ? 2 : c < 0xF0 ? 3 : 4;
+            if (n > avail) {
+                return 0;
+            }
+            c = n == 1 ? c : n == 2 ? c & 0x1F : n == 3 ? c & 0x0F : c & 0x07;
+            for (size_t k = 1; k < n; k++) {
+                c = (c << 6) | (p[k] & 0x3F);
+            }
+            *codepoint = c;
+            return n;
+        }
+        case CONVERT_ENC_UTF16: {
+            if (avail < 2) {
+                return 0;
+            }
+            unsigned int c = le ? p[0] | (p[1] << 8) : (p[0] << 8) | p[1];
+            if (c < 0xD800 || c > 0xDBFF) {
+                *codepoint = c;
+                return 2;
+            }
+            if (avail < 4) {
+                return 0;
+            }
+            unsigned int low = le ? p[2] | (p[3] << 8) : (p[2] << 8) | p[3];
+            *codepoint = 0x10000 + ((c - 0xD800) << 10) + (low - 0xDC00);
+            return 4;
+        }
+        case CONVERT_ENC_UTF32:
+            if (avail < 4) {
+                return 0;
+            }
+            *codepoint = le ? p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24)
+                            : ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+            return 4;
+        default:
+            *codepoint = convert_sbcs_char(ix->to, p[0]);
+            return 1;
+    }
+}
+
+// Переход через символ результата: позиция во входе - по длине символа в кодировке входа
+static size_t step(const convert_index *ix, const unsigned char *p, const unsigned char *end,
+                   convert_index_point *pt, unsigned int *codepoint) {
+    size_t n = decode_output(ix, p, end, codepoint);
+    if (n) {
+        pt->pos[CONVERT_POS_CODEPOINT]++;
+        pt->pos[CONVERT_POS_UTF16] += *codepoint > 0xFFFF ? 2 : 1;
+        pt->pos[CONVERT_POS_INPUT] += input_length(ix->from, *codepoint);
+        pt->pos[CONVERT_POS_OUTPUT] += n;
+    }
+    return n;
+}
+
+void convert_index_report(const convert_error *err, void *arg) {
+    convert_index_builder *b = arg;
+    if (b->errors_head == b->errors_len) {
+        b->errors_head = b->errors_len = 0;
+    }
+    if (grow((void **)&b->errors, &b->errors_cap, b->errors_len, sizeof(*b->errors)) != 0) {
+        b->failed = 1;
+        return;
+    }
+    b->errors[b->errors_len++] = *err;
+}
+
+// Начало текста: кодировка входа определена, BOM входа пропущен
+static void start(convert_index_builder *b, const convert_decoder *dec) {
+    b->ix.from = dec->from;
+    b->ix.to = dec->to;
+    b->ix.out_little_endian = dec->out_little_endian;
+    b->on_error = dec->on_error;
+    b->cur.pos[CONVERT_POS_INPUT] = (uint64_t)dec->bom_found;
+    b->cur.pos[CONVERT_POS_OUTPUT] = (uint64_t)b->output_offset;
+    b->started = 1;
+    add_point(b);
+    add_line(b, b->cur.pos[CONVERT_POS_OUTPUT]);
+}
+
+// Обработка ошибок, до которых дошёл результат. Заменённая ошибка и символ, которого нет
+// в кодировке результата, занимают следующий символ результата; пропущенная - ничего.
+// Контрольные точки ставятся до и после ошибки, поэтому между соседними точками либо вход
+// без ошибок, либо одна ошибка и не больше одного символа результата.
+static const unsigned char *take_errors(convert_index_builder *b, const unsigned char *p, const unsigned char *end) {
+    while (b->errors_head < b->errors_len) {
+        const convert_error *err = &b->errors[b->errors_head];
+        uint64_t start = (uint64_t)err->offset;
+        uint64_t stop = start + err->length;
+        if (err->kind == CONVERT_ERR_INVALID_LOW_SURROGATE) {
+            // Пропускается высокая часть пары перед нижней
+            stop = start;
+            start -= 2;
+        }
+        if (start > b->cur.pos[CONVERT_POS_INPUT]) {
+            break;
+        }
+        add_point(b);
+        int replaced = err->kind == CONVERT_ERR_UNMAPPABLE ? b->on_error != CONVERT_ON_ERROR_ABORT
+                                                           : b->on_error == CONVERT_ON_ERROR_REPLACE;
+        if (replaced) {
+            unsigned int c;
+            size_t n = step(&b->ix, p, end, &b->cur, &c);
+            if (n == 0) {
+                break;  // Замена будет в следующем результате
+            }
+            p += n;
+        }
+        b->cur.pos[CONVERT_POS_INPUT] = stop;
+        b->errors_head++;
+        add_point(b);
+    }
+    return p;
+}
+
+void convert_index_add(convert_index_builder *b, const convert_decoder *dec, const unsigned char *out, size_t len) {
+    if (!b->started) {
+        if (dec->from == CONVERT_ENC_AUTO || dec->bom_phase) {
+            return;  // Результата ещё нет
+        }
+        start(b, dec);
+    }
+
+    const unsigned char *p = out;
+    const unsigned char *end = out + len;  // out может быть NULL при len == 0
+    for (;;) {
+        p = take_errors(b, p, end);
+        if (p >= end) {
+            break;
+        }
+        unsigned int c;
+        size_t n = step(&b->ix, p, end, &b->cur, &c);
+        if (n == 0) {
+            break;
+        }
+        p += n;
+        if (c == '\n') {
+            add_line(b, b->cur.pos[CONVERT_POS_OUTPUT]);
+        }
+        if (b->cur.pos[CONVERT_POS_CODEPOINT] - b->ix.points[b->ix.npoints - 1].pos[CONVERT_POS_CODEPOINT] >=
+            b->ix.interval) {
+            add_point(b);
+        }
+    }
+}
+
+int convert_index_finish(convert_index_builder *b, const convert_decoder *dec, convert_index *ix) {
+    convert_index_add(b, dec, NULL, 0);
+    if (!b->started) {
+        start(b, dec);
+    }
+    // Ошибки в конце входа: оборванная последовательность, остановка
+    take_errors(b, NULL, NULL);
+    add_point(b);
+
+    int status = b->failed ? -1 : 0;
+    *ix = b->ix;
+    if (status != 0) {
+        convert_index_free(ix);
+    }
+    free(b->errors);
+    free(b);
+    return status;
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+    for (int k = 0; k < 8; k++) {
+        p[k] = (unsigned char)(v >> (8 * k));
+    }
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+    uint64_t v = 0;
+    for (int k = 7; k >= 0; k--) {
+        v = (v << 8) | p[k];
+    }
+    return v;
+}
+
+// Запись чисел по 8 байтов
+static int write_u64s(FILE *f, const uint64_t *v, size_t count) {
+    unsigned char buf[8 * 512];
+    while (count > 0) {
+        size_t n = count < 512 ? count : 512;
+        for (size_t k = 0; k < n; k++) {
+            put_u64(buf + 8 * k, v[k]);
+        }
+        if (fwrite(buf, 8, n, f) != n) {
+            return -1;
+        }
+        v += n;
+        count -= n;
+    }
+    return 0;
+}
+
+static int read_u64s(FILE *f, uint64_t *v, size_t count) {
+    unsigned char buf[8 * 512];
+    while (count > 0) {
+        size_t n = count < 512 ? count : 512;
+        if (fread(buf, 8, n, f) != n) {
+            return -1;
+        }
+        for (size_t k = 0; k < n; k++) {
+            v[k] = get_u64(buf + 8 * k);
+        }
+        v += n;
+        count -= n;
+    }
+    return 0;
+}
+
+// Файл: заголовок, interval, from, to, out_little_endian, npoints, nlines, точки, начала строк
+int convert_index_save(const convert_index *ix, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return -1;
+    }
+    uint64_t head[6] = {ix->interval, (uint64_t)ix->from, (uint64_t)ix->to, (uint64_t)ix->out_little_endian,
+                        ix->npoints, ix->nlines};
+    int status = fwrite(index_magic, 1, sizeof(index_magic), f) == sizeof(index_magic) ? 0 : -1;
+    if (status == 0) {
+        status = write_u64s(f, head, 6);
+    }
+    if (status == 0) {
+        status = write_u64s(f, (const uint64_t *)ix->points, ix->npoints * CONVERT_POS_KINDS);
+    }
+    if (status == 0) {
+        status = write_u64s(f, ix->lines, ix->nlines);
+    }
+    if (fclose(f) != 0) {
+        status = -1;
+    }
+    return status;
+}
+
+int convert_index_load(convert_index *ix, const char *path) {
+    memset(ix, 0, sizeof(*ix));
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return -1;
+    }
+    char magic[sizeof(index_magic)];
+    uint64_t head[6];
+    int status = -1;
+    if (fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, index_magic, sizeof(magic)) == 0 &&
+        read_u64s(f, head, 6) == 0 && head[0] > 0 && head[1] < CONVERT_ENC_COUNT && head[2] < CONVERT_ENC_COUNT &&
+        head[4] > 0 && head[4] < SIZE_MAX / sizeof(convert_index_point) && head[5] < SIZE_MAX / sizeof(uint64_t)) {
+        ix->interval = head[0];
+        ix->from = (int)head[1];
+        ix->to = (int)head[2];
+        ix->out_little_endian = (int)head[3];
+        ix->npoints = (size_t)head[4];
+        ix->nlines = (size_t)head[5];
+        ix->points = malloc(ix->npoints * sizeof(*ix->points));
+        ix->lines = malloc((ix->nlines ? ix->nlines : 1) * sizeof(*ix->lines));
+        if (ix->points && ix->lines &&
+            read_u64s(f, (uint64_t *)ix->points, ix->npoints * CONVERT_POS_KINDS) == 0 &&
+            read_u64s(f, ix->lines, ix->nlines) == 0) {
+            status = 0;
+        }
+    }
+    fclose(f);
+    if (status != 0) {
+        convert_index_free(ix);
+    }
+    return status;
+}
+
+int convert_index_translate(const convert_index *ix, const unsigned char *text, size_t text_len,
+                            int from_kind, uint64_t pos, int to_kind, uint64_t *result) {
+    const convert_index_point *points = ix->points;
+    if (ix->npoints == 0 || pos > points[ix->npoints - 1].pos[from_kind]) {
+        return -1;
+    }
+
+    // Последняя точка, не дальше pos
+    size_t lo = 0, hi = ix->npoints;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (points[mid].pos[from_kind] <= pos) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // Проход по символам до pos; последний символ перед следующей точкой приводит точно к ней
+    // (так учитывается ошибка, заменённая этим символом)
+    convert_index_point cur = points[lo];
+    if (lo + 1 < ix->npoints) {
+        const convert_index_point *next = &points[lo + 1];
+        if (next->pos[CONVERT_POS_OUTPUT] > text_len) {
+            return -1;
+        }
+        while (cur.pos[CONVERT_POS_OUTPUT] < next->pos[CONVERT_POS_OUTPUT]) {
+            convert_index_point pt = cur;
+            unsigned int c;
+            if (step(ix, text + pt.pos[CONVERT_POS_OUTPUT], text + next->pos[CONVERT_POS_OUTPUT], &pt, &c) == 0) {
+                return -1;
+            }
+            if (pt.pos[CONVERT_POS_OUTPUT] == next->pos[CONVERT_POS_OUTPUT]) {
+                pt = *next;
+            }
+            if (pt.pos[from_kind] > pos) {
+                break;
+            }
+            cur = pt;
+        }
+    }
+    *result = cur.pos[to_kind];
+    return 0;
+}
+
+size_t convert_index_line_of(const convert_index *ix, uint64_t output_offset) {
+    // Последнее начало строки, не дальше output_offset
+    size_t lo = 0, hi = ix->nlines;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ix->lines[mid] <= output_offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void convert_index_free(convert_index *ix) {
+    free(ix->points);
+    free(ix->lines);
+    ix->points = NULL;
+    ix->lines = NULL;
+    ix->npoints = 0;
+    ix->nlines = 0;
+}
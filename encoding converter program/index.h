@@ -0,0 +1,76 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "convert.h"
+
+// Разреженный индекс позиций перекодированного текста. Контрольные точки ставятся через
+// каждые interval символов и после каждой ошибки входа; точка хранит одну и ту же позицию
+// в четырёх системах отсчёта. Кроме точек хранятся начала строк результата. Позиция
+// переводится из одной системы в другую двоичным поиском ближайшей точки и проходом
+// по тексту результата не дальше следующей точки.
+
+// Символов между контрольными точками по умолчанию
+#define CONVERT_INDEX_INTERVAL 1024
+
+// Системы отсчёта позиций
+#define CONVERT_POS_CODEPOINT 0  // Символы текста
+#define CONVERT_POS_UTF16 1      // Кодовые единицы UTF-16 (индексы строк Java, .NET, JavaScript)
+#define CONVERT_POS_INPUT 2      // Байты входного файла
+#define CONVERT_POS_OUTPUT 3     // Байты файла результата
+#define CONVERT_POS_KINDS 4
+
+typedef struct {
+    uint64_t pos[CONVERT_POS_KINDS];  // Позиция по CONVERT_POS_*
+} convert_index_point;
+
+typedef struct {
+    int from;                     // Кодировка входа (CONVERT_ENC_*, уже определённая)
+    int to;                       // Кодировка результата
+    int out_little_endian;        // Порядок байтов результата UTF-16 и UTF-32
+    uint64_t interval;
+    convert_index_point *points;  // По возрастанию; первая - начало текста, последняя - конец
+    size_t npoints;
+    uint64_t *lines;              // Байт результата, с которого начинается каждая строка
+    size_t nlines;
+} convert_index;
+
+// Построитель индекса, который получает результат и ошибки потокового декодера
+typedef struct convert_index_builder convert_index_builder;
+
+// Функция для создания построителя (NULL при нехватке памяти). output_offset - сколько
+// байтов (BOM) записано в файл результата до текста; interval 0 - CONVERT_INDEX_INTERVAL.
+convert_index_builder *convert_index_builder_new(size_t interval, long output_offset);
+
+// Обработчик для convert_errors.report (arg - построитель); ошибки передаются до результата
+// того же вызова декодера, как это и делает convert_decoder_push
+void convert_index_report(const convert_error *err, void *arg);
+
+// Очередной результат декодера dec (целые символы)
+void convert_index_add(convert_index_builder *b, const convert_decoder *dec, const unsigned char *out, size_t len);
+
+// Завершение построения после convert_decoder_finish: индекс переносится в ix, построитель
+// освобождается. Возвращает 0 или -1 при нехватке памяти.
+int convert_index_finish(convert_index_builder *b, const convert_decoder *dec, convert_index *ix);
+
+// Запись индекса в файл и чтение из файла. Возвращают 0 или -1 (ошибка ввода-вывода,
+// нехватка памяти, файл не индекса).
+int convert_index_save(const convert_index *ix, const char *path);
+int convert_index_load(convert_index *ix, const char *path);
+
+// Перевод позиции pos из системы from_kind в систему to_kind (CONVERT_POS_*). text - содержимое
+// файла результата (например, отображённое в память). Позиция внутри символа (середина
+// суррогатной пары, байт многобайтовой последовательности) или внутри пропущенной ошибки
+// переводится в его начало. Возвращает 0 или -1, если позиция за концом текста или
+// text короче проиндексированного результата.
+int convert_index_translate(const convert_index *ix, const unsigned char *text, size_t text_len,
+                            int from_kind, uint64_t pos, int to_kind, uint64_t *result);
+
+// Номер строки (с 0), в которой находится байт результата output_offset
+size_t convert_index_line_of(const convert_index *ix, uint64_t output_offset);
+
+// Освобождение индекса
+void convert_index_free(convert_index *ix);
+
+#endif  // INDEX_H
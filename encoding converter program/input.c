@@ -0,0 +1,108 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "input.h"
+
+// Функция для открытия входного файла
+int input_open(input_source *src, const char *path, int mode) {
+    src->file = path != NULL ? fopen(path, "rb") : stdin;
+    src->data = NULL;
+    src->size = 0;
+    src->mapped = 0;
+    src->map_base = NULL;
+    src->map_size = 0;
+    src->head = NULL;
+    src->head_len = 0;
+
+    if (!src->file) {
+        return INPUT_ERR_OPEN;
+    }
+    if (mode == INPUT_STDIO) {
+        return 0;
+    }
+
+    // Отображать в память можно только обычные файлы; каналы и терминалы читаются через stdio
+    int fd = fileno(src->file);
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        // Стандартный ввод мог быть уже частично прочитан - начинаем с текущей позиции
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if (pos < 0 || pos > st.st_size) {
+            pos = 0;
+        }
+
+        if (st.st_size == 0) {
+            src->mapped = 1;  // Пустой файл: отображать нечего
+            return 0;
+        }
+
+        void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (base != MAP_FAILED) {
+            madvise(base, st.st_size, MADV_SEQUENTIAL);  // Разрешаем ядру упреждающее чтение
+            src->map_base = base;
+            src->map_size = st.st_size;
+            src->data = (const unsigned char *)base + pos;
+            src->size = st.st_size - pos;
+            src->mapped = 1;
+            return 0;
+        }
+    }
+
+    if (mode == INPUT_MMAP) {
+        input_close(src);
+        return INPUT_ERR_MMAP;
+    }
+    return 0;
+}
+
+// Начало входа
+int input_peek(input_source *src, size_t cap, const unsigned char **data, size_t *len) {
+    if (src->mapped) {
+        *data = src->data;
+        *len = src->size < cap ? src->size : cap;
+        return 0;
+    }
+    if (!src->head) {
+        // Чтение через read: байты не должны остаться в буфере stdio, поток может читаться
+        // и мимо него (aio.h)
+        src->head = malloc(cap ? cap : 1);
+        if (!src->head) {
+            return -1;
+        }
+        int fd = fileno(src->file);
+        while (src->head_len < cap) {
+            ssize_t r = read(fd, src->head + src->head_len, cap - src->head_len);
+            if (r < 0 && errno == EINTR) {
+                continue;
+            }
+            if (r < 0) {
+                return -1;
+            }
+            if (r == 0) {
+                break;
+            }
+            src->head_len += (size_t)r;
+        }
+    }
+    *data = src->head;
+    *len = src->head_len;
+    return 0;
+}
+
+// Функция для закрытия входного файла
+void input_close(input_source *src) {
+    if (src->map_base) {
+        munmap(src->map_base, src->map_size);
+    }
+    free(src->head);
+    src->head = NULL;
+    src->head_len = 0;
+    if (src->file && src->file != stdin) {
+        fclose(src->file);
+    }
+    src->file = NULL;
+    src->data = NULL;
+    src->map_base = NULL;
+}
@@ -0,0 +1,40 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Способы чтения входного файла
+#define INPUT_AUTO 0   // Отображение в память для обычных файлов, stdio для каналов
+#define INPUT_MMAP 1   // Только отображение в память
+#define INPUT_STDIO 2  // Только чтение через stdio
+
+// Ошибки открытия входного файла
+#define INPUT_ERR_OPEN -1  // Файл не удалось открыть
+#define INPUT_ERR_MMAP -2  // Файл не удалось отобразить в память
+
+// Входной файл: либо отображён в память целиком, либо читается из потока
+typedef struct {
+    FILE *file;                 // Поток (для stdio - единственный источник данных)
+    const unsigned char *data;  // Содержимое файла, если mapped == 1
+    size_t size;                // Размер содержимого
+    int mapped;                 // 1 - файл отображён в память
+    void *map_base;             // Начало отображения (для munmap)
+    size_t map_size;            // Размер отображения
+    unsigned char *head;        // Начало потока, прочитанное input_peek: идёт раньше file
+    size_t head_len;
+} input_source;
+
+// Функция для открытия входного файла (path == NULL - стандартный ввод)
+int input_open(input_source *src, const char *path, int mode);
+
+// Начало входа (не больше cap байтов), например для определения кодировки. Отображённый
+// файл просто не читается; из потока байты читаются мимо буфера stdio в src->head, и кто
+// читает поток дальше, сначала берёт их оттуда. Возвращает 0 или -1 (ошибка чтения или
+// нехватка памяти).
+int input_peek(input_source *src, size_t cap, const unsigned char **data, size_t *len);
+
+// Функция для закрытия входного файла и снятия отображения
+void input_close(input_source *src);
+
+#endif  // INPUT_H
@@ -0,0 +1,271 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "parallel.h"
+
+// Часть входа и результат её перекодирования
+typedef struct {
+    const unsigned char *start;
+    size_t len;
+    int final;        // Часть заканчивается на конце входа
+    size_t used;      // Сколько байтов входа обработано
+    int done;
+} chunk_job;
+
+// Буфер результата; буферов меньше, чем частей, и они используются по кругу
+typedef struct {
+    unsigned char *out;
+    size_t out_cap;
+    size_t out_len;
+    diag_log diag;    // Ошибки части (накопитель, выводятся по порядку частей)
+} chunk_slot;
+
+typedef struct {
+    chunk_job *jobs;
+    size_t njobs;
+    chunk_slot *slots;
+    size_t nslots;
+    size_t next;      // Следующая часть для перекодирования
+    size_t written;   // Сколько частей уже выведено
+    int failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    const unsigned char *data;
+    long offset;
+    int little_endian;
+    convert_block_fn convert;
+    diag_log *diag;
+} parallel_ctx;
+
+// Функция для определения числа потоков
+int parallel_threads(int requested) {
+    if (requested > 0) {
+        return requested;
+    }
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+// Перекодирование одной части в её буфер
+static int run_job(parallel_ctx *ctx, chunk_job *job, chunk_slot *slot) {
+    // С запасом для обоих направлений: не больше 2 байтов выхода на байт входа
+    size_t need = job->len * 2 + 16;
+    if (slot->out_cap < need) {
+        unsigned char *p = realloc(slot->out, need);
+        if (!p) {
+            return -1;
+        }
+        slot->out = p;
+        slot->out_cap = need;
+    }
+
+    diag_free(&slot->diag);
+    if (diag_init(&slot->diag, ctx->diag->mode, ctx->diag->max_errors, NULL, NULL) != 0) {
+        return -1;
+    }
+
+    convert_errors errors = {NULL, 0, 0, diag_report, &slot->diag, 0};
+    job->used = ctx->convert(job->start, job->len, ctx->little_endian, slot->out, slot->out_cap,
+                             &slot->out_len, ctx->offset + (long)(job->start - ctx->data), job->final,
+                             &errors);
+    return 0;
+}
+
+static void *worker(void *arg) {
+    parallel_ctx *ctx = arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    for (;;) {
+        // Не уходим вперёд больше чем на число буферов от последней выведенной части
+        while (ctx->next < ctx->njobs && ctx->next >= ctx->written + ctx->nslots && !ctx->failed) {
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        }
+        if (ctx->next >= ctx->njobs || ctx->failed) {
+            break;
+        }
+        size_t idx = ctx->next++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        int rc = run_job(ctx, &ctx->jobs[idx], &ctx->slots[idx % ctx->nslots]);
+
+        pthread_mutex_lock(&ctx->lock);
+        if (rc) {
+            ctx->failed = 1;
+        }
+        ctx->jobs[idx].done = 1;
+        pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+// Перекодирование участка памяти; возвращает количество обработанных байтов или -1
+static long long convert_region(const unsigned char *data, size_t size, FILE *out, int little_endian,
+                                long offset, int final, int nthreads,
+                                convert_block_fn convert, convert_boundary_fn boundary, diag_log *diag,
+                                stats_counters *stats) {
+    uint64_t mark = stats ? stats_now() : 0;  // Ожидание частей - фаза перекодирования
+    parallel_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.data = data;
+    ctx.offset = offset;
+    ctx.little_endian = little_endian;
+    ctx.convert = convert;
+    ctx.diag = diag;
+
+    // Делим вход на части; каждая, кроме последней, заканчивается на границе символа
+    size_t max_jobs = size / PARALLEL_CHUNK_SIZE + 1;
+    ctx.jobs = calloc(max_jobs, sizeof(chunk_job));
+    ctx.nslots = (size_t)nthreads * 2;
+    ctx.slots = calloc(ctx.nslots, sizeof(chunk_slot));
+    if (!ctx.jobs || !ctx.slots) {
+        free(ctx.jobs);
+        free(ctx.slots);
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+
+    size_t pos = 0;
+    while (pos < size && ctx.njobs < max_jobs) {
+        size_t end = size;
+        if (size - pos > PARALLEL_CHUNK_SIZE && ctx.njobs + 1 < max_jobs) {
+            end = boundary(data, size, pos + PARALLEL_CHUNK_SIZE, little_endian);
+        }
+        chunk_job *job = &ctx.jobs[ctx.njobs++];
+        job->start = data + pos;
+        job->len = end - pos;
+        job->final = (end < size) || final;
+        pos = end;
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+
+    int nworkers = nthreads < (int)ctx.njobs ? nthreads : (int)ctx.njobs;
+    pthread_t *threads = calloc(nworkers > 0 ? nworkers : 1, sizeof(pthread_t));
+    int started = 0;
+    while (threads && started < nworkers && pthread_create(&threads[started], NULL, worker, &ctx) == 0) {
+        started++;
+    }
+    if (started == 0 && ctx.njobs > 0) {
+        ctx.failed = 1;
+    }
+
+    // Вывод результатов строго по порядку частей
+    size_t used = 0;
+    for (size_t k = 0; k < ctx.njobs; k++) {
+        pthread_mutex_lock(&ctx.lock);
+        while (!ctx.jobs[k].done && !ctx.failed) {
+            pthread_cond_wait(&ctx.cond, &ctx.lock);
+        }
+        int failed = ctx.failed;
+        pthread_mutex_unlock(&ctx.lock);
+        if (failed) {
+            break;
+        }
+
+        chunk_slot *slot = &ctx.slots[k % ctx.nslots];
+        diag_merge(diag, &slot->diag);
+        stats_count(stats, slot->out, slot->out_len);
+        stats_lap(stats, STATS_TRANSCODE, &mark);
+        fwrite(slot->out, 1, slot->out_len, out);
+        stats_lap(stats, STATS_WRITE, &mark);
+        used = (ctx.jobs[k].start - data) + ctx.jobs[k].used;
+
+        pthread_mutex_lock(&ctx.lock);
+        ctx.written++;
+        pthread_cond_broadcast(&ctx.cond);
+        pthread_mutex_unlock(&ctx.lock);
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+
+    int failed = ctx.failed;
+    free(threads);
+    for (size_t s = 0; s < ctx.nslots; s++) {
+        free(ctx.slots[s].out);
+        diag_free(&ctx.slots[s].diag);
+    }
+    free(ctx.slots);
+    free(ctx.jobs);
+    pthread_mutex_destroy(&ctx.lock);
+    pthread_cond_destroy(&ctx.cond);
+
+    if (failed) {
+        fprintf(stderr, "Error: parallel conversion failed\n");
+        return -1;
+    }
+    return (long long)used;
+}
+
+// Многопоточное перекодирование данных в памяти
+int parallel_convert_buffer(const unsigned char *data, size_t size, FILE *out, int little_endian,
+                            long offset, int nthreads,
+                            convert_block_fn convert, convert_boundary_fn boundary, diag_log *diag,
+                            stats_counters *stats) {
+    if (stats) {
+        stats->bytes_in += (uint64_t)offset + size;
+    }
+    return convert_region(data, size, out, little_endian, offset, 1, nthreads, convert, boundary, diag,
+                          stats) < 0 ? -1 : 0;
+}
+
+// Многопоточное перекодирование потока
+int parallel_convert_stream(FILE *in, FILE *out, int little_endian,
+                            const unsigned char *head, size_t head_len, long offset, int nthreads,
+                            convert_block_fn convert, convert_boundary_fn boundary, diag_log *diag,
+                            stats_counters *stats) {
+    size_t batch = (size_t)nthreads * PARALLEL_CHUNK_SIZE;
+    unsigned char *buf = malloc(batch + head_len + 8);
+    if (!buf) {
+        fprintf(stderr, "Error: out of memory\n");
+        return -1;
+    }
+
+    // Остаток предыдущего пакета всегда меньше 4 байтов (в первом пакете - весь head)
+    size_t keep = head_len;
+    memcpy(buf, head, head_len);
+
+    int status = 0;
+    int final;
+    uint64_t mark = 0;
+    if (stats) {
+        stats->bytes_in += (uint64_t)offset + head_len;
+        mark = stats_now();
+    }
+    do {
+        size_t n = fread(buf + keep, 1, batch, in);
+        size_t len = keep + n;
+        final = (n == 0);  // fread возвращает 0 только в конце файла или при ошибке
+        if (stats) {
+            stats->bytes_in += n;
+            stats_lap(stats, STATS_READ, &mark);
+        }
+
+        long long used = convert_region(buf, len, out, little_endian, offset, final, nthreads,
+                                        convert, boundary, diag, stats);
+        if (stats) {
+            mark = stats_now();
+        }
+        if (used < 0) {
+            status = -1;
+            break;
+        }
+
+        offset += (long)used;
+        keep = len - (size_t)used;
+        memmove(buf, buf + used, keep);
+    } while (!final);
+
+    if (ferror(in)) {
+        fprintf(stderr, "Error: read error at offset %ld\n", offset);
+        status = -1;
+    }
+
+    free(buf);
+    return status;
+}
@@ -0,0 +1,30 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stdio.h>
+#include "convert.h"
+#include "diag.h"
+#include "stats.h"
+
+// Размер части входа, перекодируемой одним потоком выполнения
+#define PARALLEL_CHUNK_SIZE (4 * 1024 * 1024)
+
+// Функция для определения числа потоков: 0 - по числу процессоров
+int parallel_threads(int requested);
+
+// Многопоточное перекодирование данных, целиком находящихся в памяти.
+// Вход делится на части по границам символов, части перекодируются независимо,
+// результат выводится в исходном порядке, ошибки передаются в diag в том же порядке.
+// Если stats != NULL, в неё добавляются размеры, символы результата и время фаз.
+int parallel_convert_buffer(const unsigned char *data, size_t size, FILE *out, int little_endian,
+                            long offset, int nthreads,
+                            convert_block_fn convert, convert_boundary_fn boundary, diag_log *diag,
+                            stats_counters *stats);
+
+// Многопоточное перекодирование потока: вход читается пакетами по части на поток
+int parallel_convert_stream(FILE *in, FILE *out, int little_endian,
+                            const unsigned char *head, size_t head_len, long offset, int nthreads,
+                            convert_block_fn convert, convert_boundary_fn boundary, diag_log *diag,
+                            stats_counters *stats);
+
+#endif  // PARALLEL_H
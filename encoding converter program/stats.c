@@ -0,0 +1,175 @@
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+uint64_t stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+// Длина символа в UTF-8
+static unsigned char utf8_length(unsigned int codepoint) {
+    return codepoint < 0x80 ? 1 : codepoint < 0x800 ? 2 : codepoint < 0x10000 ? 3 : 4;
+}
+
+void stats_init(stats_counters *st, int to, int to_le) {
+    memset(st, 0, sizeof(*st));
+    st->from = -1;
+    st->to = to;
+    st->to_le = to_le;
+    st->threads = 1;
+    if (to >= CONVERT_ENC_CP1251) {
+        for (int b = 0; b < 256; b++) {
+            st->sbcs_len[b] = utf8_length(convert_sbcs_char(to, (unsigned char)b));
+        }
+    }
+    st->start_ns = stats_now();
+}
+
+void stats_lap(stats_counters *st, int phase, uint64_t *mark) {
+    if (!st) {
+        return;
+    }
+    uint64_t now = stats_now();
+    st->phase_ns[phase] += now - *mark;
+    *mark = now;
+}
+
+// Подсчёт символов результата UTF-16 (как в stats_count для UTF-8, по участкам). hi - смещение
+// старшего байта кодовой единицы; функция подставляется в вызов с постоянным hi, чтобы цикл
+// векторизовался. Суррогатная пара считается по старшей половине.
+static inline void count_utf16(stats_counters *st, const unsigned char *out, size_t units, const int hi) {
+    uint64_t ascii = 0, wide = 0, high = 0, low = 0;
+    size_t k = 0;
+    for (; k + 128 <= units; k += 128) {
+        const unsigned char *p = out + 2 * k;
+        unsigned char c_ascii = 0, c_wide = 0, c_high = 0, c_low = 0;
+        for (size_t j = 0; j < 256; j += 2) {
+            c_ascii += (p[j + hi] | (p[j + 1 - hi] & 0x80)) == 0;
+            c_wide += p[j + hi] >= 0x08;
+            c_high += (p[j + hi] & 0xFC) == 0xD8;
+            c_low += (p[j + hi] & 0xFC) == 0xDC;
+        }
+        ascii += c_ascii;
+        wide += c_wide;
+        high += c_high;
+        low += c_low;
+    }
+    for (; k < units; k++) {
+        unsigned char h = out[2 * k + hi];
+        ascii += (h | (out[2 * k + 1 - hi] & 0x80)) == 0;
+        wide += h >= 0x08;
+        high += (h & 0xFC) == 0xD8;
+        low += (h & 0xFC) == 0xDC;
+    }
+    st->chars[0] += ascii;
+    st->chars[1] += units - ascii - wide;
+    st->chars[2] += wide - high - low;
+    st->chars[3] += high;
+}
+
+void stats_count(stats_counters *st, const unsigned char *out, size_t len) {
+    if (!st) {
+        return;
+    }
+    st->bytes_out += len;
+    if (st->to == CONVERT_ENC_UTF8) {
+        // Символы считаются по первым байтам. Сравнения без ветвлений в участках постоянной
+        // длины с байтовыми счётчиками векторизуются; в общие счётчики участок переносится,
+        // пока байтовые не переполнились.
+        size_t k = 0;
+        for (; k + 128 <= len; k += 128) {
+            unsigned char ascii = 0, lead2 = 0, lead3 = 0, lead4 = 0;
+            for (size_t j = k; j < k + 128; j++) {
+                ascii += out[j] < 0x80;
+                lead2 += out[j] >= 0xC0;
+                lead3 += out[j] >= 0xE0;
+                lead4 += out[j] >= 0xF0;
+            }
+            st->chars[0] += ascii;
+            st->chars[1] += lead2 - lead3;
+            st->chars[2] += lead3 - lead4;
+            st->chars[3] += lead4;
+        }
+        for (; k < len; k++) {
+            st->chars[0] += out[k] < 0x80;
+            st->chars[1] += out[k] >= 0xC0 && out[k] < 0xE0;
+            st->chars[2] += out[k] >= 0xE0 && out[k] < 0xF0;
+            st->chars[3] += out[k] >= 0xF0;
+        }
+    } else if (st->to == CONVERT_ENC_UTF16) {
+        if (st->to_le) {
+            count_utf16(st, out, len / 2, 1);
+        } else {
+            count_utf16(st, out, len / 2, 0);
+        }
+    } else if (st->to == CONVERT_ENC_UTF32) {
+        for (size_t k = 0; k + 4 <= len; k += 4) {
+            unsigned int codepoint = st->to_le
+                ? (unsigned int)out[k] | out[k + 1] << 8 | out[k + 2] << 16 | (unsigned int)out[k + 3] << 24
+                : (unsigned int)out[k] << 24 | out[k + 1] << 16 | out[k + 2] << 8 | out[k + 3];
+            st->chars[utf8_length(codepoint) - 1]++;
+        }
+    } else {
+        for (size_t k = 0; k < len; k++) {
+            st->chars[st->sbcs_len[out[k]] - 1]++;
+        }
+    }
+}
+
+// Название кодировки с порядком байтов (UTF-16LE, CP1251, ...)
+static void encoding_label(char *buf, int encoding, int little_endian) {
+    const char *name = convert_encoding_name(encoding);
+    int wide = encoding == CONVERT_ENC_UTF16 || encoding == CONVERT_ENC_UTF32;
+    sprintf(buf, "%s%s", name ? name : "unknown", !wide ? "" : little_endian ? "LE" : "BE");
+}
+
+void stats_print(stats_counters *st, const diag_log *diag, int json, FILE *out) {
+    st->total_ns = stats_now() - st->start_ns;
+    char from[32], to[32];
+    encoding_label(from, st->from, st->from_le);
+    encoding_label(to, st->to, st->to_le);
+    uint64_t chars = st->chars[0] + st->chars[1] + st->chars[2] + st->chars[3];
+    double seconds = st->total_ns / 1e9;
+    double mbps = st->total_ns ? st->bytes_in / 1e6 / seconds : 0;
+
+    // Ошибки по видам
+    char kinds[CONVERT_ERR_KINDS * 40] = "";
+    size_t len = 0;
+    for (int k = 0; k < CONVERT_ERR_KINDS; k++) {
+        if (diag->by_kind[k]) {
+            len += sprintf(kinds + len, json ? "%s\"%s\": %zu" : "%s%s: %zu", len ? ", " : "",
+                           convert_error_name(k), diag->by_kind[k]);
+        }
+    }
+
+    if (json) {
+        fprintf(out, "{\"input\": {\"encoding\": \"%s\", \"bytes\": %llu, \"io\": \"%s\"}, "
+                     "\"output\": {\"encoding\": \"%s\", \"bytes\": %llu, \"io\": \"%s\"}, \"threads\": %d, "
+                     "\"codepoints\": %llu, \"by_length\": [%llu, %llu, %llu, %llu], \"surrogate_pairs\": %llu, "
+                     "\"errors\": %zu, \"by_kind\": {%s}, "
+                     "\"seconds\": {\"total\": %.6f, \"read\": %.6f, \"transcode\": %.6f, \"write\": %.6f}, "
+                     "\"mb_per_s\": %.1f}\n",
+                from, (unsigned long long)st->bytes_in, st->io_read, to, (unsigned long long)st->bytes_out,
+                st->io_write, st->threads, (unsigned long long)chars, (unsigned long long)st->chars[0],
+                (unsigned long long)st->chars[1], (unsigned long long)st->chars[2],
+                (unsigned long long)st->chars[3], (unsigned long long)st->chars[3], diag->total, kinds,
+                seconds, st->phase_ns[STATS_READ] / 1e9, st->phase_ns[STATS_TRANSCODE] / 1e9,
+                st->phase_ns[STATS_WRITE] / 1e9, mbps);
+    } else {
+        fprintf(out, "stats: %s -> %s, %d thread%s, read %s, write %s\n", from, to, st->threads,
+                st->threads == 1 ? "" : "s", st->io_read, st->io_write);
+        fprintf(out, "  bytes: %llu in, %llu out\n", (unsigned long long)st->bytes_in,
+                (unsigned long long)st->bytes_out);
+        fprintf(out, "  code points: %llu (1 byte: %llu, 2 bytes: %llu, 3 bytes: %llu, 4 bytes: %llu), "
+                     "%llu surrogate pair%s\n",
+                (unsigned long long)chars, (unsigned long long)st->chars[0], (unsigned long long)st->chars[1],
+                (unsigned long long)st->chars[2], (unsigned long long)st->chars[3],
+                (unsigned long long)st->chars[3], st->chars[3] == 1 ? "" : "s");
+        fprintf(out, "  errors: %zu%s%s%s\n", diag->total, len ? " (" : "", kinds, len ? ")" : "");
+        fprintf(out, "  time: %.6f s (read %.6f s, transcode %.6f s, write %.6f s), %.1f MB/s\n", seconds,
+                st->phase_ns[STATS_READ] / 1e9, st->phase_ns[STATS_TRANSCODE] / 1e9,
+                st->phase_ns[STATS_WRITE] / 1e9, mbps);
+    }
+}
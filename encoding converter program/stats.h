@@ -0,0 +1,52 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "diag.h"
+
+// Фазы перекодирования, время которых измеряется (--stats)
+#define STATS_READ 0       // Ожидание входа
+#define STATS_TRANSCODE 1  // Перекодирование (в многопоточном режиме - ожидание частей от потоков)
+#define STATS_WRITE 2      // Ожидание записи результата
+#define STATS_PHASES 3
+
+// Статистика одного перекодирования. Время фаз - время потока, который ведёт перекодирование:
+// при чтении и записи впереди и позади него (aio.h) в фазы чтения и записи попадает только
+// ожидание, поэтому по ним видно, упирается ли работа в ввод-вывод или в процессор.
+// Без --stats статистика не ведётся: вместо неё передаётся NULL.
+typedef struct {
+    int from;                         // Кодировка входа (уже определённая) и её порядок байтов
+    int from_le;
+    int to;                           // Кодировка результата и её порядок байтов
+    int to_le;
+    int threads;
+    const char *io_read;              // Способ чтения (mmap, stdio или aio_stream_mode)
+    const char *io_write;             // Способ записи
+    uint64_t bytes_in;                // Байты входа, включая BOM
+    uint64_t bytes_out;               // Байты результата, включая BOM
+    uint64_t chars[4];                // Символы результата по длине в UTF-8 (1-4 байта)
+    uint64_t phase_ns[STATS_PHASES];  // Время фаз STATS_*
+    uint64_t start_ns;
+    uint64_t total_ns;                // Всё время перекодирования
+    unsigned char sbcs_len[256];      // Длина в UTF-8 символа каждого байта кодовой страницы to
+} stats_counters;
+
+// Текущее время (монотонные часы) в наносекундах
+uint64_t stats_now(void);
+
+// Функция для подготовки статистики перекодирования в кодировку to; отсчёт времени начинается
+void stats_init(stats_counters *st, int to, int to_le);
+
+// Добавление к фазе phase времени с *mark до текущего момента; *mark становится текущим
+// моментом. При st == NULL ничего не делает.
+void stats_lap(stats_counters *st, int phase, uint64_t *mark);
+
+// Учёт len байтов результата (целые символы в кодировке to). При st == NULL ничего не делает.
+void stats_count(stats_counters *st, const unsigned char *out, size_t len);
+
+// Остановка отсчёта времени и вывод статистики с числом ошибок из diag (при json == 1 -
+// одной строкой JSON)
+void stats_print(stats_counters *st, const diag_log *diag, int json, FILE *out);
+
+#endif  // STATS_H